@@ -1942,6 +1942,51 @@ void   ctrl_msg__event__station_disconnect_from_espsoft_ap__free_unpacked
   assert(message->base.descriptor == &ctrl_msg__event__station_disconnect_from_espsoft_ap__descriptor);
   protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
 }
+void   ctrl_msg__event__apscan_result__init
+                     (CtrlMsgEventAPScanResult         *message)
+{
+  static const CtrlMsgEventAPScanResult init_value = CTRL_MSG__EVENT__APSCAN_RESULT__INIT;
+  *message = init_value;
+}
+size_t ctrl_msg__event__apscan_result__get_packed_size
+                     (const CtrlMsgEventAPScanResult *message)
+{
+  assert(message->base.descriptor == &ctrl_msg__event__apscan_result__descriptor);
+  return protobuf_c_message_get_packed_size ((const ProtobufCMessage*)(message));
+}
+size_t ctrl_msg__event__apscan_result__pack
+                     (const CtrlMsgEventAPScanResult *message,
+                      uint8_t       *out)
+{
+  assert(message->base.descriptor == &ctrl_msg__event__apscan_result__descriptor);
+  return protobuf_c_message_pack ((const ProtobufCMessage*)message, out);
+}
+size_t ctrl_msg__event__apscan_result__pack_to_buffer
+                     (const CtrlMsgEventAPScanResult *message,
+                      ProtobufCBuffer *buffer)
+{
+  assert(message->base.descriptor == &ctrl_msg__event__apscan_result__descriptor);
+  return protobuf_c_message_pack_to_buffer ((const ProtobufCMessage*)message, buffer);
+}
+CtrlMsgEventAPScanResult *
+       ctrl_msg__event__apscan_result__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data)
+{
+  return (CtrlMsgEventAPScanResult *)
+     protobuf_c_message_unpack (&ctrl_msg__event__apscan_result__descriptor,
+                                allocator, len, data);
+}
+void   ctrl_msg__event__apscan_result__free_unpacked
+                     (CtrlMsgEventAPScanResult *message,
+                      ProtobufCAllocator *allocator)
+{
+  if(!message)
+    return;
+  assert(message->base.descriptor == &ctrl_msg__event__apscan_result__descriptor);
+  protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
+}
 void   ctrl_msg__init
                      (CtrlMsg         *message)
 {
@@ -3083,9 +3128,29 @@ const ProtobufCMessageDescriptor ctrl_msg__resp__start_soft_ap__descriptor =
   (ProtobufCMessageInit) ctrl_msg__resp__start_soft_ap__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
-#define ctrl_msg__req__scan_result__field_descriptors NULL
-#define ctrl_msg__req__scan_result__field_indices_by_name NULL
-#define ctrl_msg__req__scan_result__number_ranges NULL
+static const ProtobufCFieldDescriptor ctrl_msg__req__scan_result__field_descriptors[1] =
+{
+  {
+    "stream",
+    1,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_BOOL,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgReqScanResult, stream),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+};
+static const unsigned ctrl_msg__req__scan_result__field_indices_by_name[] = {
+  0,   /* field[0] = stream */
+};
+static const ProtobufCIntRange ctrl_msg__req__scan_result__number_ranges[1 + 1] =
+{
+  { 1, 0 },
+  { 0, 1 }
+};
 const ProtobufCMessageDescriptor ctrl_msg__req__scan_result__descriptor =
 {
   PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
@@ -3094,10 +3159,10 @@ const ProtobufCMessageDescriptor ctrl_msg__req__scan_result__descriptor =
   "CtrlMsgReqScanResult",
   "",
   sizeof(CtrlMsgReqScanResult),
-  0,
+  1,
   ctrl_msg__req__scan_result__field_descriptors,
   ctrl_msg__req__scan_result__field_indices_by_name,
-  0,  ctrl_msg__req__scan_result__number_ranges,
+  1,  ctrl_msg__req__scan_result__number_ranges,
   (ProtobufCMessageInit) ctrl_msg__req__scan_result__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
@@ -3247,9 +3312,55 @@ const ProtobufCMessageDescriptor ctrl_msg__resp__soft_apconnected_sta__descripto
   (ProtobufCMessageInit) ctrl_msg__resp__soft_apconnected_sta__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
-#define ctrl_msg__req__otabegin__field_descriptors NULL
-#define ctrl_msg__req__otabegin__field_indices_by_name NULL
-#define ctrl_msg__req__otabegin__number_ranges NULL
+static const ProtobufCFieldDescriptor ctrl_msg__req__otabegin__field_descriptors[3] =
+{
+  {
+    "compressed",
+    1,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_BOOL,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgReqOTABegin, compressed),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "image_id",
+    2,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgReqOTABegin, image_id),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "image_size",
+    3,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgReqOTABegin, image_size),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+};
+static const unsigned ctrl_msg__req__otabegin__field_indices_by_name[] = {
+  0,   /* field[0] = compressed */
+  1,   /* field[1] = image_id */
+  2,   /* field[2] = image_size */
+};
+static const ProtobufCIntRange ctrl_msg__req__otabegin__number_ranges[1 + 1] =
+{
+  { 1, 0 },
+  { 0, 3 }
+};
 const ProtobufCMessageDescriptor ctrl_msg__req__otabegin__descriptor =
 {
   PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
@@ -3258,14 +3369,14 @@ const ProtobufCMessageDescriptor ctrl_msg__req__otabegin__descriptor =
   "CtrlMsgReqOTABegin",
   "",
   sizeof(CtrlMsgReqOTABegin),
-  0,
+  3,
   ctrl_msg__req__otabegin__field_descriptors,
   ctrl_msg__req__otabegin__field_indices_by_name,
-  0,  ctrl_msg__req__otabegin__number_ranges,
+  1,  ctrl_msg__req__otabegin__number_ranges,
   (ProtobufCMessageInit) ctrl_msg__req__otabegin__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
-static const ProtobufCFieldDescriptor ctrl_msg__resp__otabegin__field_descriptors[1] =
+static const ProtobufCFieldDescriptor ctrl_msg__resp__otabegin__field_descriptors[2] =
 {
   {
     "resp",
@@ -3279,14 +3390,27 @@ static const ProtobufCFieldDescriptor ctrl_msg__resp__otabegin__field_descriptor
     0,             /* flags */
     0,NULL,NULL    /* reserved1,reserved2, etc */
   },
+  {
+    "resume_offset",
+    2,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgRespOTABegin, resume_offset),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
 };
 static const unsigned ctrl_msg__resp__otabegin__field_indices_by_name[] = {
   0,   /* field[0] = resp */
+  1,   /* field[1] = resume_offset */
 };
 static const ProtobufCIntRange ctrl_msg__resp__otabegin__number_ranges[1 + 1] =
 {
   { 1, 0 },
-  { 0, 1 }
+  { 0, 2 }
 };
 const ProtobufCMessageDescriptor ctrl_msg__resp__otabegin__descriptor =
 {
@@ -3296,14 +3420,14 @@ const ProtobufCMessageDescriptor ctrl_msg__resp__otabegin__descriptor =
   "CtrlMsgRespOTABegin",
   "",
   sizeof(CtrlMsgRespOTABegin),
-  1,
+  2,
   ctrl_msg__resp__otabegin__field_descriptors,
   ctrl_msg__resp__otabegin__field_indices_by_name,
   1,  ctrl_msg__resp__otabegin__number_ranges,
   (ProtobufCMessageInit) ctrl_msg__resp__otabegin__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
-static const ProtobufCFieldDescriptor ctrl_msg__req__otawrite__field_descriptors[1] =
+static const ProtobufCFieldDescriptor ctrl_msg__req__otawrite__field_descriptors[2] =
 {
   {
     "ota_data",
@@ -3317,14 +3441,27 @@ static const ProtobufCFieldDescriptor ctrl_msg__req__otawrite__field_descriptors
     0,             /* flags */
     0,NULL,NULL    /* reserved1,reserved2, etc */
   },
+  {
+    "offset",
+    2,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgReqOTAWrite, offset),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
 };
 static const unsigned ctrl_msg__req__otawrite__field_indices_by_name[] = {
+  1,   /* field[1] = offset */
   0,   /* field[0] = ota_data */
 };
 static const ProtobufCIntRange ctrl_msg__req__otawrite__number_ranges[1 + 1] =
 {
   { 1, 0 },
-  { 0, 1 }
+  { 0, 2 }
 };
 const ProtobufCMessageDescriptor ctrl_msg__req__otawrite__descriptor =
 {
@@ -3334,14 +3471,14 @@ const ProtobufCMessageDescriptor ctrl_msg__req__otawrite__descriptor =
   "CtrlMsgReqOTAWrite",
   "",
   sizeof(CtrlMsgReqOTAWrite),
-  1,
+  2,
   ctrl_msg__req__otawrite__field_descriptors,
   ctrl_msg__req__otawrite__field_indices_by_name,
   1,  ctrl_msg__req__otawrite__number_ranges,
   (ProtobufCMessageInit) ctrl_msg__req__otawrite__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
-static const ProtobufCFieldDescriptor ctrl_msg__resp__otawrite__field_descriptors[1] =
+static const ProtobufCFieldDescriptor ctrl_msg__resp__otawrite__field_descriptors[2] =
 {
   {
     "resp",
@@ -3355,14 +3492,27 @@ static const ProtobufCFieldDescriptor ctrl_msg__resp__otawrite__field_descriptor
     0,             /* flags */
     0,NULL,NULL    /* reserved1,reserved2, etc */
   },
+  {
+    "checkpoint",
+    2,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgRespOTAWrite, checkpoint),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
 };
 static const unsigned ctrl_msg__resp__otawrite__field_indices_by_name[] = {
+  1,   /* field[1] = checkpoint */
   0,   /* field[0] = resp */
 };
 static const ProtobufCIntRange ctrl_msg__resp__otawrite__number_ranges[1 + 1] =
 {
   { 1, 0 },
-  { 0, 1 }
+  { 0, 2 }
 };
 const ProtobufCMessageDescriptor ctrl_msg__resp__otawrite__descriptor =
 {
@@ -3372,7 +3522,7 @@ const ProtobufCMessageDescriptor ctrl_msg__resp__otawrite__descriptor =
   "CtrlMsgRespOTAWrite",
   "",
   sizeof(CtrlMsgRespOTAWrite),
-  1,
+  2,
   ctrl_msg__resp__otawrite__field_descriptors,
   ctrl_msg__resp__otawrite__field_indices_by_name,
   1,  ctrl_msg__resp__otawrite__number_ranges,
@@ -4039,7 +4189,84 @@ const ProtobufCMessageDescriptor ctrl_msg__event__station_disconnect_from_espsof
   (ProtobufCMessageInit) ctrl_msg__event__station_disconnect_from_espsoft_ap__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
-static const ProtobufCFieldDescriptor ctrl_msg__field_descriptors[48] =
+static const ProtobufCFieldDescriptor ctrl_msg__event__apscan_result__field_descriptors[4] =
+{
+  {
+    "resp",
+    1,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_INT32,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgEventAPScanResult, resp),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "chnl",
+    2,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgEventAPScanResult, chnl),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "entries",
+    3,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_MESSAGE,
+    offsetof(CtrlMsgEventAPScanResult, n_entries),
+    offsetof(CtrlMsgEventAPScanResult, entries),
+    &scan_result__descriptor,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "scan_done",
+    4,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_BOOL,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsgEventAPScanResult, scan_done),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+};
+static const unsigned ctrl_msg__event__apscan_result__field_indices_by_name[] = {
+  1,   /* field[1] = chnl */
+  2,   /* field[2] = entries */
+  0,   /* field[0] = resp */
+  3,   /* field[3] = scan_done */
+};
+static const ProtobufCIntRange ctrl_msg__event__apscan_result__number_ranges[1 + 1] =
+{
+  { 1, 0 },
+  { 0, 4 }
+};
+const ProtobufCMessageDescriptor ctrl_msg__event__apscan_result__descriptor =
+{
+  PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+  "CtrlMsg_Event_APScanResult",
+  "CtrlMsgEventAPScanResult",
+  "CtrlMsgEventAPScanResult",
+  "",
+  sizeof(CtrlMsgEventAPScanResult),
+  4,
+  ctrl_msg__event__apscan_result__field_descriptors,
+  ctrl_msg__event__apscan_result__field_indices_by_name,
+  1,  ctrl_msg__event__apscan_result__number_ranges,
+  (ProtobufCMessageInit) ctrl_msg__event__apscan_result__init,
+  NULL,NULL,NULL    /* reserved[123] */
+};
+static const ProtobufCFieldDescriptor ctrl_msg__field_descriptors[50] =
 {
   {
     "msg_type",
@@ -4065,6 +4292,18 @@ static const ProtobufCFieldDescriptor ctrl_msg__field_descriptors[48] =
     0,             /* flags */
     0,NULL,NULL    /* reserved1,reserved2, etc */
   },
+  {
+    "uid",
+    3,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(CtrlMsg, uid),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
   {
     "req_get_mac_address",
     101,
@@ -4617,64 +4856,78 @@ static const ProtobufCFieldDescriptor ctrl_msg__field_descriptors[48] =
     0 | PROTOBUF_C_FIELD_FLAG_ONEOF,             /* flags */
     0,NULL,NULL    /* reserved1,reserved2, etc */
   },
+  {
+    "event_ap_scan_result",
+    305,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_MESSAGE,
+    offsetof(CtrlMsg, payload_case),
+    offsetof(CtrlMsg, event_ap_scan_result),
+    &ctrl_msg__event__apscan_result__descriptor,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_ONEOF,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
 };
 static const unsigned ctrl_msg__field_indices_by_name[] = {
-  44,   /* field[44] = event_esp_init */
-  45,   /* field[45] = event_heartbeat */
-  46,   /* field[46] = event_station_disconnect_from_AP */
-  47,   /* field[47] = event_station_disconnect_from_ESP_SoftAP */
+  49,   /* field[49] = event_ap_scan_result */
+  45,   /* field[45] = event_esp_init */
+  46,   /* field[46] = event_heartbeat */
+  47,   /* field[47] = event_station_disconnect_from_AP */
+  48,   /* field[48] = event_station_disconnect_from_ESP_SoftAP */
   1,   /* field[1] = msg_id */
   0,   /* field[0] = msg_type */
-  22,   /* field[22] = req_config_heartbeat */
-  8,   /* field[8] = req_connect_ap */
-  9,   /* field[9] = req_disconnect_ap */
-  7,   /* field[7] = req_get_ap_config */
-  2,   /* field[2] = req_get_mac_address */
-  16,   /* field[16] = req_get_power_save_mode */
-  10,   /* field[10] = req_get_softap_config */
-  21,   /* field[21] = req_get_wifi_curr_tx_power */
-  4,   /* field[4] = req_get_wifi_mode */
-  17,   /* field[17] = req_ota_begin */
-  19,   /* field[19] = req_ota_end */
-  18,   /* field[18] = req_ota_write */
-  6,   /* field[6] = req_scan_ap_list */
-  3,   /* field[3] = req_set_mac_address */
-  15,   /* field[15] = req_set_power_save_mode */
-  11,   /* field[11] = req_set_softap_vendor_specific_ie */
-  20,   /* field[20] = req_set_wifi_max_tx_power */
-  5,   /* field[5] = req_set_wifi_mode */
-  13,   /* field[13] = req_softap_connected_stas_list */
-  12,   /* field[12] = req_start_softap */
-  14,   /* field[14] = req_stop_softap */
-  43,   /* field[43] = resp_config_heartbeat */
-  29,   /* field[29] = resp_connect_ap */
-  30,   /* field[30] = resp_disconnect_ap */
-  28,   /* field[28] = resp_get_ap_config */
-  23,   /* field[23] = resp_get_mac_address */
-  37,   /* field[37] = resp_get_power_save_mode */
-  31,   /* field[31] = resp_get_softap_config */
-  42,   /* field[42] = resp_get_wifi_curr_tx_power */
-  25,   /* field[25] = resp_get_wifi_mode */
-  38,   /* field[38] = resp_ota_begin */
-  40,   /* field[40] = resp_ota_end */
-  39,   /* field[39] = resp_ota_write */
-  27,   /* field[27] = resp_scan_ap_list */
-  24,   /* field[24] = resp_set_mac_address */
-  36,   /* field[36] = resp_set_power_save_mode */
-  32,   /* field[32] = resp_set_softap_vendor_specific_ie */
-  41,   /* field[41] = resp_set_wifi_max_tx_power */
-  26,   /* field[26] = resp_set_wifi_mode */
-  34,   /* field[34] = resp_softap_connected_stas_list */
-  33,   /* field[33] = resp_start_softap */
-  35,   /* field[35] = resp_stop_softap */
+  23,   /* field[23] = req_config_heartbeat */
+  9,   /* field[9] = req_connect_ap */
+  10,   /* field[10] = req_disconnect_ap */
+  8,   /* field[8] = req_get_ap_config */
+  3,   /* field[3] = req_get_mac_address */
+  17,   /* field[17] = req_get_power_save_mode */
+  11,   /* field[11] = req_get_softap_config */
+  22,   /* field[22] = req_get_wifi_curr_tx_power */
+  5,   /* field[5] = req_get_wifi_mode */
+  18,   /* field[18] = req_ota_begin */
+  20,   /* field[20] = req_ota_end */
+  19,   /* field[19] = req_ota_write */
+  7,   /* field[7] = req_scan_ap_list */
+  4,   /* field[4] = req_set_mac_address */
+  16,   /* field[16] = req_set_power_save_mode */
+  12,   /* field[12] = req_set_softap_vendor_specific_ie */
+  21,   /* field[21] = req_set_wifi_max_tx_power */
+  6,   /* field[6] = req_set_wifi_mode */
+  14,   /* field[14] = req_softap_connected_stas_list */
+  13,   /* field[13] = req_start_softap */
+  15,   /* field[15] = req_stop_softap */
+  44,   /* field[44] = resp_config_heartbeat */
+  30,   /* field[30] = resp_connect_ap */
+  31,   /* field[31] = resp_disconnect_ap */
+  29,   /* field[29] = resp_get_ap_config */
+  24,   /* field[24] = resp_get_mac_address */
+  38,   /* field[38] = resp_get_power_save_mode */
+  32,   /* field[32] = resp_get_softap_config */
+  43,   /* field[43] = resp_get_wifi_curr_tx_power */
+  26,   /* field[26] = resp_get_wifi_mode */
+  39,   /* field[39] = resp_ota_begin */
+  41,   /* field[41] = resp_ota_end */
+  40,   /* field[40] = resp_ota_write */
+  28,   /* field[28] = resp_scan_ap_list */
+  25,   /* field[25] = resp_set_mac_address */
+  37,   /* field[37] = resp_set_power_save_mode */
+  33,   /* field[33] = resp_set_softap_vendor_specific_ie */
+  42,   /* field[42] = resp_set_wifi_max_tx_power */
+  27,   /* field[27] = resp_set_wifi_mode */
+  35,   /* field[35] = resp_softap_connected_stas_list */
+  34,   /* field[34] = resp_start_softap */
+  36,   /* field[36] = resp_stop_softap */
+  2,   /* field[2] = uid */
 };
 static const ProtobufCIntRange ctrl_msg__number_ranges[4 + 1] =
 {
   { 1, 0 },
-  { 101, 2 },
-  { 201, 23 },
-  { 301, 44 },
-  { 0, 48 }
+  { 101, 3 },
+  { 201, 24 },
+  { 301, 45 },
+  { 0, 50 }
 };
 const ProtobufCMessageDescriptor ctrl_msg__descriptor =
 {
@@ -4684,7 +4937,7 @@ const ProtobufCMessageDescriptor ctrl_msg__descriptor =
   "CtrlMsg",
   "",
   sizeof(CtrlMsg),
-  48,
+  50,
   ctrl_msg__field_descriptors,
   ctrl_msg__field_indices_by_name,
   4,  ctrl_msg__number_ranges,
@@ -4955,7 +5208,7 @@ const ProtobufCEnumDescriptor ctrl_msg_type__descriptor =
   ctrl_msg_type__value_ranges,
   NULL,NULL,NULL,NULL   /* reserved[1234] */
 };
-static const ProtobufCEnumValue ctrl_msg_id__enum_values_by_number[53] =
+static const ProtobufCEnumValue ctrl_msg_id__enum_values_by_number[54] =
 {
   { "MsgId_Invalid", "CTRL_MSG_ID__MsgId_Invalid", 0 },
   { "Req_Base", "CTRL_MSG_ID__Req_Base", 100 },
@@ -5009,17 +5262,19 @@ static const ProtobufCEnumValue ctrl_msg_id__enum_values_by_number[53] =
   { "Event_Heartbeat", "CTRL_MSG_ID__Event_Heartbeat", 302 },
   { "Event_StationDisconnectFromAP", "CTRL_MSG_ID__Event_StationDisconnectFromAP", 303 },
   { "Event_StationDisconnectFromESPSoftAP", "CTRL_MSG_ID__Event_StationDisconnectFromESPSoftAP", 304 },
-  { "Event_Max", "CTRL_MSG_ID__Event_Max", 305 },
+  { "Event_APScanResult", "CTRL_MSG_ID__Event_APScanResult", 305 },
+  { "Event_Max", "CTRL_MSG_ID__Event_Max", 306 },
 };
 static const ProtobufCIntRange ctrl_msg_id__value_ranges[] = {
-{0, 0},{100, 1},{200, 24},{300, 47},{0, 53}
+{0, 0},{100, 1},{200, 24},{300, 47},{0, 54}
 };
-static const ProtobufCEnumValueIndex ctrl_msg_id__enum_values_by_name[53] =
+static const ProtobufCEnumValueIndex ctrl_msg_id__enum_values_by_name[54] =
 {
+  { "Event_APScanResult", 52 },
   { "Event_Base", 47 },
   { "Event_ESPInit", 48 },
   { "Event_Heartbeat", 49 },
-  { "Event_Max", 52 },
+  { "Event_Max", 53 },
   { "Event_StationDisconnectFromAP", 50 },
   { "Event_StationDisconnectFromESPSoftAP", 51 },
   { "MsgId_Invalid", 0 },
@@ -5077,9 +5332,9 @@ const ProtobufCEnumDescriptor ctrl_msg_id__descriptor =
   "CtrlMsgId",
   "CtrlMsgId",
   "",
-  53,
+  54,
   ctrl_msg_id__enum_values_by_number,
-  53,
+  54,
   ctrl_msg_id__enum_values_by_name,
   4,
   ctrl_msg_id__value_ranges,
@@ -9,11 +9,25 @@
 #define PRIO_Q_OTHERS                             2
 #define MAX_PRIORITY_QUEUES                       3
 
+/* Priority queue bits, as in ESP_PRIV_CHECKSUM_PRIO_Q mask */
+#define ESP_PRIO_Q_BIT(prio_q)                    (1 << (prio_q))
+#define ESP_CHECKSUM_ALL_PRIO_Q                   ((1 << MAX_PRIORITY_QUEUES) - 1)
+
 /* ESP Payload Header Flags */
 #define MORE_FRAGMENT                             (1 << 0)
+/* Another esp_payload_header framed packet follows in same transfer */
+#define MORE_PKT_IN_AGGR                          (1 << 1)
+
+/* Aggregated packets start at 4 byte aligned position in transfer */
+#define ESP_AGGR_ALIGN(len)                       (((len) + 3) & ~3)
 
-/* Serial interface */
+/* Unit of xfer_len in payload header. 1600 byte SPI transfer fits in u8 */
+#define ESP_SPI_XFER_LEN_UNIT                     8
+
+/* Serial interface, may be overridden at build time (e.g. to a pty) */
+#ifndef SERIAL_IF_FILE
 #define SERIAL_IF_FILE                            "/dev/esps0"
+#endif
 
 /* Protobuf related info */
 /* Endpoints registered must have same string length */
@@ -28,7 +42,12 @@ struct esp_payload_header {
 	uint16_t         offset;
 	uint16_t         checksum;
 	uint16_t		 seq_num;
-	uint8_t          reserved2;
+	union {
+		uint8_t      reserved2;
+		/* With ESP_SPI_VAR_LEN, set in first header of transfer only:
+		 * sender data length in transfer, in ESP_SPI_XFER_LEN_UNIT */
+		uint8_t      xfer_len;
+	};
 	/* Position of union field has to always be last,
 	 * this is required for hci_pkt_type */
 	union {
@@ -49,6 +68,17 @@ typedef enum {
 	ESP_MAX_IF,
 } ESP_INTERFACE_TYPE;
 
+/* Priority queue carrying packets of given interface type */
+static inline uint8_t esp_if_type_to_prio_q(uint8_t if_type)
+{
+	if (if_type == ESP_SERIAL_IF)
+		return PRIO_Q_SERIAL;
+	else if (if_type == ESP_HCI_IF)
+		return PRIO_Q_BT;
+
+	return PRIO_Q_OTHERS;
+}
+
 typedef enum {
 	ESP_OPEN_DATA_PATH,
 	ESP_CLOSE_DATA_PATH,
@@ -56,6 +86,18 @@ typedef enum {
 	ESP_MAX_HOST_INTERRUPT,
 } ESP_HOST_INTERRUPT;
 
+/* SDIO general purpose interrupt bits raised by ESP to host */
+typedef enum {
+	/* ESP loaded a receive buffer while host waits for one */
+	ESP_TX_BUF_AVAILABLE,
+	ESP_MAX_SLAVE_INTERRUPT,
+} ESP_SLAVE_INTERRUPT;
+
+/* Byte of scratch register 0 which host sets before it waits for
+ * ESP_TX_BUF_AVAILABLE. ESP raises the interrupt only while it is set,
+ * and clears it as it does */
+#define ESP_TX_BUF_WAIT_SCRATCH_POS     0
+
 
 typedef enum {
 	ESP_WLAN_SDIO_SUPPORT = (1 << 0),
@@ -66,6 +108,10 @@ typedef enum {
 	ESP_WLAN_SPI_SUPPORT = (1 << 5),
 	ESP_BT_SPI_SUPPORT = (1 << 6),
 	ESP_CHECKSUM_ENABLED = (1 << 7),
+	/* Capabilities beyond first byte are sent in ESP_PRIV_CAPABILITY_EXT */
+	ESP_SPI_AGGREGATION = (1 << 8),
+	/* SPI transfer may end once data of both sides is clocked */
+	ESP_SPI_VAR_LEN = (1 << 9),
 } ESP_CAPABILITIES;
 
 typedef enum {
@@ -85,7 +131,9 @@ typedef enum {
 	ESP_PRIV_CAPABILITY,
 	ESP_PRIV_SPI_CLK_MHZ,
 	ESP_PRIV_FIRMWARE_CHIP_ID,
-	ESP_PRIV_TEST_RAW_TP
+	ESP_PRIV_TEST_RAW_TP,
+	ESP_PRIV_CAPABILITY_EXT,
+	ESP_PRIV_CHECKSUM_PRIO_Q,
 } ESP_PRIV_TAG_TYPE;
 
 struct esp_priv_event {
@@ -95,17 +143,49 @@ struct esp_priv_event {
 }__attribute__((packed));
 
 
+/* Checksum is sum of all bytes, modulo 2^16.
+ * Bytes are added a native word at a time, into 16 bit lanes holding odd and
+ * even bytes. Lanes are folded at most every 128 words, before overflow */
 static inline uint16_t compute_checksum(uint8_t *buf, uint16_t len)
 {
-	uint16_t checksum = 0;
-	uint16_t i = 0;
+	const unsigned long lane_mask = (~0UL / 0xFFFF) * 0xFF;
+	uint32_t checksum = 0;
+	unsigned long lanes = 0;
+	unsigned long word = 0;
+	uint16_t words = 0;
+
+	/* Leading bytes, till buf is word aligned */
+	while (len && ((uintptr_t) buf & (sizeof(word) - 1))) {
+		checksum += *buf++;
+		len--;
+	}
 
-	while(i < len) {
-		checksum += buf[i];
-		i++;
+	while (len >= sizeof(word)) {
+		/* Each lane gains at most 2*0xFF per word */
+		words = len / sizeof(word);
+		if (words > 128)
+			words = 128;
+		len -= words * sizeof(word);
+
+		lanes = 0;
+		while (words--) {
+			__builtin_memcpy(&word, buf, sizeof(word));
+			lanes += word & lane_mask;
+			lanes += (word >> 8) & lane_mask;
+			buf += sizeof(word);
+		}
+
+		while (lanes) {
+			checksum += lanes & 0xFFFF;
+			lanes >>= 16;
+		}
 	}
 
-	return checksum;
+	/* Trailing bytes */
+	while (len--)
+		checksum += *buf++;
+
+	return (uint16_t) checksum;
 }
 
 #endif
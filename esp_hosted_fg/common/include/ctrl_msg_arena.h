@@ -0,0 +1,123 @@
+// Copyright 2015-2022 Espressif Systems (Shanghai) PTE LTD
+/* SPDX-License-Identifier: GPL-2.0-only OR Apache-2.0 */
+
+/** prevent recursive inclusion **/
+#ifndef __CTRL_MSG_ARENA_H
+#define __CTRL_MSG_ARENA_H
+
+/*
+ * Bump arena for control messages, used by host and ESP.
+ *
+ * Unpacking a CtrlMsg with default allocator does one malloc per nested
+ * message, bytes field and repeated field array. With arena as
+ * ProtobufCAllocator, all of those are carved out of one buffer and are
+ * released together by ctrl_msg_arena_reset(), once the message is done with.
+ *
+ * Arena is not thread safe. It is meant to be owned by the single thread
+ * which decodes (or builds) one control message at a time.
+ * When arena is full, allocation falls back to heap. Such allocations are
+ * freed back to heap by ctrl_msg_arena_free(), so the message is then to be
+ * released with ctrl_msg_arena_free_unpacked() which takes care of both.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <protobuf-c/protobuf-c.h>
+
+/* Heap used when arena is full. May be overridden before including */
+#ifndef CTRL_MSG_ARENA_MALLOC
+#define CTRL_MSG_ARENA_MALLOC(size)         malloc(size)
+#define CTRL_MSG_ARENA_FREE(ptr)            free(ptr)
+#endif
+
+/* Every allocation is aligned for 64 bit fields */
+#define CTRL_MSG_ARENA_ALIGN                8
+
+typedef struct {
+	uint8_t *buf;
+	size_t size;
+	size_t used;
+	/* Heap allocations made as arena was full, not yet freed */
+	uint32_t heap_in_use;
+
+	/* Stats */
+	size_t peak_used;
+	uint32_t overflow;
+} ctrl_msg_arena_t;
+
+static inline void ctrl_msg_arena_init(ctrl_msg_arena_t *arena,
+		void *buf, size_t size)
+{
+	arena->buf = (uint8_t *)buf;
+	arena->size = size;
+	arena->used = 0;
+	arena->heap_in_use = 0;
+	arena->peak_used = 0;
+	arena->overflow = 0;
+}
+
+static inline int ctrl_msg_arena_owns(ctrl_msg_arena_t *arena, void *ptr)
+{
+	return ((uint8_t *)ptr >= arena->buf) &&
+		((uint8_t *)ptr < arena->buf + arena->size);
+}
+
+/* ProtobufCAllocator alloc hook, allocator_data is ctrl_msg_arena_t */
+static inline void * ctrl_msg_arena_alloc(void *allocator_data, size_t size)
+{
+	ctrl_msg_arena_t *arena = (ctrl_msg_arena_t *)allocator_data;
+	size_t aligned = (size + CTRL_MSG_ARENA_ALIGN - 1) &
+		~((size_t)CTRL_MSG_ARENA_ALIGN - 1);
+	void *ptr = NULL;
+
+	if (aligned && aligned <= arena->size - arena->used) {
+		ptr = arena->buf + arena->used;
+		arena->used += aligned;
+		if (arena->used > arena->peak_used)
+			arena->peak_used = arena->used;
+		return ptr;
+	}
+
+	arena->overflow++;
+	ptr = CTRL_MSG_ARENA_MALLOC(size);
+	if (ptr)
+		arena->heap_in_use++;
+	return ptr;
+}
+
+/* ProtobufCAllocator free hook
+ * Arena memory is reclaimed only on reset, heap fallback is freed here */
+static inline void ctrl_msg_arena_free(void *allocator_data, void *ptr)
+{
+	ctrl_msg_arena_t *arena = (ctrl_msg_arena_t *)allocator_data;
+
+	if (!ptr || ctrl_msg_arena_owns(arena, ptr))
+		return;
+
+	CTRL_MSG_ARENA_FREE(ptr);
+	arena->heap_in_use--;
+}
+
+static inline void ctrl_msg_arena_reset(ctrl_msg_arena_t *arena)
+{
+	arena->used = 0;
+}
+
+/* Release message unpacked with arena allocator and reset arena.
+ * Message is walked only if some of it had to come from heap */
+static inline void ctrl_msg_arena_free_unpacked(ctrl_msg_arena_t *arena,
+		ProtobufCAllocator *allocator, ProtobufCMessage *msg)
+{
+	if (msg && arena->heap_in_use)
+		protobuf_c_message_free_unpacked(msg, allocator);
+	ctrl_msg_arena_reset(arena);
+}
+
+#define CTRL_MSG_ARENA_ALLOCATOR(arena) {                         \
+	.alloc = ctrl_msg_arena_alloc,                                \
+	.free = ctrl_msg_arena_free,                                  \
+	.allocator_data = (arena),                                    \
+}
+
+#endif
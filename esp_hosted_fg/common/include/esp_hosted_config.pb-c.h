@@ -58,6 +58,7 @@ typedef struct CtrlMsgEventESPInit CtrlMsgEventESPInit;
 typedef struct CtrlMsgEventHeartbeat CtrlMsgEventHeartbeat;
 typedef struct CtrlMsgEventStationDisconnectFromAP CtrlMsgEventStationDisconnectFromAP;
 typedef struct CtrlMsgEventStationDisconnectFromESPSoftAP CtrlMsgEventStationDisconnectFromESPSoftAP;
+typedef struct CtrlMsgEventAPScanResult CtrlMsgEventAPScanResult;
 typedef struct CtrlMsg CtrlMsg;
 
 
@@ -199,11 +200,12 @@ typedef enum _CtrlMsgId {
   CTRL_MSG_ID__Event_Heartbeat = 302,
   CTRL_MSG_ID__Event_StationDisconnectFromAP = 303,
   CTRL_MSG_ID__Event_StationDisconnectFromESPSoftAP = 304,
+  CTRL_MSG_ID__Event_APScanResult = 305,
   /*
    * Add new control path command notification before Event_Max
    * and update Event_Max 
    */
-  CTRL_MSG_ID__Event_Max = 305
+  CTRL_MSG_ID__Event_Max = 306
     PROTOBUF_C__FORCE_ENUM_TO_BE_INT_SIZE(CTRL_MSG_ID)
 } CtrlMsgId;
 
@@ -446,10 +448,15 @@ struct  CtrlMsgRespStartSoftAP
 struct  CtrlMsgReqScanResult
 {
   ProtobufCMessage base;
+  /*
+   * Respond as soon as scan is started and send
+   * APs found as Event_APScanResult, channel by channel 
+   */
+  protobuf_c_boolean stream;
 };
 #define CTRL_MSG__REQ__SCAN_RESULT__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&ctrl_msg__req__scan_result__descriptor) \
-     }
+    , 0 }
 
 
 struct  CtrlMsgRespScanResult
@@ -490,40 +497,62 @@ struct  CtrlMsgRespSoftAPConnectedSTA
 struct  CtrlMsgReqOTABegin
 {
   ProtobufCMessage base;
+  /*
+   * OTA writes carry zlib stream of image, which ESP inflates 
+   */
+  protobuf_c_boolean compressed;
+  /*
+   * If non zero, ESP checkpoints written offset and resumes
+   * interrupted OTA of image with same id and size 
+   */
+  uint32_t image_id;
+  uint32_t image_size;
 };
 #define CTRL_MSG__REQ__OTABEGIN__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&ctrl_msg__req__otabegin__descriptor) \
-     }
+    , 0, 0, 0 }
 
 
 struct  CtrlMsgRespOTABegin
 {
   ProtobufCMessage base;
   int32_t resp;
+  /*
+   * Image offset OTA writes are to continue from 
+   */
+  uint32_t resume_offset;
 };
 #define CTRL_MSG__RESP__OTABEGIN__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&ctrl_msg__resp__otabegin__descriptor) \
-    , 0 }
+    , 0, 0 }
 
 
 struct  CtrlMsgReqOTAWrite
 {
   ProtobufCMessage base;
   ProtobufCBinaryData ota_data;
+  /*
+   * Image offset of ota_data, checked if OTA began with image_id 
+   */
+  uint32_t offset;
 };
 #define CTRL_MSG__REQ__OTAWRITE__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&ctrl_msg__req__otawrite__descriptor) \
-    , {0,NULL} }
+    , {0,NULL}, 0 }
 
 
 struct  CtrlMsgRespOTAWrite
 {
   ProtobufCMessage base;
   int32_t resp;
+  /*
+   * Image offset written durably, which OTA would resume from 
+   */
+  uint32_t checkpoint;
 };
 #define CTRL_MSG__RESP__OTAWRITE__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&ctrl_msg__resp__otawrite__descriptor) \
-    , 0 }
+    , 0, 0 }
 
 
 struct  CtrlMsgReqOTAEnd
@@ -687,6 +716,26 @@ struct  CtrlMsgEventStationDisconnectFromESPSoftAP
     , 0, {0,NULL} }
 
 
+struct  CtrlMsgEventAPScanResult
+{
+  ProtobufCMessage base;
+  int32_t resp;
+  /*
+   * channel just scanned 
+   */
+  uint32_t chnl;
+  size_t n_entries;
+  ScanResult **entries;
+  /*
+   * last event of this scan 
+   */
+  protobuf_c_boolean scan_done;
+};
+#define CTRL_MSG__EVENT__APSCAN_RESULT__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&ctrl_msg__event__apscan_result__descriptor) \
+    , 0, 0, 0,NULL, 0 }
+
+
 typedef enum {
   CTRL_MSG__PAYLOAD__NOT_SET = 0,
   CTRL_MSG__PAYLOAD_REQ_GET_MAC_ADDRESS = 101,
@@ -734,7 +783,8 @@ typedef enum {
   CTRL_MSG__PAYLOAD_EVENT_ESP_INIT = 301,
   CTRL_MSG__PAYLOAD_EVENT_HEARTBEAT = 302,
   CTRL_MSG__PAYLOAD_EVENT_STATION_DISCONNECT_FROM__AP = 303,
-  CTRL_MSG__PAYLOAD_EVENT_STATION_DISCONNECT_FROM__ESP__SOFT_AP = 304
+  CTRL_MSG__PAYLOAD_EVENT_STATION_DISCONNECT_FROM__ESP__SOFT_AP = 304,
+  CTRL_MSG__PAYLOAD_EVENT_AP_SCAN_RESULT = 305
     PROTOBUF_C__FORCE_ENUM_TO_BE_INT_SIZE(CTRL_MSG__PAYLOAD__CASE)
 } CtrlMsg__PayloadCase;
 
@@ -749,6 +799,11 @@ struct  CtrlMsg
    * msg id 
    */
   CtrlMsgId msg_id;
+  /*
+   * request sequence id, echoed back in its response.
+   * 0 when not used 
+   */
+  uint32_t uid;
   CtrlMsg__PayloadCase payload_case;
   union {
     /*
@@ -806,11 +861,12 @@ struct  CtrlMsg
     CtrlMsgEventHeartbeat *event_heartbeat;
     CtrlMsgEventStationDisconnectFromAP *event_station_disconnect_from_ap;
     CtrlMsgEventStationDisconnectFromESPSoftAP *event_station_disconnect_from_esp_softap;
+    CtrlMsgEventAPScanResult *event_ap_scan_result;
   };
 };
 #define CTRL_MSG__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&ctrl_msg__descriptor) \
-    , CTRL_MSG_TYPE__MsgType_Invalid, CTRL_MSG_ID__MsgId_Invalid, CTRL_MSG__PAYLOAD__NOT_SET, {0} }
+    , CTRL_MSG_TYPE__MsgType_Invalid, CTRL_MSG_ID__MsgId_Invalid, 0, CTRL_MSG__PAYLOAD__NOT_SET, {0} }
 
 
 /* ScanResult methods */
@@ -1630,6 +1686,25 @@ CtrlMsgEventStationDisconnectFromESPSoftAP *
 void   ctrl_msg__event__station_disconnect_from_espsoft_ap__free_unpacked
                      (CtrlMsgEventStationDisconnectFromESPSoftAP *message,
                       ProtobufCAllocator *allocator);
+/* CtrlMsgEventAPScanResult methods */
+void   ctrl_msg__event__apscan_result__init
+                     (CtrlMsgEventAPScanResult         *message);
+size_t ctrl_msg__event__apscan_result__get_packed_size
+                     (const CtrlMsgEventAPScanResult   *message);
+size_t ctrl_msg__event__apscan_result__pack
+                     (const CtrlMsgEventAPScanResult   *message,
+                      uint8_t             *out);
+size_t ctrl_msg__event__apscan_result__pack_to_buffer
+                     (const CtrlMsgEventAPScanResult   *message,
+                      ProtobufCBuffer     *buffer);
+CtrlMsgEventAPScanResult *
+       ctrl_msg__event__apscan_result__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data);
+void   ctrl_msg__event__apscan_result__free_unpacked
+                     (CtrlMsgEventAPScanResult *message,
+                      ProtobufCAllocator *allocator);
 /* CtrlMsg methods */
 void   ctrl_msg__init
                      (CtrlMsg         *message);
@@ -1780,6 +1855,9 @@ typedef void (*CtrlMsgEventStationDisconnectFromAP_Closure)
 typedef void (*CtrlMsgEventStationDisconnectFromESPSoftAP_Closure)
                  (const CtrlMsgEventStationDisconnectFromESPSoftAP *message,
                   void *closure_data);
+typedef void (*CtrlMsgEventAPScanResult_Closure)
+                 (const CtrlMsgEventAPScanResult *message,
+                  void *closure_data);
 typedef void (*CtrlMsg_Closure)
                  (const CtrlMsg *message,
                   void *closure_data);
@@ -1841,6 +1919,7 @@ extern const ProtobufCMessageDescriptor ctrl_msg__event__espinit__descriptor;
 extern const ProtobufCMessageDescriptor ctrl_msg__event__heartbeat__descriptor;
 extern const ProtobufCMessageDescriptor ctrl_msg__event__station_disconnect_from_ap__descriptor;
 extern const ProtobufCMessageDescriptor ctrl_msg__event__station_disconnect_from_espsoft_ap__descriptor;
+extern const ProtobufCMessageDescriptor ctrl_msg__event__apscan_result__descriptor;
 extern const ProtobufCMessageDescriptor ctrl_msg__descriptor;
 
 PROTOBUF_C__END_DECLS
@@ -93,7 +93,6 @@ static QueueHandle_t to_host_queue[MAX_PRIORITY_QUEUES] = {NULL};
 static protocomm_t *pc_pserial;
 
 static struct rx_data {
-	uint8_t valid;
 	uint16_t cur_seq_no;
 	int len;
 	uint8_t data[4096];
@@ -122,9 +121,9 @@ static void print_firmware_version()
 	ESP_LOGI(TAG, "*********************************************************************");
 }
 
-static uint8_t get_capabilities()
+static uint32_t get_capabilities()
 {
-	uint8_t cap = 0;
+	uint32_t cap = 0;
 
 	ESP_LOGI(TAG, "Supported features are:");
 #if CONFIG_ESP_SPI_HOST_INTERFACE
@@ -139,10 +138,20 @@ static uint8_t get_capabilities()
 	cap |= ESP_CHECKSUM_ENABLED;
 #endif
 
+#if CONFIG_ESP_SPI_HOST_INTERFACE && CONFIG_ESP_SPI_AGGREGATION
+	ESP_LOGI(TAG, "- Multi packet aggregation over SPI");
+	cap |= ESP_SPI_AGGREGATION;
+#endif
+
+#if CONFIG_ESP_SPI_HOST_INTERFACE && CONFIG_ESP_SPI_VAR_LEN
+	ESP_LOGI(TAG, "- Variable length SPI transactions");
+	cap |= ESP_SPI_VAR_LEN;
+#endif
+
 #ifdef CONFIG_BT_ENABLED
 	cap |= get_bluetooth_capabilities();
 #endif
-	ESP_LOGI(TAG, "capabilities: 0x%x", cap);
+	ESP_LOGI(TAG, "capabilities: 0x%x", (unsigned int)cap);
 
 	return cap;
 }
@@ -307,10 +316,15 @@ void send_task(void* pvParameters)
 	}
 }
 
+/* Request is copied as it is queued to pserial task, so reassembly buffer
+ * is free for next request right away. This lets host keep multiple
+ * requests in flight, without rx being held up till each is handled */
 void parse_protobuf_req(void)
 {
 	protocomm_pserial_data_ready(pc_pserial, r.data,
 		r.len, UNKNOWN_CTRL_MSG_ID);
+	r.len = 0;
+	r.cur_seq_no = 0;
 }
 
 void send_event_to_host(int event_id)
@@ -339,13 +353,6 @@ void process_serial_rx_pkt(uint8_t *buf)
 	ESP_LOG_BUFFER_HEXDUMP(TAG_RX_S, payload, payload_len, ESP_LOG_INFO);
 #endif
 
-	while (r.valid)
-	{
-		ESP_LOGI(TAG,"More segment: %u curr seq: %u header seq: %u\n",
-			header->flags & MORE_FRAGMENT, r.cur_seq_no, header->seq_num);
-		vTaskDelay(10);
-	}
-
 	if (!r.len) {
 		/* New Buffer */
 		r.cur_seq_no = le16toh(header->seq_num);
@@ -353,7 +360,6 @@ void process_serial_rx_pkt(uint8_t *buf)
 
 	if (header->seq_num != r.cur_seq_no) {
 		/* Sequence number mismatch */
-		r.valid = 1;
 		parse_protobuf_req();
 		return;
 	}
@@ -363,7 +369,6 @@ void process_serial_rx_pkt(uint8_t *buf)
 
 	if (!(header->flags & MORE_FRAGMENT)) {
 		/* Received complete buffer */
-		r.valid = 1;
 		parse_protobuf_req();
 	}
 }
@@ -435,16 +440,12 @@ void recv_task(void* pvParameters)
 	}
 }
 
+/* Request is already in `data`, copied by parse_protobuf_req() */
 static ssize_t serial_read_data(uint8_t *data, ssize_t len)
 {
-	len = min(len, r.len);
-	if (r.valid) {
-		memcpy(data, r.data, len);
-		r.valid = 0;
-		r.len = 0;
-		r.cur_seq_no = 0;
-	} else {
+	if (!data) {
 		ESP_LOGI(TAG,"No data to be read, len %d", len);
+		return 0;
 	}
 	return len;
 }
@@ -679,7 +680,7 @@ void task_runtime_stats_task(void* pvParameters)
 void app_main()
 {
 	esp_err_t ret;
-	uint8_t capa = 0;
+	uint32_t capa = 0;
 	uint8_t prio_q_idx = 0;
 #ifdef CONFIG_BT_ENABLED
 	uint8_t mac[MAC_LEN] = {0};
@@ -28,6 +28,16 @@
 
 #endif
 
+/* Priority queues carrying checksum, announced to host in boot-up event */
+#if CONFIG_ESP_CHECKSUM_DATA_PATH
+#define CHECKSUM_PRIO_Q_MASK        ESP_CHECKSUM_ALL_PRIO_Q
+#else
+#define CHECKSUM_PRIO_Q_MASK        (ESP_PRIO_Q_BIT(PRIO_Q_SERIAL) | ESP_PRIO_Q_BIT(PRIO_Q_BT))
+#endif
+
+#define IS_CHECKSUM_ON_IF(if_type)  \
+	(CHECKSUM_PRIO_Q_MASK & ESP_PRIO_Q_BIT(esp_if_type_to_prio_q(if_type)))
+
 typedef enum {
 	LENGTH_1_BYTE  = 1,
 	LENGTH_2_BYTE  = 2,
@@ -92,6 +102,6 @@ typedef struct {
 
 interface_context_t * interface_insert_driver(int (*callback)(uint8_t val));
 int interface_remove_driver();
-void generate_startup_event(uint8_t cap);
+void generate_startup_event(uint32_t cap);
 int send_to_host_queue(interface_buffer_handle_t *buf_handle, uint8_t queue_type);
 #endif
@@ -74,6 +74,48 @@ static inline void sdio_buffer_tx_free(void *buf)
 	hosted_mempool_free(buf_mp_tx_g, buf);
 }
 
+#if CONFIG_ESP_SDIO_TX_QUEUE
+/* Buffers queued to host and not yet reclaimed. Startup event goes before
+ * data path is open, so only one task sends at a time */
+static uint32_t tx_queued;
+
+static void sdio_tx_reclaim(TickType_t wait)
+{
+	void *buf = NULL;
+
+	while (sdio_slave_send_get_finished(&buf, wait) == ESP_OK) {
+		sdio_buffer_tx_free(buf);
+		tx_queued--;
+		wait = 0;
+	}
+}
+#endif
+
+/* Send buffer from sdio_buffer_tx_alloc(), which is then owned by this call */
+static esp_err_t sdio_tx_send(uint8_t *sendbuf, uint32_t len)
+{
+	esp_err_t ret = ESP_OK;
+
+#if CONFIG_ESP_SDIO_TX_QUEUE
+	/* Block for host to read only once send queue is full */
+	sdio_tx_reclaim(tx_queued >= SDIO_SLAVE_QUEUE_SIZE ? portMAX_DELAY : 0);
+
+	/* Packets are back to back in stream, so next one has to start
+	 * 4 byte aligned. Buffer is zeroed, padding included */
+	ret = sdio_slave_send_queue(sendbuf, ESP_AGGR_ALIGN(len), sendbuf,
+			portMAX_DELAY);
+	if (ret == ESP_OK) {
+		tx_queued++;
+		return ESP_OK;
+	}
+#else
+	ret = sdio_slave_transmit(sendbuf, len);
+#endif
+
+	sdio_buffer_tx_free(sendbuf);
+	return ret;
+}
+
 interface_context_t *interface_insert_driver(int (*event_handler)(uint8_t val))
 {
 	ESP_LOGI(TAG, "Using SDIO interface");
@@ -104,7 +146,7 @@ IRAM_ATTR static void event_cb(uint8_t val)
 	}
 }
 
-void generate_startup_event(uint8_t cap)
+void generate_startup_event(uint32_t cap)
 {
 	struct esp_payload_header *header = NULL;
 	interface_buffer_handle_t buf_handle = {0};
@@ -148,6 +190,13 @@ void generate_startup_event(uint8_t cap)
 	*pos = LENGTH_1_BYTE;               pos++;len++;
 	*pos = cap;                         pos++;len++;
 
+#if CONFIG_ESP_SDIO_CHECKSUM
+	/* TLV - Priority queues carrying checksum */
+	*pos = ESP_PRIV_CHECKSUM_PRIO_Q;    pos++;len++;
+	*pos = LENGTH_1_BYTE;               pos++;len++;
+	*pos = CHECKSUM_PRIO_Q_MASK;        pos++;len++;
+#endif
+
 	*pos = ESP_PRIV_TEST_RAW_TP;        pos++;len++;
 	*pos = LENGTH_1_BYTE;               pos++;len++;
 	*pos = raw_tp_cap;                  pos++;len++;
@@ -166,19 +215,24 @@ void generate_startup_event(uint8_t cap)
 
 	ESP_LOG_BUFFER_HEXDUMP("sdio_tx", buf_handle.payload, buf_handle.payload_len, ESP_LOG_VERBOSE);
 
-	ret = sdio_slave_transmit(buf_handle.payload, buf_handle.payload_len);
+	ret = sdio_tx_send(buf_handle.payload, buf_handle.payload_len);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG , "sdio slave tx error, ret : 0x%x\r\n", ret);
-		sdio_buffer_tx_free(buf_handle.payload);
 		return;
 	}
-
-	sdio_buffer_tx_free(buf_handle.payload);
 }
 
 static void sdio_read_done(void *handle)
 {
 	sdio_slave_recv_load_buf((sdio_slave_buf_handle_t) handle);
+
+	/* Buffers written by host are only returned here, after they are
+	 * processed, so ESP cannot tell whether host has run out of them.
+	 * Host sets wait flag before it waits, notify only then */
+	if (sdio_slave_read_reg(ESP_TX_BUF_WAIT_SCRATCH_POS)) {
+		sdio_slave_write_reg(ESP_TX_BUF_WAIT_SCRATCH_POS, 0);
+		sdio_slave_send_host_int(ESP_TX_BUF_AVAILABLE);
+	}
 }
 
 static interface_handle_t * sdio_init(void)
@@ -304,19 +358,17 @@ static int32_t sdio_write(interface_handle_t *handle, interface_buffer_handle_t
 	memcpy(sendbuf + offset, buf_handle->payload, buf_handle->payload_len);
 
 #if CONFIG_ESP_SDIO_CHECKSUM
-	header->checksum = htole16(compute_checksum(sendbuf,
-				offset+buf_handle->payload_len));
+	if (IS_CHECKSUM_ON_IF(header->if_type))
+		header->checksum = htole16(compute_checksum(sendbuf,
+					offset+buf_handle->payload_len));
 #endif
 
-	ret = sdio_slave_transmit(sendbuf, total_len);
+	ret = sdio_tx_send(sendbuf, total_len);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG , "sdio slave transmit error, ret : 0x%x\r\n", ret);
-		sdio_buffer_tx_free(sendbuf);
 		return ESP_FAIL;
 	}
 
-	sdio_buffer_tx_free(sendbuf);
-
 	return buf_handle->payload_len;
 }
 
@@ -353,14 +405,16 @@ static int sdio_read(interface_handle_t *if_handle, interface_buffer_handle_t *b
 	len = le16toh(header->len) + le16toh(header->offset);
 
 #if CONFIG_ESP_SDIO_CHECKSUM
-	rx_checksum = le16toh(header->checksum);
-	header->checksum = 0;
+	if (IS_CHECKSUM_ON_IF(header->if_type)) {
+		rx_checksum = le16toh(header->checksum);
+		header->checksum = 0;
 
-	checksum = compute_checksum(buf_handle->payload, len);
+		checksum = compute_checksum(buf_handle->payload, len);
 
-	if (checksum != rx_checksum) {
-		sdio_read_done(buf_handle->sdio_buf_handle);
-		return ESP_FAIL;
+		if (checksum != rx_checksum) {
+			sdio_read_done(buf_handle->sdio_buf_handle);
+			return ESP_FAIL;
+		}
 	}
 #endif
 
@@ -384,6 +438,9 @@ static esp_err_t sdio_reset(interface_handle_t *handle)
 	if (ret != ESP_OK)
 		return ret;
 
+	/* With CONFIG_ESP_SDIO_TX_QUEUE, send buffers returned here are
+	 * reclaimed by sdio_tx_send() instead */
+#if !CONFIG_ESP_SDIO_TX_QUEUE
 	while (1) {
 		sdio_slave_buf_handle_t handle = NULL;
 
@@ -397,6 +454,7 @@ static esp_err_t sdio_reset(interface_handle_t *handle)
 			ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
 		}
 	}
+#endif
 
 	return ESP_OK;
 }
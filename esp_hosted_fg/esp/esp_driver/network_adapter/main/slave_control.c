@@ -14,13 +14,29 @@
 // limitations under the License.
 
 #include <string.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "esp_log.h"
 #include "esp_private/wifi.h"
 #include "slave_control.h"
 #include "esp_hosted_config.pb-c.h"
+#include "ctrl_msg_arena.h"
 #include "esp_ota_ops.h"
+#include "nvs.h"
+#if CONFIG_IDF_TARGET_ESP32
+#include "esp32/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32S2
+#include "esp32s2/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32S3
+#include "esp32s3/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32C2
+#include "esp32c2/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32C3
+#include "esp32c3/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32C6
+#include "esp32c6/rom/miniz.h"
+#endif
 
 #define MAC_STR_LEN                 17
 #define MAC2STR(a)                  (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
@@ -51,6 +67,16 @@
 #define OTA_SLEEP_TIME_MS           (40)
 #endif
 
+/* Resumable OTA. Offset written is saved to NVS every interval, aligned
+ * to flash sector, as resumed OTA erases partition from there on */
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 4, 0)
+#define OTA_RESUME_SUPPORTED        1
+#endif
+#define OTA_CKPT_NVS_NAMESPACE      "hosted_ota"
+#define OTA_CKPT_NVS_KEY            "ckpt"
+#define OTA_CKPT_INTERVAL           (64*1024)
+#define OTA_CKPT_ALIGN              (4096)
+
 #define MIN_HEARTBEAT_INTERVAL      (10)
 #define MAX_HEARTBEAT_INTERVAL      (60*60)
 
@@ -62,6 +88,31 @@
             }                       \
         }
 
+/* Request is unpacked and big responses are built in arena,
+ * enough for OTA write chunk or scan list of about 30 APs */
+#ifndef CTRL_MSG_ARENA_SIZE
+#define CTRL_MSG_ARENA_SIZE         (6 * 1024)
+#endif
+
+#define arena_mem_free(x)           \
+        {                           \
+            ctrl_msg_arena_free(&ctrl_msg_arena, x); \
+            x = NULL;               \
+        }
+
+/* Streaming scan sends at most these many APs per channel */
+#ifndef SCAN_STREAM_MAX_AP_PER_CHNL
+#define SCAN_STREAM_MAX_AP_PER_CHNL 16
+#endif
+
+/* Event data passed from scan done handler to ctrl_ntfy_APScanResult() */
+typedef struct {
+	uint8_t chnl;
+	uint8_t scan_done;
+	uint16_t count;
+	wifi_ap_record_t ap_info[SCAN_STREAM_MAX_AP_PER_CHNL];
+} scan_stream_evt_t;
+
 typedef struct esp_ctrl_msg_cmd {
 	int req_num;
 	esp_err_t (*command_handler)(CtrlMsg *req,
@@ -78,9 +129,56 @@ static bool event_registered = false;
 static EventGroupHandle_t wifi_event_group;
 
 static bool scan_done = false;
+
+/* Streaming scan state, channels are scanned one by one */
+static volatile bool scan_streaming = false;
+static bool scan_stream_event_registered = false;
+static uint8_t scan_stream_chnl;
+static uint8_t scan_stream_last_chnl;
+static scan_stream_evt_t scan_stream_evt;
 static esp_ota_handle_t handle;
 const esp_partition_t* update_partition = NULL;
 static int ota_msg = 0;
+/* Host may have more OTA writes in flight. Once one fails, rest must
+ * not be written at wrong offset, so are failed till next OTA begin */
+static int ota_write_failed = 0;
+
+/* Compressed OTA, image arrives as zlib stream and is inflated with ROM
+ * tinfl. Output is written to flash straight from dictionary window */
+typedef struct {
+	tinfl_decompressor inflator;
+	size_t dict_ofs;
+	bool done;
+	uint8_t dict[TINFL_LZ_DICT_SIZE];
+} ota_inflate_t;
+
+static ota_inflate_t *ota_inflate = NULL;
+
+/* Checkpoint of resumable OTA, kept in NVS across ESP reset */
+typedef struct {
+	uint32_t image_id;
+	uint32_t image_size;
+	uint32_t part_addr;
+	uint32_t offset;
+} ota_ckpt_t;
+
+/* Of ongoing OTA. OTA is checkpointed if image_id is set */
+static ota_ckpt_t ota_ckpt;
+/* Offsets of OTA writes are checked if host gave image_id */
+static uint32_t ota_image_id = 0;
+static uint32_t ota_offset = 0;
+static bool ota_handle_valid = false;
+
+/* Used only while handling one request in data_transfer_handler() or one
+ * notification in ctrl_notify_handler(), both called from pserial task.
+ * Reset once response or notification is packed */
+static uint64_t ctrl_msg_arena_buf[CTRL_MSG_ARENA_SIZE / sizeof(uint64_t)];
+static ctrl_msg_arena_t ctrl_msg_arena = {
+	.buf = (uint8_t *)ctrl_msg_arena_buf,
+	.size = sizeof(ctrl_msg_arena_buf),
+};
+static ProtobufCAllocator ctrl_msg_allocator =
+	CTRL_MSG_ARENA_ALLOCATOR(&ctrl_msg_arena);
 
 static void station_event_handler(void* arg, esp_event_base_t event_base,
 		int32_t event_id, void* event_data);
@@ -88,6 +186,8 @@ static void softap_event_handler(void* arg, esp_event_base_t event_base,
 		int32_t event_id, void* event_data);
 static void ap_scan_list_event_handler(void* arg, esp_event_base_t event_base,
 		int32_t event_id, void* event_data);
+static void ap_scan_stream_event_handler(void* arg, esp_event_base_t event_base,
+		int32_t event_id, void* event_data);
 static void station_event_register(void);
 static void softap_event_register(void);
 static void softap_event_unregister(void);
@@ -185,6 +285,86 @@ static void ap_scan_list_event_handler(void *arg, esp_event_base_t event_base,
 	}
 }
 
+static esp_err_t ap_scan_stream_chnl_start(void)
+{
+	wifi_scan_config_t scanConf = {
+		.channel = scan_stream_chnl,
+		.show_hidden = true
+	};
+
+	return esp_wifi_scan_start(&scanConf, false);
+}
+
+/* event handler for streaming scan
+ * sends APs found on channel just scanned and moves on to next channel */
+static void ap_scan_stream_event_handler(void *arg, esp_event_base_t event_base,
+		int32_t event_id, void *event_data)
+{
+	scan_stream_evt_t *evt = &scan_stream_evt;
+	uint16_t count = SCAN_STREAM_MAX_AP_PER_CHNL;
+
+	if (!scan_streaming)
+		return;
+
+	evt->chnl = scan_stream_chnl;
+	if (esp_wifi_scan_get_ap_records(&count, evt->ap_info))
+		count = 0;
+	evt->count = count;
+
+	/* Next channel is started before sending this one,
+	 * so radio keeps scanning while APs go to host */
+	evt->scan_done = 1;
+	if (scan_stream_chnl < scan_stream_last_chnl) {
+		scan_stream_chnl++;
+		if (ap_scan_stream_chnl_start() == ESP_OK)
+			evt->scan_done = 0;
+		else
+			ESP_LOGE(TAG, "Failed to start scan on channel %u", scan_stream_chnl);
+	}
+	if (evt->scan_done)
+		scan_streaming = false;
+
+	/* evt is copied, so can be reused for next channel */
+	send_event_data_to_host(CTRL_MSG_ID__Event_APScanResult, (uint8_t *)evt,
+			offsetof(scan_stream_evt_t, ap_info) +
+			count * sizeof(wifi_ap_record_t));
+}
+
+/* Start scanning first channel of current country,
+ * rest is driven by ap_scan_stream_event_handler() */
+static esp_err_t ap_scan_stream_start(void)
+{
+	wifi_country_t country = {0};
+	esp_err_t ret = ESP_OK;
+
+	ret = esp_wifi_get_country(&country);
+	if (ret || !country.nchan) {
+		ESP_LOGE(TAG, "Failed to get country channels");
+		return ESP_FAIL;
+	}
+
+	if (!scan_stream_event_registered) {
+		ret = esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE,
+				&ap_scan_stream_event_handler, NULL);
+		if (ret) {
+			ESP_LOGE(TAG, "Failed to register scan done event");
+			return ret;
+		}
+		scan_stream_event_registered = true;
+	}
+
+	scan_stream_chnl = country.schan;
+	scan_stream_last_chnl = country.schan + country.nchan - 1;
+	scan_streaming = true;
+
+	ret = ap_scan_stream_chnl_start();
+	if (ret) {
+		ESP_LOGE(TAG, "Failed to start scan on channel %u", scan_stream_chnl);
+		scan_streaming = false;
+	}
+	return ret;
+}
+
 /* register station connect/disconnect events */
 static void station_event_register(void)
 {
@@ -992,12 +1172,57 @@ err:
 	return ESP_OK;
 }
 
-/* Function sends scanned list of available APs */
+static void *arena_calloc(size_t size)
+{
+	void *ptr = ctrl_msg_arena_alloc(&ctrl_msg_arena, size);
+
+	if (ptr)
+		memset(ptr, 0, size);
+	return ptr;
+}
+
+static uint8_t *arena_strndup(const char *str, size_t max_len)
+{
+	size_t len = strnlen(str, max_len);
+	uint8_t *ptr = (uint8_t *)ctrl_msg_arena_alloc(&ctrl_msg_arena, len + 1);
+
+	if (ptr) {
+		memcpy(ptr, str, len);
+		ptr[len] = '\0';
+	}
+	return ptr;
+}
+
+/* Station mode is needed for scan, softap is kept running if started */
+static esp_err_t set_wifi_mode_for_scan(void)
+{
+	esp_err_t ret = ESP_OK;
+	wifi_mode_t mode = 0;
+
+	ret = esp_wifi_get_mode(&mode);
+	if (ret) {
+		ESP_LOGE(TAG,"Failed to get wifi mode");
+		return ret;
+	}
+
+	if ((softap_started) &&
+	    ((mode != WIFI_MODE_STA) && (mode != WIFI_MODE_NULL))) {
+		ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
+		ESP_LOGI(TAG,"softap+station mode set in scan handler");
+	} else {
+		ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+		ESP_LOGI(TAG,"Station mode set in scan handler");
+	}
+	return ESP_OK;
+}
+
+/* Function sends scanned list of available APs
+ * In streaming mode, responds once scan is started and
+ * APs are sent as Event_APScanResult, channel by channel */
 static esp_err_t req_get_ap_scan_list_handler (CtrlMsg *req,
 		CtrlMsg *resp, void *priv_data)
 {
 	esp_err_t ret = ESP_OK;
-	wifi_mode_t mode = 0;
 	uint16_t ap_count = 0;
 	credentials_t credentials = {0};
 	wifi_ap_record_t *ap_info = NULL;
@@ -1013,7 +1238,7 @@ static esp_err_t req_get_ap_scan_list_handler (CtrlMsg *req,
 	}
 
 	resp_payload = (CtrlMsgRespScanResult *)
-		calloc(1,sizeof(CtrlMsgRespScanResult));
+		arena_calloc(sizeof(CtrlMsgRespScanResult));
 	if (!resp_payload) {
 		ESP_LOGE(TAG,"Failed To allocate memory");
 		return ESP_ERR_NO_MEM;
@@ -1023,22 +1248,25 @@ static esp_err_t req_get_ap_scan_list_handler (CtrlMsg *req,
 	resp->payload_case = CTRL_MSG__PAYLOAD_RESP_SCAN_AP_LIST;
 	resp->resp_scan_ap_list = resp_payload;
 
-	ap_scan_list_event_register();
-	ret = esp_wifi_get_mode(&mode);
-	if (ret) {
-		ESP_LOGE(TAG,"Failed to get wifi mode");
-		goto err;
+	if (scan_streaming) {
+		ESP_LOGE(TAG,"Streaming scan in progress");
+		resp_payload->resp = FAILURE;
+		return ESP_OK;
 	}
 
-	if ((softap_started) &&
-	    ((mode != WIFI_MODE_STA) && (mode != WIFI_MODE_NULL))) {
-		ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
-		ESP_LOGI(TAG,"softap+station mode set in scan handler");
-	} else {
-		ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-		ESP_LOGI(TAG,"Station mode set in scan handler");
+	if (req->req_scan_ap_list && req->req_scan_ap_list->stream) {
+		if (set_wifi_mode_for_scan() || ap_scan_stream_start())
+			resp_payload->resp = FAILURE;
+		else
+			resp_payload->resp = SUCCESS;
+		return ESP_OK;
 	}
 
+	ap_scan_list_event_register();
+	ret = set_wifi_mode_for_scan();
+	if (ret)
+		goto err;
+
 	ret = esp_wifi_scan_start(&scanConf, true);
 	if (ret) {
 		ESP_LOGE(TAG,"Failed to start scan start command");
@@ -1074,7 +1302,7 @@ static esp_err_t req_get_ap_scan_list_handler (CtrlMsg *req,
 	credentials.count = ap_count;
 
 	results = (ScanResult **)
-		calloc(credentials.count, sizeof(ScanResult));
+		arena_calloc(credentials.count * sizeof(ScanResult *));
 	if (!results) {
 		ESP_LOGE(TAG,"Failed To allocate memory");
 		goto err;
@@ -1083,7 +1311,7 @@ static esp_err_t req_get_ap_scan_list_handler (CtrlMsg *req,
 	resp_payload->entries = results;
 	ESP_LOGI(TAG,"Total APs scanned = %u",ap_count);
 	for (int i = 0; i < credentials.count; i++ ) {
-		results[i] = (ScanResult *)calloc(1,sizeof(ScanResult));
+		results[i] = (ScanResult *)arena_calloc(sizeof(ScanResult));
 		if (!results[i]) {
 			ESP_LOGE(TAG,"Failed to allocate memory");
 			goto err;
@@ -1095,11 +1323,11 @@ static esp_err_t req_get_ap_scan_list_handler (CtrlMsg *req,
 		results[i]->ssid.len = strnlen((char *)ap_info[i].ssid, SSID_LENGTH);
 
 
-		results[i]->ssid.data = (uint8_t *)strndup((char *)ap_info[i].ssid,
+		results[i]->ssid.data = arena_strndup((char *)ap_info[i].ssid,
 				SSID_LENGTH);
 		if (!results[i]->ssid.data) {
 			ESP_LOGE(TAG,"Failed to allocate memory for scan result entry SSID");
-			mem_free(results[i]);
+			arena_mem_free(results[i]);
 			goto err;
 		}
 
@@ -1113,14 +1341,16 @@ static esp_err_t req_get_ap_scan_list_handler (CtrlMsg *req,
 		results[i]->bssid.len = strnlen((char *)credentials.bssid, BSSID_LENGTH);
 		if (!results[i]->bssid.len) {
 			ESP_LOGE(TAG, "Invalid BSSID length");
-			mem_free(results[i]);
+			arena_mem_free(results[i]->ssid.data);
+			arena_mem_free(results[i]);
 			goto err;
 		}
-		results[i]->bssid.data = (uint8_t *)strndup((char *)credentials.bssid,
+		results[i]->bssid.data = arena_strndup((char *)credentials.bssid,
 				BSSID_LENGTH);
 		if (!results[i]->bssid.data) {
 			ESP_LOGE(TAG, "Failed to allocate memory for scan result entry BSSID");
-			mem_free(results[i]);
+			arena_mem_free(results[i]->ssid.data);
+			arena_mem_free(results[i]);
 			goto err;
 		}
 
@@ -1229,7 +1459,7 @@ static esp_err_t get_connected_sta_list_handler (CtrlMsg *req,
 	}
 
 	resp_payload = (CtrlMsgRespSoftAPConnectedSTA *)
-		calloc(1,sizeof(CtrlMsgRespSoftAPConnectedSTA));
+		arena_calloc(sizeof(CtrlMsgRespSoftAPConnectedSTA));
 	if (!resp_payload) {
 		ESP_LOGE(TAG,"failed to allocate memory resp payload");
 		mem_free(stas_info);
@@ -1267,8 +1497,8 @@ static esp_err_t get_connected_sta_list_handler (CtrlMsg *req,
 	resp_payload->num = stas_info->num;
 	if (stas_info->num) {
 		resp_payload->n_stations = stas_info->num;
-		results = (ConnectedSTAList **)calloc(stas_info->num,
-				sizeof(ConnectedSTAList));
+		results = (ConnectedSTAList **)arena_calloc(stas_info->num *
+				sizeof(ConnectedSTAList *));
 		if (!results) {
 			ESP_LOGE(TAG,"Failed to allocate memory for connected stations");
 			goto err;
@@ -1277,7 +1507,7 @@ static esp_err_t get_connected_sta_list_handler (CtrlMsg *req,
 		for (int i = 0; i < stas_info->num ; i++) {
 			snprintf((char *)credentials.bssid,BSSID_LENGTH,
 					MACSTR,MAC2STR(stas_info->sta[i].mac));
-			results[i] = (ConnectedSTAList *)calloc(1,
+			results[i] = (ConnectedSTAList *)arena_calloc(
 					sizeof(ConnectedSTAList));
 			if (!results[i]) {
 				ESP_LOGE(TAG,"Failed to allocated memory");
@@ -1291,7 +1521,7 @@ static esp_err_t get_connected_sta_list_handler (CtrlMsg *req,
 				goto err;
 			}
 			results[i]->mac.data =
-				(uint8_t *)strndup((char *)credentials.bssid, BSSID_LENGTH);
+				arena_strndup((char *)credentials.bssid, BSSID_LENGTH);
 			if (!results[i]->mac.data) {
 				ESP_LOGE(TAG,"Failed to allocate memory mac address");
 				goto err;
@@ -1459,19 +1689,79 @@ static esp_err_t req_get_power_save_mode_handler (CtrlMsg *req,
 	return ESP_OK;
 }
 
+/* Save checkpoint to NVS, or erase it if NULL */
+static void ota_ckpt_save(const ota_ckpt_t *ckpt)
+{
+	nvs_handle_t nvs;
+	esp_err_t ret = ESP_OK;
+
+	ret = nvs_open(OTA_CKPT_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+	if (ret != ESP_OK) {
+		ESP_LOGW(TAG, "Failed to open NVS for OTA checkpoint (0x%x)", ret);
+		return;
+	}
+
+	if (ckpt)
+		ret = nvs_set_blob(nvs, OTA_CKPT_NVS_KEY, ckpt, sizeof(*ckpt));
+	else
+		ret = nvs_erase_key(nvs, OTA_CKPT_NVS_KEY);
+	if (ret == ESP_OK)
+		ret = nvs_commit(nvs);
+	if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND)
+		ESP_LOGW(TAG, "Failed to save OTA checkpoint (0x%x)", ret);
+
+	nvs_close(nvs);
+}
+
+/* Offset interrupted OTA of same image is to resume from, 0 if none */
+static uint32_t ota_ckpt_resume_offset(uint32_t image_id, uint32_t image_size,
+		const esp_partition_t *partition)
+{
+#if OTA_RESUME_SUPPORTED
+	ota_ckpt_t ckpt = {0};
+	size_t len = sizeof(ckpt);
+	nvs_handle_t nvs;
+	esp_err_t ret = ESP_OK;
+
+	if (nvs_open(OTA_CKPT_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+		return 0;
+	ret = nvs_get_blob(nvs, OTA_CKPT_NVS_KEY, &ckpt, &len);
+	nvs_close(nvs);
+
+	if ((ret != ESP_OK) || (len != sizeof(ckpt)) ||
+	    (ckpt.image_id != image_id) || (ckpt.image_size != image_size) ||
+	    (ckpt.part_addr != partition->address) ||
+	    (ckpt.offset >= image_size))
+		return 0;
+
+	return ckpt.offset;
+#else
+	return 0;
+#endif
+}
+
 /* Function OTA begin */
 static esp_err_t req_ota_begin_handler (CtrlMsg *req,
 		CtrlMsg *resp, void *priv_data)
 {
 	esp_err_t ret = ESP_OK;
 	CtrlMsgRespOTABegin *resp_payload = NULL;
+	uint32_t image_id = 0, image_size = 0, resume_offset = 0;
+	bool compressed = false;
 
 	if (!req || !resp) {
 		ESP_LOGE(TAG, "Invalid parameters");
 		return ESP_FAIL;
 	}
 
-	ESP_LOGI(TAG, "OTA update started");
+	if (req->req_ota_begin) {
+		compressed = req->req_ota_begin->compressed;
+		image_id = req->req_ota_begin->image_id;
+		image_size = req->req_ota_begin->image_size;
+	}
+
+	ESP_LOGI(TAG, "OTA update started%s",
+			compressed ? ", image compressed" : "");
 
 	resp_payload = (CtrlMsgRespOTABegin *)
 		calloc(1,sizeof(CtrlMsgRespOTABegin));
@@ -1483,6 +1773,33 @@ static esp_err_t req_ota_begin_handler (CtrlMsg *req,
 	resp->payload_case = CTRL_MSG__PAYLOAD_RESP_OTA_BEGIN;
 	resp->resp_ota_begin = resp_payload;
 
+	/* Drop state of earlier OTA, which was never ended, as host is to
+	 * resume it. Data written since last checkpoint is in flash already */
+	free(ota_inflate);
+	ota_inflate = NULL;
+	if (ota_handle_valid) {
+		if (ota_ckpt.image_id &&
+		    ((ota_offset & ~(OTA_CKPT_ALIGN - 1)) > ota_ckpt.offset)) {
+			ota_ckpt.offset = ota_offset & ~(OTA_CKPT_ALIGN - 1);
+			ota_ckpt_save(&ota_ckpt);
+		}
+		esp_ota_abort(handle);
+		ota_handle_valid = false;
+	}
+	ota_image_id = 0;
+	ota_ckpt.image_id = 0;
+
+	if (compressed) {
+		ota_inflate = (ota_inflate_t *)malloc(sizeof(ota_inflate_t));
+		if (!ota_inflate) {
+			ESP_LOGE(TAG, "Failed to allocate memory for inflate");
+			goto err;
+		}
+		tinfl_init(&ota_inflate->inflator);
+		ota_inflate->dict_ofs = 0;
+		ota_inflate->done = false;
+	}
+
 	/* Identify next OTA partition */
 	update_partition = esp_ota_get_next_update_partition(NULL);
 	if (update_partition == NULL) {
@@ -1490,28 +1807,106 @@ static esp_err_t req_ota_begin_handler (CtrlMsg *req,
 		goto err;
 	}
 
-	ESP_LOGI(TAG, "Prepare partition for OTA\n");
+	/* Inflate state is not kept, so compressed OTA is never resumed */
+	if (image_id && !compressed)
+		resume_offset = ota_ckpt_resume_offset(image_id, image_size,
+				update_partition);
+
 	ota_ongoing=1;
 #if CONFIG_ESP_OTA_WORKAROUND
 	vTaskDelay(OTA_SLEEP_TIME_MS/portTICK_PERIOD_MS);
 #endif
-	ret = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &handle);
+#if OTA_RESUME_SUPPORTED
+	if (resume_offset) {
+		ESP_LOGI(TAG, "Resume OTA from offset %" PRIu32 "\n", resume_offset);
+		ret = esp_ota_resume(update_partition, OTA_SIZE_UNKNOWN,
+				resume_offset, &handle);
+	} else
+#endif
+	{
+		ESP_LOGI(TAG, "Prepare partition for OTA\n");
+		/* Checkpoint is no longer valid, once partition is erased */
+		if (image_id)
+			ota_ckpt_save(NULL);
+		ret = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &handle);
+	}
 	ota_ongoing=0;
 	if (ret) {
 		ESP_LOGE(TAG, "OTA update failed in OTA begin");
 		goto err;
 	}
 
+	ota_handle_valid = true;
+	ota_image_id = image_id;
+	ota_offset = resume_offset;
+#if OTA_RESUME_SUPPORTED
+	if (image_id && !compressed) {
+		ota_ckpt.image_id = image_id;
+		ota_ckpt.image_size = image_size;
+		ota_ckpt.part_addr = update_partition->address;
+		ota_ckpt.offset = resume_offset;
+	}
+#endif
+
 	ota_msg = 1;
+	ota_write_failed = 0;
 
+	resp_payload->resume_offset = resume_offset;
 	resp_payload->resp = SUCCESS;
 	return ESP_OK;
 err:
+	free(ota_inflate);
+	ota_inflate = NULL;
 	resp_payload->resp = FAILURE;
 	return ESP_OK;
 
 }
 
+/* Inflate next piece of zlib stream and write output to OTA partition.
+ * Stream may be split anywhere across OTA writes */
+static esp_err_t ota_inflate_write(const uint8_t *in, size_t in_len)
+{
+	tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+	size_t in_bytes = 0, out_bytes = 0;
+	esp_err_t ret = ESP_OK;
+
+	/* Output may still be pending once all input is consumed */
+	while (in_len || (status == TINFL_STATUS_HAS_MORE_OUTPUT)) {
+		if (ota_inflate->done) {
+			ESP_LOGE(TAG, "OTA data past end of compressed image");
+			return ESP_FAIL;
+		}
+
+		in_bytes = in_len;
+		out_bytes = TINFL_LZ_DICT_SIZE - ota_inflate->dict_ofs;
+		status = tinfl_decompress(&ota_inflate->inflator, in, &in_bytes,
+				ota_inflate->dict, ota_inflate->dict + ota_inflate->dict_ofs,
+				&out_bytes, TINFL_FLAG_PARSE_ZLIB_HEADER |
+				TINFL_FLAG_HAS_MORE_INPUT);
+		in += in_bytes;
+		in_len -= in_bytes;
+
+		if (out_bytes) {
+			ret = esp_ota_write(handle,
+					ota_inflate->dict + ota_inflate->dict_ofs, out_bytes);
+			if (ret != ESP_OK)
+				return ret;
+			ota_inflate->dict_ofs = (ota_inflate->dict_ofs + out_bytes) &
+				(TINFL_LZ_DICT_SIZE - 1);
+		}
+
+		if (status < TINFL_STATUS_DONE) {
+			ESP_LOGE(TAG, "Compressed image is corrupted (%d)", status);
+			return ESP_FAIL;
+		}
+		if (status == TINFL_STATUS_DONE)
+			ota_inflate->done = true;
+		/* TINFL_STATUS_HAS_MORE_OUTPUT: dictionary wrapped, go on */
+	}
+
+	return ESP_OK;
+}
+
 /* Function OTA write */
 static esp_err_t req_ota_write_handler (CtrlMsg *req,
 		CtrlMsg *resp, void *priv_data)
@@ -1538,6 +1933,22 @@ static esp_err_t req_ota_write_handler (CtrlMsg *req,
 	resp->payload_case = CTRL_MSG__PAYLOAD_RESP_OTA_WRITE;
 	resp->resp_ota_write = resp_payload;
 
+	resp_payload->checkpoint = ota_ckpt.offset;
+
+	if (ota_write_failed) {
+		resp_payload->resp = FAILURE;
+		return ESP_OK;
+	}
+
+	/* Host resuming from other offset would corrupt image */
+	if (ota_image_id && (req->req_ota_write->offset != ota_offset)) {
+		ESP_LOGE(TAG, "OTA write at offset %" PRIu32 ", expected %" PRIu32,
+				req->req_ota_write->offset, ota_offset);
+		ota_write_failed = 1;
+		resp_payload->resp = FAILURE;
+		return ESP_OK;
+	}
+
 	ota_ongoing=1;
 #if CONFIG_ESP_OTA_WORKAROUND
 	/* Delay added is to give chance to transfer pending data at transport
@@ -1548,14 +1959,28 @@ static esp_err_t req_ota_write_handler (CtrlMsg *req,
 #endif
 	printf(".");
 	fflush(stdout);
-	ret = esp_ota_write( handle, (const void *)req->req_ota_write->ota_data.data,
-			req->req_ota_write->ota_data.len);
+	if (ota_inflate)
+		ret = ota_inflate_write(req->req_ota_write->ota_data.data,
+				req->req_ota_write->ota_data.len);
+	else
+		ret = esp_ota_write( handle, (const void *)req->req_ota_write->ota_data.data,
+				req->req_ota_write->ota_data.len);
 	ota_ongoing=0;
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "OTA write failed with return code 0x%x",ret);
+		ota_write_failed = 1;
 		resp_payload->resp = FAILURE;
 		return ESP_OK;
 	}
+
+	ota_offset += req->req_ota_write->ota_data.len;
+	if (ota_ckpt.image_id &&
+	    (ota_offset - ota_ckpt.offset >= OTA_CKPT_INTERVAL)) {
+		ota_ckpt.offset = ota_offset & ~(OTA_CKPT_ALIGN - 1);
+		ota_ckpt_save(&ota_ckpt);
+		resp_payload->checkpoint = ota_ckpt.offset;
+	}
+
 	resp_payload->resp = SUCCESS;
 	return ESP_OK;
 }
@@ -1582,6 +2007,32 @@ static esp_err_t req_ota_end_handler (CtrlMsg *req,
 	resp->payload_case = CTRL_MSG__PAYLOAD_RESP_OTA_END;
 	resp->resp_ota_end = resp_payload;
 
+	if (!ota_handle_valid) {
+		ESP_LOGE(TAG, "OTA end without OTA begin");
+		goto err;
+	}
+	/* OTA is over either way, image is complete or found bad */
+	ota_handle_valid = false;
+	ota_image_id = 0;
+	if (ota_ckpt.image_id) {
+		ota_ckpt.image_id = 0;
+		ota_ckpt.offset = 0;
+		ota_ckpt_save(NULL);
+	}
+
+	if (ota_inflate) {
+		bool done = ota_inflate->done;
+
+		free(ota_inflate);
+		ota_inflate = NULL;
+		/* Truncated stream may still be a valid looking image */
+		if (!done) {
+			ESP_LOGE(TAG, "Compressed image is incomplete");
+			esp_ota_abort(handle);
+			goto err;
+		}
+	}
+
 	ota_ongoing=1;
 #if CONFIG_ESP_OTA_WORKAROUND
 	vTaskDelay(OTA_SLEEP_TIME_MS/portTICK_PERIOD_MS);
@@ -2065,17 +2516,17 @@ static void esp_ctrl_msg_cleanup(CtrlMsg *resp)
 					for (int i=0 ; i<resp->resp_scan_ap_list->n_entries; i++) {
 						if (resp->resp_scan_ap_list->entries[i]) {
 							if (resp->resp_scan_ap_list->entries[i]->ssid.data) {
-								mem_free(resp->resp_scan_ap_list->entries[i]->ssid.data);
+								arena_mem_free(resp->resp_scan_ap_list->entries[i]->ssid.data);
 							}
 							if (resp->resp_scan_ap_list->entries[i]->bssid.data) {
-								mem_free(resp->resp_scan_ap_list->entries[i]->bssid.data);
+								arena_mem_free(resp->resp_scan_ap_list->entries[i]->bssid.data);
 							}
-							mem_free(resp->resp_scan_ap_list->entries[i]);
+							arena_mem_free(resp->resp_scan_ap_list->entries[i]);
 						}
 				   }
-					mem_free(resp->resp_scan_ap_list->entries);
+					arena_mem_free(resp->resp_scan_ap_list->entries);
 				}
-				mem_free(resp->resp_scan_ap_list);
+				arena_mem_free(resp->resp_scan_ap_list);
 			}
 			break;
 		} case (CTRL_MSG_ID__Resp_GetSoftAPConnectedSTAList ) : {
@@ -2084,14 +2535,14 @@ static void esp_ctrl_msg_cleanup(CtrlMsg *resp)
 					for (int i=0 ; i < resp->resp_softap_connected_stas_list->num; i++) {
 						if (resp->resp_softap_connected_stas_list->stations[i]) {
 							if (resp->resp_softap_connected_stas_list->stations[i]->mac.data) {
-								mem_free(resp->resp_softap_connected_stas_list->stations[i]->mac.data);
+								arena_mem_free(resp->resp_softap_connected_stas_list->stations[i]->mac.data);
 							}
-							mem_free(resp->resp_softap_connected_stas_list->stations[i]);
+							arena_mem_free(resp->resp_softap_connected_stas_list->stations[i]);
 						}
 					}
-					mem_free(resp->resp_softap_connected_stas_list->stations);
+					arena_mem_free(resp->resp_softap_connected_stas_list->stations);
 				}
-				mem_free(resp->resp_softap_connected_stas_list);
+				arena_mem_free(resp->resp_softap_connected_stas_list);
 			}
 			break;
 		} case (CTRL_MSG_ID__Resp_SetMacAddress) : {
@@ -2136,6 +2587,19 @@ static void esp_ctrl_msg_cleanup(CtrlMsg *resp)
 		} case (CTRL_MSG_ID__Event_StationDisconnectFromESPSoftAP) : {
 			mem_free(resp->event_station_disconnect_from_esp_softap);
 			break;
+		} case (CTRL_MSG_ID__Event_APScanResult) : {
+			if (resp->event_ap_scan_result) {
+				for (int i=0 ; i<resp->event_ap_scan_result->n_entries; i++) {
+					ScanResult *entry = resp->event_ap_scan_result->entries[i];
+
+					arena_mem_free(entry->ssid.data);
+					arena_mem_free(entry->bssid.data);
+					arena_mem_free(entry);
+				}
+				arena_mem_free(resp->event_ap_scan_result->entries);
+				arena_mem_free(resp->event_ap_scan_result);
+			}
+			break;
 		} default: {
 			ESP_LOGE(TAG, "Unsupported CtrlMsg type[%u]",resp->msg_id);
 			break;
@@ -2154,23 +2618,26 @@ esp_err_t data_transfer_handler(uint32_t session_id,const uint8_t *inbuf,
 		return ESP_FAIL;
 	}
 
-	req = ctrl_msg__unpack(NULL, inlen, inbuf);
+	/* Request and big response are both carved from arena,
+	 * which is reset only after response is packed */
+	req = ctrl_msg__unpack(&ctrl_msg_allocator, inlen, inbuf);
 	if (!req) {
 		ESP_LOGE(TAG, "Unable to unpack config data");
+		ctrl_msg_arena_reset(&ctrl_msg_arena);
 		return ESP_FAIL;
 	}
 
 	ctrl_msg__init (&resp);
 	resp.msg_type = CTRL_MSG_TYPE__Resp;
 	resp.msg_id = req->msg_id - CTRL_MSG_ID__Req_Base + CTRL_MSG_ID__Resp_Base;
+	/* Host matches response to its request using uid */
+	resp.uid = req->uid;
 	ret = esp_ctrl_msg_command_dispatcher(req,&resp,NULL);
 	if (ret) {
 		ESP_LOGE(TAG, "Command dispatching not happening");
 		goto err;
 	}
 
-	ctrl_msg__free_unpacked(req, NULL);
-
 	*outlen = ctrl_msg__get_packed_size (&resp);
 	if (*outlen <= 0) {
 		ESP_LOGE(TAG, "Invalid encoding for response");
@@ -2181,15 +2648,21 @@ esp_err_t data_transfer_handler(uint32_t session_id,const uint8_t *inbuf,
 	if (!*outbuf) {
 		ESP_LOGE(TAG, "No memory allocated for outbuf");
 		esp_ctrl_msg_cleanup(&resp);
+		ctrl_msg_arena_free_unpacked(&ctrl_msg_arena, &ctrl_msg_allocator,
+				(ProtobufCMessage *)req);
 		return ESP_ERR_NO_MEM;
 	}
 
 	ctrl_msg__pack (&resp, *outbuf);
 	esp_ctrl_msg_cleanup(&resp);
+	ctrl_msg_arena_free_unpacked(&ctrl_msg_arena, &ctrl_msg_allocator,
+			(ProtobufCMessage *)req);
 	return ESP_OK;
 
 err:
 	esp_ctrl_msg_cleanup(&resp);
+	ctrl_msg_arena_free_unpacked(&ctrl_msg_arena, &ctrl_msg_allocator,
+			(ProtobufCMessage *)req);
 	return ESP_FAIL;
 }
 
@@ -2290,6 +2763,76 @@ err:
 	return ESP_OK;
 }
 
+static esp_err_t ctrl_ntfy_APScanResult(CtrlMsg *ntfy,
+		const uint8_t *data, ssize_t len)
+{
+	const scan_stream_evt_t *evt = (const scan_stream_evt_t *)data;
+	size_t hdr_len = offsetof(scan_stream_evt_t, ap_info);
+	CtrlMsgEventAPScanResult *ntfy_payload = NULL;
+	char bssid[BSSID_LENGTH] = "";
+	ScanResult *entry = NULL;
+
+	if (!data || (len < hdr_len) ||
+	    (len < hdr_len + evt->count * sizeof(wifi_ap_record_t))) {
+		ESP_LOGE(TAG, "Invalid scan result event data");
+		return ESP_FAIL;
+	}
+
+	ntfy_payload = (CtrlMsgEventAPScanResult *)
+		arena_calloc(sizeof(CtrlMsgEventAPScanResult));
+	if (!ntfy_payload) {
+		ESP_LOGE(TAG,"Failed to allocate memory");
+		return ESP_ERR_NO_MEM;
+	}
+	ctrl_msg__event__apscan_result__init(ntfy_payload);
+
+	ntfy->payload_case = CTRL_MSG__PAYLOAD_EVENT_AP_SCAN_RESULT;
+	ntfy->event_ap_scan_result = ntfy_payload;
+
+	ntfy_payload->chnl = evt->chnl;
+	ntfy_payload->scan_done = evt->scan_done;
+
+	if (evt->count) {
+		ntfy_payload->entries = (ScanResult **)
+			arena_calloc(evt->count * sizeof(ScanResult *));
+		if (!ntfy_payload->entries)
+			goto err;
+	}
+
+	for (int i = 0; i < evt->count; i++) {
+		entry = (ScanResult *)arena_calloc(sizeof(ScanResult));
+		if (!entry)
+			goto err;
+		scan_result__init(entry);
+		ntfy_payload->entries[i] = entry;
+		ntfy_payload->n_entries++;
+
+		entry->ssid.data = arena_strndup((char *)evt->ap_info[i].ssid,
+				SSID_LENGTH);
+		if (!entry->ssid.data)
+			goto err;
+		entry->ssid.len = strnlen((char *)entry->ssid.data, SSID_LENGTH);
+
+		snprintf(bssid, BSSID_LENGTH, MACSTR, MAC2STR(evt->ap_info[i].bssid));
+		entry->bssid.data = arena_strndup(bssid, BSSID_LENGTH);
+		if (!entry->bssid.data)
+			goto err;
+		entry->bssid.len = strnlen(bssid, BSSID_LENGTH);
+
+		entry->chnl = evt->ap_info[i].primary;
+		entry->rssi = evt->ap_info[i].rssi;
+		entry->sec_prot = evt->ap_info[i].authmode;
+	}
+
+	ntfy_payload->resp = SUCCESS;
+	return ESP_OK;
+err:
+	/* Still sent, as host waits for scan_done */
+	ESP_LOGE(TAG, "Failed to allocate scan result entries");
+	ntfy_payload->resp = FAILURE;
+	return ESP_OK;
+}
+
 esp_err_t ctrl_notify_handler(uint32_t session_id,const uint8_t *inbuf,
 		ssize_t inlen, uint8_t **outbuf, ssize_t *outlen, void *priv_data)
 {
@@ -2318,6 +2861,9 @@ esp_err_t ctrl_notify_handler(uint32_t session_id,const uint8_t *inbuf,
 		} case CTRL_MSG_ID__Event_StationDisconnectFromESPSoftAP: {
 			ret = ctrl_ntfy_StationDisconnectFromESPSoftAP(&ntfy, inbuf, inlen);
 			break;
+		} case CTRL_MSG_ID__Event_APScanResult: {
+			ret = ctrl_ntfy_APScanResult(&ntfy, inbuf, inlen);
+			break;
 		} default: {
 			ESP_LOGE(TAG, "Incorrect/unsupported Ctrl Notification[%u]\n",ntfy.msg_id);
 			goto err;
@@ -2340,11 +2886,13 @@ esp_err_t ctrl_notify_handler(uint32_t session_id,const uint8_t *inbuf,
 	if (!*outbuf) {
 		ESP_LOGE(TAG, "No memory allocated for outbuf");
 		esp_ctrl_msg_cleanup(&ntfy);
+		ctrl_msg_arena_reset(&ctrl_msg_arena);
 		return ESP_ERR_NO_MEM;
 	}
 
 	ctrl_msg__pack (&ntfy, *outbuf);
 	esp_ctrl_msg_cleanup(&ntfy);
+	ctrl_msg_arena_reset(&ctrl_msg_arena);
 	return ESP_OK;
 
 err:
@@ -2353,5 +2901,6 @@ err:
 		*outbuf = NULL;
 	}
 	esp_ctrl_msg_cleanup(&ntfy);
+	ctrl_msg_arena_reset(&ctrl_msg_arena);
 	return ESP_FAIL;
 }
@@ -263,7 +263,7 @@ int interface_remove_driver()
 	return 0;
 }
 
-void generate_startup_event(uint8_t cap)
+void generate_startup_event(uint32_t cap)
 {
 	struct esp_payload_header *header = NULL;
 	interface_buffer_handle_t buf_handle = {0};
@@ -310,6 +310,23 @@ void generate_startup_event(uint8_t cap)
 	*pos = LENGTH_1_BYTE;               pos++;len++;
 	*pos = cap;                         pos++;len++;
 
+	/* TLV - Capabilities beyond first byte, full mask little endian */
+	if (cap >> 8) {
+		*pos = ESP_PRIV_CAPABILITY_EXT; pos++;len++;
+		*pos = LENGTH_4_BYTE;           pos++;len++;
+		*pos = cap & 0xFF;              pos++;len++;
+		*pos = (cap >> 8) & 0xFF;       pos++;len++;
+		*pos = (cap >> 16) & 0xFF;      pos++;len++;
+		*pos = (cap >> 24) & 0xFF;      pos++;len++;
+	}
+
+#if CONFIG_ESP_SPI_CHECKSUM
+	/* TLV - Priority queues carrying checksum */
+	*pos = ESP_PRIV_CHECKSUM_PRIO_Q;    pos++;len++;
+	*pos = LENGTH_1_BYTE;               pos++;len++;
+	*pos = CHECKSUM_PRIO_Q_MASK;        pos++;len++;
+#endif
+
 	*pos = ESP_PRIV_TEST_RAW_TP;        pos++;len++;
 	*pos = LENGTH_1_BYTE;               pos++;len++;
 	*pos = raw_tp_cap;                  pos++;len++;
@@ -358,6 +375,76 @@ static void IRAM_ATTR spi_post_trans_cb(spi_slave_transaction_t *trans)
 	reset_handshake_gpio();
 }
 
+#if CONFIG_ESP_SPI_AGGREGATION
+/* Pack more pending tx buffers after the one in 'sendbuf', as long as they
+ * fit in the transaction. Each packet starts at DMA aligned position and
+ * all but the last one carry MORE_PKT_IN_AGGR flag.
+ * Returns end of last packet in 'sendbuf', not padded */
+static uint32_t aggregate_tx_buffers(uint8_t *sendbuf, uint32_t len)
+{
+	interface_buffer_handle_t buf_handle = {0};
+	struct esp_payload_header *header = (struct esp_payload_header *) sendbuf;
+	uint8_t prio_q_idx = 0;
+	uint32_t pos = 0;
+
+	while (ESP_AGGR_ALIGN(len) + sizeof(struct esp_payload_header) < SPI_BUFFER_SIZE) {
+
+		/* Only look at highest priority non-empty queue, to retain ordering */
+		for (prio_q_idx=0; prio_q_idx<MAX_PRIORITY_QUEUES; prio_q_idx++)
+			if (pdTRUE == xQueuePeek(spi_tx_queue[prio_q_idx], &buf_handle, 0))
+				break;
+
+		if (prio_q_idx == MAX_PRIORITY_QUEUES)
+			break;
+
+		pos = ESP_AGGR_ALIGN(len);
+		if (pos + buf_handle.payload_len > SPI_BUFFER_SIZE)
+			break;
+
+		if (pdTRUE != xSemaphoreTake(spi_tx_sem, 0))
+			break;
+
+		if (pdFALSE == xQueueReceive(spi_tx_queue[prio_q_idx], &buf_handle, 0)) {
+			xSemaphoreGive(spi_tx_sem);
+			break;
+		}
+
+		/* Checksum is plain byte sum, account for newly set flag */
+		header->flags |= MORE_PKT_IN_AGGR;
+#if CONFIG_ESP_SPI_CHECKSUM
+		if (IS_CHECKSUM_ON_IF(header->if_type))
+			header->checksum = htole16(le16toh(header->checksum) + MORE_PKT_IN_AGGR);
+#endif
+
+		memset(sendbuf + len, 0, pos - len);
+		memcpy(sendbuf + pos, buf_handle.payload, buf_handle.payload_len);
+		header = (struct esp_payload_header *) (sendbuf + pos);
+		len = pos + buf_handle.payload_len;
+
+		spi_buffer_tx_free(buf_handle.payload);
+	}
+
+	return len;
+}
+#endif
+
+#if CONFIG_ESP_SPI_VAR_LEN
+/* Announce length of ESP data in transaction, in first payload header.
+ * Host clocks at least as much, and may end transaction there */
+static void set_tx_xfer_len(uint8_t *sendbuf, uint32_t len)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) sendbuf;
+
+	header->xfer_len = (len + ESP_SPI_XFER_LEN_UNIT - 1) / ESP_SPI_XFER_LEN_UNIT;
+
+	/* Checksum is plain byte sum, account for newly set field */
+#if CONFIG_ESP_SPI_CHECKSUM
+	if (IS_CHECKSUM_ON_IF(header->if_type))
+		header->checksum = htole16(le16toh(header->checksum) + header->xfer_len);
+#endif
+}
+#endif
+
 static uint8_t * get_next_tx_buffer(uint32_t *len)
 {
 	interface_buffer_handle_t buf_handle = {0};
@@ -378,6 +465,13 @@ static uint8_t * get_next_tx_buffer(uint32_t *len)
 					ret = pdFALSE;
 
 	if (ret == pdTRUE && buf_handle.payload) {
+#if CONFIG_ESP_SPI_AGGREGATION
+		buf_handle.payload_len = aggregate_tx_buffers(buf_handle.payload,
+				buf_handle.payload_len);
+#endif
+#if CONFIG_ESP_SPI_VAR_LEN
+		set_tx_xfer_len(buf_handle.payload, buf_handle.payload_len);
+#endif
 		if (len)
 			*len = buf_handle.payload_len;
 		/* Return real data buffer from queue */
@@ -410,68 +504,124 @@ static uint8_t * get_next_tx_buffer(uint32_t *len)
 	return sendbuf;
 }
 
-static int process_spi_rx(interface_buffer_handle_t *buf_handle)
+/* Validate packet at 'header' and return its total length (header + payload).
+ * 'room' is the space left in rx buffer from 'header' onwards.
+ * Returns 0 if packet is not valid */
+static uint16_t get_rx_pkt_len(struct esp_payload_header *header, uint16_t room)
 {
-	struct esp_payload_header *header = NULL;
 	uint16_t len = 0, offset = 0;
 #if CONFIG_ESP_SPI_CHECKSUM
 	uint16_t rx_checksum = 0, checksum = 0;
 #endif
 
-	/* Validate received buffer. Drop invalid buffer. */
+	if (room < sizeof(struct esp_payload_header))
+		return 0;
 
-	if (!buf_handle || !buf_handle->payload) {
-		ESP_LOGE(TAG, "%s: Invalid params", __func__);
-		return -1;
-	}
-
-	header = (struct esp_payload_header *) buf_handle->payload;
 	len = le16toh(header->len);
 	offset = le16toh(header->offset);
 
 	if (!len)
-		return -1;
+		return 0;
 
-	if (len > SPI_BUFFER_SIZE) {
-		ESP_LOGE(TAG, "rx_pkt len[%u]>max[%u], dropping it", len, SPI_BUFFER_SIZE);
+	if (len + offset > room) {
+		ESP_LOGE(TAG, "rx_pkt len[%u]>max[%u], dropping it", len + offset, room);
 
-		return -1;
+		return 0;
 	}
 
 #if CONFIG_ESP_SPI_CHECKSUM
-	rx_checksum = le16toh(header->checksum);
-	header->checksum = 0;
+	if (IS_CHECKSUM_ON_IF(header->if_type)) {
+		rx_checksum = le16toh(header->checksum);
+		header->checksum = 0;
 
-	checksum = compute_checksum(buf_handle->payload, len+offset);
+		checksum = compute_checksum((uint8_t *) header, len+offset);
 
-	if (checksum != rx_checksum) {
-		ESP_LOGE(TAG, "%s: cal_chksum[%u] != exp_chksum[%u], drop len[%u] offset[%u]",
-				__func__, checksum, rx_checksum, len, offset);
-		return -1;
+		if (checksum != rx_checksum) {
+			ESP_LOGE(TAG, "%s: cal_chksum[%u] != exp_chksum[%u], drop len[%u] offset[%u]",
+					__func__, checksum, rx_checksum, len, offset);
+			return 0;
+		}
 	}
 #endif
 
-	/* Buffer is valid */
-	buf_handle->if_type = header->if_type;
-	buf_handle->if_num = header->if_num;
-	buf_handle->free_buf_handle = esp_spi_read_done;
-	buf_handle->payload_len = le16toh(header->len) + offset;
-	buf_handle->priv_buffer_handle = buf_handle->payload;
+	return len + offset;
+}
 
+static void enqueue_rx_buffer(interface_buffer_handle_t *buf_handle)
+{
 #if ESP_PKT_STATS
 	if (buf_handle->if_type == ESP_STA_IF)
 		pkt_stats.sta_rx_in++;
 #endif
-	if (header->if_type == ESP_SERIAL_IF) {
+	if (buf_handle->if_type == ESP_SERIAL_IF) {
 		xQueueSend(spi_rx_queue[PRIO_Q_SERIAL], buf_handle, portMAX_DELAY);
-	} else if (header->if_type == ESP_HCI_IF) {
+	} else if (buf_handle->if_type == ESP_HCI_IF) {
 		xQueueSend(spi_rx_queue[PRIO_Q_BT], buf_handle, portMAX_DELAY);
 	} else {
 		xQueueSend(spi_rx_queue[PRIO_Q_OTHERS], buf_handle, portMAX_DELAY);
 	}
 
 	xSemaphoreGive(spi_rx_sem);
-	return 0;
+}
+
+static int process_spi_rx(interface_buffer_handle_t *buf_handle)
+{
+	struct esp_payload_header *header = NULL;
+	interface_buffer_handle_t pkt_handle = {0};
+	uint8_t *rx_buf = NULL;
+	uint16_t len = 0, pos = 0, room = 0;
+
+	/* Validate received buffer. Drop invalid buffer. */
+
+	if (!buf_handle || !buf_handle->payload) {
+		ESP_LOGE(TAG, "%s: Invalid params", __func__);
+		return -1;
+	}
+
+	rx_buf = buf_handle->payload;
+	/* Only as much as host clocked */
+	room = buf_handle->payload_len;
+
+	/* Host may pack multiple packets in one transaction, each at DMA aligned
+	 * position, with MORE_PKT_IN_AGGR set on all but the last one.
+	 * Leading packets are copied out, last one is handed over in rx buffer */
+	for (;;) {
+		header = (struct esp_payload_header *) (rx_buf + pos);
+		len = get_rx_pkt_len(header, room - pos);
+		if (!len)
+			return -1;
+
+		if (!(header->flags & MORE_PKT_IN_AGGR) ||
+		    (ESP_AGGR_ALIGN(pos + len) >= room)) {
+			/* Buffer is valid */
+			buf_handle->if_type = header->if_type;
+			buf_handle->if_num = header->if_num;
+			buf_handle->free_buf_handle = esp_spi_read_done;
+			buf_handle->payload = rx_buf + pos;
+			buf_handle->payload_len = len;
+			buf_handle->priv_buffer_handle = rx_buf;
+
+			enqueue_rx_buffer(buf_handle);
+			return 0;
+		}
+
+		memset(&pkt_handle, 0, sizeof(pkt_handle));
+		pkt_handle.payload = malloc(len);
+		if (pkt_handle.payload) {
+			memcpy(pkt_handle.payload, header, len);
+			pkt_handle.if_type = header->if_type;
+			pkt_handle.if_num = header->if_num;
+			pkt_handle.free_buf_handle = free;
+			pkt_handle.payload_len = len;
+			pkt_handle.priv_buffer_handle = pkt_handle.payload;
+
+			enqueue_rx_buffer(&pkt_handle);
+		} else {
+			ESP_LOGE(TAG, "Failed to allocate aggregated rx pkt, drop");
+		}
+
+		pos = ESP_AGGR_ALIGN(pos + len);
+	}
 }
 
 static void queue_next_transaction(void)
@@ -525,6 +675,14 @@ static void spi_transaction_post_process_task(void* pvParameters)
 		/* Process received data */
 		if (spi_trans->rx_buffer) {
 			rx_buf_handle.payload = spi_trans->rx_buffer;
+#if CONFIG_ESP_SPI_VAR_LEN
+			/* Host may end transaction early */
+			rx_buf_handle.payload_len = spi_trans->trans_len / SPI_BITS_PER_WORD;
+			if (rx_buf_handle.payload_len > SPI_BUFFER_SIZE)
+				rx_buf_handle.payload_len = SPI_BUFFER_SIZE;
+#else
+			rx_buf_handle.payload_len = SPI_BUFFER_SIZE;
+#endif
 
 			ret = process_spi_rx(&rx_buf_handle);
 
@@ -730,8 +888,9 @@ static int32_t esp_spi_write(interface_handle_t *handle, interface_buffer_handle
 
 
 #if CONFIG_ESP_SPI_CHECKSUM
-	header->checksum = htole16(compute_checksum(tx_buf_handle.payload,
-				offset+buf_handle->payload_len));
+	if (IS_CHECKSUM_ON_IF(header->if_type))
+		header->checksum = htole16(compute_checksum(tx_buf_handle.payload,
+					offset+buf_handle->payload_len));
 #endif
 
 	if (header->if_type == ESP_SERIAL_IF)
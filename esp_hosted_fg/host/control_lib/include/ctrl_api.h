@@ -35,6 +35,12 @@
 #define DEFAULT_CTRL_RESP_TIMEOUT            30
 #define DEFAULT_CTRL_RESP_AP_SCAN_TIMEOUT    (60*3)
 
+/* ESP reassembles control request in 4096 bytes,
+ * so that is what OTA write data has to fit in, with headers */
+#define CTRL_OTA_WRITE_MAX_FRAG_SIZE         4000
+#define CTRL_OTA_DEFAULT_WINDOW              4
+#define CTRL_OTA_MAX_WINDOW                  8
+
 
 #define SUCCESS_STR                          "success"
 #define FAILURE_STR                          "failure"
@@ -156,6 +162,7 @@ typedef enum {
 		CTRL_MSG_ID__Event_StationDisconnectFromAP,
 	CTRL_EVENT_STATION_DISCONNECT_FROM_ESP_SOFTAP =
 		CTRL_MSG_ID__Event_StationDisconnectFromESPSoftAP,
+	CTRL_EVENT_AP_SCAN_RESULT  = CTRL_MSG_ID__Event_APScanResult,
 	/*
 	 * Add new control path command notification before Event_Max
 	 * and update Event_Max
@@ -276,6 +283,9 @@ typedef struct {
 	int count;
 	/* dynamic size */
 	wifi_scanlist_t *out_list;
+	/* Req: respond as soon as scan is started. APs found are then
+	 * sent as CTRL_EVENT_AP_SCAN_RESULT events, channel by channel */
+	bool stream;
 } wifi_ap_scan_list_t;
 
 typedef struct {
@@ -295,15 +305,92 @@ typedef struct {
 	vendor_ie_data_t vnd_ie;
 } wifi_softap_vendor_ie_t;
 
+typedef struct {
+	/* OTA writes carry zlib stream of image, which ESP inflates */
+	bool compressed;
+	/* If non zero, ESP checkpoints written offset and resumes
+	 * interrupted OTA of image with same id and size */
+	uint32_t image_id;
+	uint32_t image_size;
+	/* Resp: image offset OTA writes are to continue from */
+	uint32_t resume_offset;
+} ota_begin_t;
+
 typedef struct {
 	uint8_t *ota_data;
 	uint32_t ota_data_len;
+	/* Image offset of ota_data, checked if OTA began with image_id */
+	uint32_t offset;
+	/* Resp: image offset written durably, which OTA would resume from */
+	uint32_t checkpoint;
 } ota_write_t;
 
 typedef struct {
 	int power;
 } wifi_tx_power_t;
 
+typedef struct {
+	/* Bytes sent to ESP and ESP confirmed as written to flash */
+	uint32_t bytes_sent;
+	uint32_t bytes_written;
+	/* As set in ota_update_config_t, 0 if unknown */
+	uint32_t total_bytes;
+	uint32_t elapsed_ms;
+	/* bytes_written per sec since OTA begin */
+	uint32_t bytes_per_sec;
+	/* Offset OTA resumed from, 0 if image was sent from start */
+	uint32_t resume_offset;
+	/* Offset ESP confirmed as durably written. OTA of same
+	 * image_id resumes from here, if interrupted */
+	uint32_t checkpoint;
+} ota_progress_t;
+
+/* Fill `buf` with next, up to `len` bytes of image.
+ * Returns bytes filled in, 0 at end of image or negative on error */
+typedef int (*ota_read_cb_t)(void *priv, uint8_t *buf, uint32_t len);
+
+/* Position image source, so that next read_cb starts at `offset`.
+ * Returns 0 on success */
+typedef int (*ota_seek_cb_t)(void *priv, uint32_t offset);
+
+typedef void (*ota_progress_cb_t)(const ota_progress_t *progress, void *priv);
+
+typedef struct {
+	/* Mandatory, image source */
+	ota_read_cb_t read_cb;
+	/* Passed to read_cb and progress_cb */
+	void *priv;
+	/* Optional, image size. If set, OTA fails if image size differs */
+	uint32_t total_bytes;
+	/* Bytes read from read_cb at a time, default is frag_size.
+	 * Chunk is sent in fragments of frag_size */
+	uint32_t chunk_size;
+	/* Bytes per OTA write request, default and
+	 * maximum is CTRL_OTA_WRITE_MAX_FRAG_SIZE */
+	uint32_t frag_size;
+	/* OTA write requests in flight, awaiting response.
+	 * Default is CTRL_OTA_DEFAULT_WINDOW, maximum is CTRL_OTA_MAX_WINDOW */
+	uint8_t window;
+	/* Response timeout of each request, default DEFAULT_CTRL_RESP_TIMEOUT */
+	int cmd_timeout_sec;
+	/* Optional, called as ESP confirms writes */
+	ota_progress_cb_t progress_cb;
+	/* Image from read_cb is zlib stream (e.g. made by ota_compress),
+	 * inflated by ESP as written. Sizes and progress are then
+	 * of compressed image */
+	bool compressed;
+	/* Optional, enables resume. Identifies image, e.g. its CRC32, and
+	 * needs total_bytes. Interrupted OTA is left open at ESP, and next
+	 * OTA of same image_id and size continues from ESP checkpoint */
+	uint32_t image_id;
+	/* Times OTA is resumed within this call after transport or
+	 * write failure, needs image_id */
+	uint8_t retries;
+	/* Optional, used to position image source on resume. If not set,
+	 * image is read and skipped, which works only going forward */
+	ota_seek_cb_t seek_cb;
+} ota_update_config_t;
+
 typedef struct {
 	/* event */
 	uint32_t hb_num;
@@ -317,6 +404,16 @@ typedef struct {
 	char mac[MAX_MAC_STR_LEN];
 } event_station_disconn_t;
 
+typedef struct {
+	/* channel just scanned */
+	int channel;
+	/* last event of this scan */
+	bool scan_done;
+	int count;
+	/* dynamic size */
+	wifi_scanlist_t *out_list;
+} event_ap_scan_result_t;
+
 typedef struct Ctrl_cmd_t {
 	/* msg type could be 1. req 2. resp 3. notification */
 	uint8_t msg_type;
@@ -340,6 +437,8 @@ typedef struct Ctrl_cmd_t {
 
 		wifi_power_save_t           wifi_ps;
 
+		ota_begin_t                 ota_begin;
+
 		ota_write_t                 ota_write;
 
 		wifi_tx_power_t             wifi_tx_power;
@@ -347,6 +446,8 @@ typedef struct Ctrl_cmd_t {
 		event_heartbeat_t           e_heartbeat;
 
 		event_station_disconn_t     e_sta_disconnected;
+
+		event_ap_scan_result_t      e_ap_scan_result;
 	}u;
 
 	/* By default this callback is set to NULL.
@@ -373,9 +474,26 @@ typedef struct Ctrl_cmd_t {
 	/* free handle to be registered
 	 * Ignored if assigned as NULL */
 	void (*free_buffer_func)(void *free_buffer_handle);
+
+	/* Sequence id assigned by control lib to request and carried
+	 * back in its response. Not to be set by app */
+	uint32_t uid;
 } ctrl_cmd_t;
 
 
+/* Usage of preallocated pool, which responses and events
+ * handed over to application are taken from */
+typedef struct {
+	/* Number of messages in pool */
+	uint32_t capacity;
+	/* Messages currently held by application or control lib */
+	uint32_t in_use;
+	/* Highest value of in_use seen */
+	uint32_t peak_in_use;
+	/* Allocations served from heap as pool was empty */
+	uint32_t exhausted;
+} ctrl_msg_pool_stats_t;
+
 /* resp callback */
 typedef int (*ctrl_resp_cb_t) (ctrl_cmd_t * resp);
 
@@ -392,7 +510,7 @@ typedef int (*ctrl_event_cb_t) (ctrl_cmd_t * event);
  *   1. allocated buffer within library are saved in `app_resp->free_buffer_handle`
  *   Please use `app_resp->free_buffer_func` for freeing them.
  *   2. Response `ctrl_cmd_t *app_resp` is also allocated from library,
- *   need to free using hosted_free() function.
+ *   need to free using free_ctrl_msg() function.
  **/
 
 /* Set control event callback
@@ -440,6 +558,57 @@ int reset_event_callback(int event);
  **/
 int init_hosted_control_lib(void);
 
+/* Initialize hosted control library in event loop mode
+ *
+ * Alternative to init_hosted_control_lib() for single threaded
+ * applications with their own event loop (poll/epoll/select).
+ * No rx thread is created. Application waits for get_ctrl_poll_fd() to be
+ * readable and calls ctrl_process_pending(), which decodes received
+ * responses and events and calls their callbacks in caller's context.
+ * Only async requests, i.e. with `ctrl_resp_cb` set, are allowed.
+ * Supported on Linux host only.
+ *
+ * Returns:
+ * > SUCCESS - 0
+ * > FAILURE - -1
+ **/
+int init_hosted_control_lib_poll_mode(void);
+
+/* Get file descriptor to wait on, in event loop mode
+ *
+ * Fd becomes readable when data from ESP is available.
+ * Fd is closed by deinit_hosted_control_lib(), so remove it from
+ * event loop before that.
+ *
+ * Returns:
+ * > fd - to poll for readability
+ * > FAILURE - -1, if not in event loop mode
+ **/
+int get_ctrl_poll_fd(void);
+
+/* Get time till next async response timeout is due, in event loop mode
+ *
+ * Can directly be used as timeout of poll() or epoll_wait(), so that
+ * ctrl_process_pending() is called in time to report timed out requests
+ *
+ * Returns:
+ * > milliseconds till earliest response timeout, 0 if already due
+ * > -1 - if no response is awaited or not in event loop mode
+ **/
+int get_ctrl_poll_timeout_ms(void);
+
+/* Process everything pending, in event loop mode
+ *
+ * Never blocks. Decodes all complete responses and events received so
+ * far and calls their callbacks, then fails async requests whose
+ * response timed out, with CTRL_ERR_REQUEST_TIMEOUT.
+ *
+ * Returns:
+ * > Number of messages received and processed, >= 0
+ * > FAILURE - -1, if not in event loop mode
+ **/
+int ctrl_process_pending(void);
+
 /* De-initialize hosted control library
  *
  * This is last step for application while using control path
@@ -451,6 +620,28 @@ int init_hosted_control_lib(void);
  **/
 int deinit_hosted_control_lib(void);
 
+/* Free response or event received from hosted control lib
+ *
+ * Also frees `free_buffer_handle` using `free_buffer_func`, if set.
+ * Messages come from preallocated pool, so do not use free()
+ * or hosted_free() on them.
+ *
+ * Inputs:
+ * > app_msg - Response or event, NULL is ignored
+ **/
+void free_ctrl_msg(ctrl_cmd_t *app_msg);
+
+/* Get usage statistics of control message pool
+ *
+ * Inputs:
+ * > stats - Filled in with current statistics
+ *
+ * Returns:
+ * > SUCCESS - 0
+ * > FAILURE - -1
+ **/
+int get_ctrl_msg_pool_stats(ctrl_msg_pool_stats_t *stats);
+
 /* Get the MAC address of station or softAP interface of ESP32 */
 ctrl_cmd_t * wifi_get_mac(ctrl_cmd_t req);
 
@@ -524,6 +715,27 @@ ctrl_cmd_t * ota_write(ctrl_cmd_t req);
  * Creates timer which reset ESP32 after 5 sec */
 ctrl_cmd_t * ota_end(ctrl_cmd_t req);
 
+/* Performs complete OTA of ESP32, i.e. OTA begin, writes and end
+ *
+ * Image is read using `config->read_cb` and sent in OTA write requests
+ * without waiting for response of each, keeping up to `config->window`
+ * writes in flight. ESP writes them in order. On any failure, no more
+ * writes are sent and OTA is ended, so that ESP keeps booting current
+ * image.
+ *
+ * Blocks till OTA end response. Only one OTA update at a time.
+ * Not supported in event loop mode.
+ *
+ * Inputs:
+ * > config - OTA update configuration
+ * > progress - Optional, filled in with final progress
+ *
+ * Returns:
+ * > SUCCESS - 0, ESP will restart with new image after 5 sec
+ * > FAILURE - -1
+ **/
+int ota_update(ota_update_config_t *config, ota_progress_t *progress);
+
 /* Get the interface up for interface `iface` */
 int interface_up(int sockfd, char* iface);
 
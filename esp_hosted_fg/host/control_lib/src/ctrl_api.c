@@ -4,8 +4,10 @@
  * Copyright (C) 2015-2022 Espressif Systems (Shanghai) PTE LTD
  * SPDX-License-Identifier: GPL-2.0-only OR Apache-2.0
  */
+#include <string.h>
 #include "ctrl_api.h"
 #include "ctrl_core.h"
+#include "platform_wrapper.h"
 
 #define CTRL_SEND_REQ(msGiD) do {                                     \
     req.msg_id = msGiD;                                               \
@@ -21,18 +23,47 @@
   return ctrl_wait_and_parse_sync_resp(&req);                         \
 } while(0);
 
+#define OTA_MIN(X, Y)                  (((X) < (Y)) ? (X) : (Y))
+
 extern int init_hosted_control_lib_internal(void);
+extern int init_hosted_control_lib_poll_mode_internal(void);
 extern int deinit_hosted_control_lib_internal(void);
 
+static int ota_ctxt_init(void);
+static void ota_ctxt_deinit(void);
+
 
 int init_hosted_control_lib(void)
 {
-	return init_hosted_control_lib_internal();
+	if (ota_ctxt_init())
+		return FAILURE;
+
+	if (init_hosted_control_lib_internal()) {
+		ota_ctxt_deinit();
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+int init_hosted_control_lib_poll_mode(void)
+{
+	if (ota_ctxt_init())
+		return FAILURE;
+
+	if (init_hosted_control_lib_poll_mode_internal()) {
+		ota_ctxt_deinit();
+		return FAILURE;
+	}
+	return SUCCESS;
 }
 
 int deinit_hosted_control_lib(void)
 {
-	return deinit_hosted_control_lib_internal();
+	int ret = deinit_hosted_control_lib_internal();
+
+	/* Write responses can no longer turn up */
+	ota_ctxt_deinit();
+	return ret;
 }
 
 /** Control Req->Resp APIs **/
@@ -161,3 +192,369 @@ ctrl_cmd_t * ota_end(ctrl_cmd_t req)
 	CTRL_SEND_REQ(CTRL_REQ_OTA_END);
 	CTRL_DECODE_RESP_IF_NOT_ASYNC();
 }
+
+/** OTA update, with window of writes in flight **/
+
+/* State of ota_update() in progress, shared with write response callback
+ * which runs in control lib rx or timer thread. ESP responds in order, so
+ * i'th response is for i'th write sent.
+ * Writes of an attempt are sent after its OTA begin, so they have higher
+ * uid than begin response. Responses with lower uid are from an earlier
+ * attempt, which gave up waiting for them, and are ignored */
+static struct {
+	/* Held for whole of ota_update(), so only one runs at a time */
+	void *lock;
+	/* Serializes response callback with attempt start and end */
+	void *state_lock;
+	void *ack_sem;
+	/* uid of OTA begin response of attempt, 0 if none is running */
+	uint32_t begin_uid;
+	uint8_t window;
+	uint32_t frag_len[CTRL_OTA_MAX_WINDOW];
+	uint32_t frags_sent;
+	volatile uint32_t frags_acked;
+	volatile uint32_t bytes_written;
+	volatile uint32_t checkpoint;
+	volatile uint8_t failed;
+} ota_ctxt;
+
+static int ota_ctxt_init(void)
+{
+	ota_ctxt.lock = hosted_create_semaphore(1);
+	ota_ctxt.state_lock = hosted_create_semaphore(1);
+	ota_ctxt.ack_sem = hosted_create_semaphore(0);
+	if (!ota_ctxt.lock || !ota_ctxt.state_lock || !ota_ctxt.ack_sem) {
+		printf("Failed to create OTA semaphores\n");
+		ota_ctxt_deinit();
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+static void ota_ctxt_deinit(void)
+{
+	if (ota_ctxt.lock)
+		hosted_destroy_semaphore(ota_ctxt.lock);
+	if (ota_ctxt.state_lock)
+		hosted_destroy_semaphore(ota_ctxt.state_lock);
+	if (ota_ctxt.ack_sem)
+		hosted_destroy_semaphore(ota_ctxt.ack_sem);
+	ota_ctxt.lock = NULL;
+	ota_ctxt.state_lock = NULL;
+	ota_ctxt.ack_sem = NULL;
+}
+
+/* Start accepting write responses newer than `begin_uid`,
+ * or stop accepting any with 0 */
+static void ota_set_begin_uid(uint32_t begin_uid)
+{
+	hosted_get_semaphore(ota_ctxt.state_lock, HOSTED_SEM_BLOCKING);
+	ota_ctxt.begin_uid = begin_uid;
+	if (!begin_uid) {
+		ota_ctxt.frags_sent = 0;
+		ota_ctxt.frags_acked = 0;
+		ota_ctxt.failed = 0;
+	}
+	hosted_post_semaphore(ota_ctxt.state_lock);
+}
+
+static int ota_write_resp_cb(ctrl_cmd_t *resp)
+{
+	uint32_t idx = 0;
+
+	hosted_get_semaphore(ota_ctxt.state_lock, HOSTED_SEM_BLOCKING);
+
+	/* uid 0 is of write which failed to go out, reported right away */
+	if (!ota_ctxt.begin_uid || (resp->uid &&
+	    ((int32_t)(resp->uid - ota_ctxt.begin_uid) <= 0))) {
+		hosted_post_semaphore(ota_ctxt.state_lock);
+		free_ctrl_msg(resp);
+		return SUCCESS;
+	}
+
+	idx = ota_ctxt.frags_acked % ota_ctxt.window;
+	if (resp->resp_event_status == SUCCESS) {
+		ota_ctxt.bytes_written += ota_ctxt.frag_len[idx];
+	} else {
+		printf("OTA write failed, status[%u]\n", resp->resp_event_status);
+		ota_ctxt.failed = 1;
+	}
+	if (resp->u.ota_write.checkpoint > ota_ctxt.checkpoint)
+		ota_ctxt.checkpoint = resp->u.ota_write.checkpoint;
+	ota_ctxt.frags_acked++;
+
+	hosted_post_semaphore(ota_ctxt.state_lock);
+	free_ctrl_msg(resp);
+	hosted_post_semaphore(ota_ctxt.ack_sem);
+	return SUCCESS;
+}
+
+/* Wait till no more than `max_in_flight` writes await response
+ * Control lib fails timed out writes by itself, so waiting a bit longer
+ * than response timeout is only to never block forever */
+static int ota_wait_in_flight(uint32_t max_in_flight, int timeout_sec)
+{
+	while (ota_ctxt.frags_sent - ota_ctxt.frags_acked > max_in_flight) {
+		if (hosted_get_semaphore(ota_ctxt.ack_sem, timeout_sec + 1)) {
+			printf("OTA write response not received\n");
+			return FAILURE;
+		}
+	}
+	return SUCCESS;
+}
+
+static void ota_update_progress(ota_update_config_t *config,
+		ota_progress_t *progress, uint64_t start_ms)
+{
+	progress->bytes_written = ota_ctxt.bytes_written;
+	progress->checkpoint = ota_ctxt.checkpoint;
+	progress->elapsed_ms = hosted_get_time_ms() - start_ms;
+	progress->bytes_per_sec = progress->elapsed_ms ?
+		(uint64_t)(progress->bytes_written - progress->resume_offset) *
+		1000 / progress->elapsed_ms : 0;
+
+	if (config->progress_cb)
+		config->progress_cb(progress, config->priv);
+}
+
+/* Begin OTA at ESP, which tells offset to continue from */
+static int ota_update_begin(ota_update_config_t *config, int timeout_sec,
+		uint32_t *resume_offset, uint32_t *begin_uid)
+{
+	ctrl_cmd_t req = {0};
+	ctrl_cmd_t *resp = NULL;
+	int ret = FAILURE;
+
+	req.msg_type = CTRL_REQ;
+	req.cmd_timeout_sec = timeout_sec;
+	req.u.ota_begin.compressed = config->compressed;
+	req.u.ota_begin.image_id = config->image_id;
+	req.u.ota_begin.image_size = config->total_bytes;
+	resp = ota_begin(req);
+	if (!resp || resp->resp_event_status != SUCCESS) {
+		printf("OTA begin failed\n");
+	} else if (resp->u.ota_begin.resume_offset > config->total_bytes) {
+		printf("OTA resume offset %u beyond image\n",
+				resp->u.ota_begin.resume_offset);
+	} else {
+		*resume_offset = resp->u.ota_begin.resume_offset;
+		*begin_uid = resp->uid;
+		ret = SUCCESS;
+	}
+
+	free_ctrl_msg(resp);
+	return ret;
+}
+
+/* Position image source at `offset`. Without seek_cb, image is read and
+ * skipped, so source can not be moved back */
+static int ota_update_seek(ota_update_config_t *config, uint32_t *src_offset,
+		uint32_t offset, uint8_t *buf, uint32_t buf_size)
+{
+	int read_len = 0;
+
+	if (*src_offset == offset)
+		return SUCCESS;
+
+	if (config->seek_cb) {
+		if (config->seek_cb(config->priv, offset)) {
+			printf("Failed to seek OTA image to %u\n", offset);
+			return FAILURE;
+		}
+		*src_offset = offset;
+		return SUCCESS;
+	}
+
+	if (offset < *src_offset) {
+		printf("OTA image can not be read again from %u, no seek_cb\n",
+				offset);
+		return FAILURE;
+	}
+
+	while (*src_offset < offset) {
+		read_len = config->read_cb(config->priv, buf,
+				OTA_MIN(buf_size, offset - *src_offset));
+		if (read_len <= 0) {
+			printf("Failed to read OTA image up to %u\n", offset);
+			return FAILURE;
+		}
+		*src_offset += read_len;
+	}
+	return SUCCESS;
+}
+
+int ota_update(ota_update_config_t *config, ota_progress_t *progress)
+{
+	ctrl_cmd_t req = {0};
+	ctrl_cmd_t *resp = NULL;
+	ota_progress_t p = {0};
+	uint8_t *chunk = NULL;
+	uint32_t chunk_size = 0, frag_size = 0, off = 0, len = 0;
+	uint32_t last_reported = 0, src_offset = 0, img_offset = 0, begin_uid = 0;
+	uint8_t retries = 0, began = 0;
+	uint64_t start_ms = 0;
+	int timeout_sec = 0, read_len = 0, ret = FAILURE;
+
+	if (!config || !config->read_cb ||
+	    (config->image_id && !config->total_bytes)) {
+		printf("Invalid OTA update config\n");
+		return FAILURE;
+	}
+
+	/* Writes are awaited by blocking, which needs control lib rx thread */
+	if (get_ctrl_poll_fd() >= 0) {
+		printf("OTA update not supported in event loop mode\n");
+		return FAILURE;
+	}
+
+	if (!ota_ctxt.lock || hosted_get_semaphore(ota_ctxt.lock, 0)) {
+		printf("OTA update already in progress\n");
+		return FAILURE;
+	}
+
+	frag_size = config->frag_size ?
+		OTA_MIN(config->frag_size, CTRL_OTA_WRITE_MAX_FRAG_SIZE) :
+		CTRL_OTA_WRITE_MAX_FRAG_SIZE;
+	chunk_size = config->chunk_size ? config->chunk_size : frag_size;
+	frag_size = OTA_MIN(frag_size, chunk_size);
+	timeout_sec = config->cmd_timeout_sec ?
+		config->cmd_timeout_sec : DEFAULT_CTRL_RESP_TIMEOUT;
+	retries = config->image_id ? config->retries : 0;
+
+	chunk = (uint8_t *)hosted_malloc(chunk_size);
+	if (!chunk) {
+		printf("Failed to allocate OTA chunk of %u bytes\n", chunk_size);
+		hosted_post_semaphore(ota_ctxt.lock);
+		return FAILURE;
+	}
+
+	ota_ctxt.window = config->window ?
+		OTA_MIN(config->window, CTRL_OTA_MAX_WINDOW) : CTRL_OTA_DEFAULT_WINDOW;
+	ota_ctxt.checkpoint = 0;
+
+	p.total_bytes = config->total_bytes;
+	start_ms = hosted_get_time_ms();
+
+	/* Each attempt begins OTA again, ESP resuming at its checkpoint */
+	for (;;) {
+		/* Responses of earlier attempt are ignored from here on */
+		ota_set_begin_uid(0);
+		/* Drop posts left over from earlier OTA update or attempt */
+		while (!hosted_get_semaphore(ota_ctxt.ack_sem, 0));
+
+		if (ota_update_begin(config, timeout_sec, &img_offset, &begin_uid)) {
+			ota_ctxt.failed = 1;
+			goto next_attempt;
+		}
+		began = 1;
+		ota_set_begin_uid(begin_uid);
+
+		if (img_offset)
+			printf("Resuming OTA from offset %u\n", img_offset);
+		p.resume_offset = img_offset;
+		ota_ctxt.bytes_written = img_offset;
+		ota_ctxt.checkpoint = img_offset;
+		last_reported = img_offset;
+
+		if (ota_update_seek(config, &src_offset, img_offset,
+					chunk, chunk_size)) {
+			ota_ctxt.failed = 1;
+			goto next_attempt;
+		}
+
+		while (!ota_ctxt.failed) {
+			read_len = config->read_cb(config->priv, chunk, chunk_size);
+			if (read_len < 0) {
+				printf("Failed to read OTA image\n");
+				ota_ctxt.failed = 1;
+				break;
+			}
+			if (!read_len)
+				break;
+			src_offset += read_len;
+
+			for (off = 0; off < read_len; off += len) {
+				len = OTA_MIN(frag_size, read_len - off);
+
+				if (ota_wait_in_flight(ota_ctxt.window - 1, timeout_sec))
+					ota_ctxt.failed = 1;
+				if (ota_ctxt.failed)
+					break;
+
+				if (ota_ctxt.bytes_written != last_reported) {
+					last_reported = ota_ctxt.bytes_written;
+					ota_update_progress(config, &p, start_ms);
+				}
+
+				memset(&req, 0, sizeof(req));
+				req.msg_type = CTRL_REQ;
+				req.cmd_timeout_sec = timeout_sec;
+				req.ctrl_resp_cb = ota_write_resp_cb;
+				req.u.ota_write.ota_data = chunk + off;
+				req.u.ota_write.ota_data_len = len;
+				req.u.ota_write.offset = img_offset;
+
+				/* Data is packed before ota_write() returns, so chunk
+				 * is free to be reused without waiting for response.
+				 * Send failure is reported through callback as well */
+				ota_ctxt.frag_len[ota_ctxt.frags_sent % ota_ctxt.window] = len;
+				ota_ctxt.frags_sent++;
+				ota_write(req);
+				p.bytes_sent += len;
+				img_offset += len;
+			}
+		}
+
+		if (ota_wait_in_flight(0, timeout_sec))
+			ota_ctxt.failed = 1;
+
+		if (!ota_ctxt.failed && config->total_bytes &&
+		    (ota_ctxt.bytes_written != config->total_bytes)) {
+			printf("OTA image is %u bytes, expected %u\n",
+					ota_ctxt.bytes_written, config->total_bytes);
+			ota_ctxt.failed = 1;
+			/* Image does not match image_id, resuming won't help */
+			retries = 0;
+		}
+
+next_attempt:
+		if (!ota_ctxt.failed || !retries)
+			break;
+		retries--;
+		ota_update_progress(config, &p, start_ms);
+		printf("OTA interrupted at %u bytes, resuming\n",
+				ota_ctxt.bytes_written);
+	}
+
+	if (!began)
+		goto done;
+
+	/* Interrupted OTA is left open at ESP, to be resumed */
+	if (ota_ctxt.failed && config->image_id) {
+		printf("OTA can be resumed from offset %u\n", ota_ctxt.checkpoint);
+		goto done;
+	}
+
+	/* End OTA even on failure, so that ESP releases it.
+	 * Incomplete image does not pass validation at ESP */
+	memset(&req, 0, sizeof(req));
+	req.msg_type = CTRL_REQ;
+	req.cmd_timeout_sec = timeout_sec;
+	resp = ota_end(req);
+	if (!ota_ctxt.failed && resp && resp->resp_event_status == SUCCESS)
+		ret = SUCCESS;
+	else if (!ota_ctxt.failed)
+		printf("OTA end failed\n");
+	free_ctrl_msg(resp);
+
+done:
+	ota_update_progress(config, &p, start_ms);
+	if (progress)
+		*progress = p;
+
+	/* Late responses must not touch state of next OTA update */
+	ota_set_begin_uid(0);
+	hosted_post_semaphore(ota_ctxt.lock);
+	mem_free(chunk);
+	return ret;
+}
@@ -7,9 +7,12 @@
 #include "ctrl_core.h"
 #include "serial_if.h"
 #include "platform_wrapper.h"
-#include "esp_queue.h"
 #include <unistd.h>
 
+#define CTRL_MSG_ARENA_MALLOC(size)  hosted_malloc(size)
+#define CTRL_MSG_ARENA_FREE(ptr)     hosted_free(ptr)
+#include "ctrl_msg_arena.h"
+
 
 #ifdef MCU_SYS
 #include "common.h"
@@ -43,6 +46,23 @@
 #define CTRL_LIB_STATE_INIT          1
 #define CTRL_LIB_STATE_READY         2
 
+/* Control requests which can wait for response at same time */
+#define CTRL_MAX_OUTSTANDING_REQ     8
+
+/* Responses and events held by control lib or application at same time,
+ * without falling back to heap */
+#define CTRL_MSG_POOL_SIZE           (CTRL_MAX_OUTSTANDING_REQ * 2)
+
+/* Arena to unpack received control msg into, enough for scan list
+ * of few tens of APs. Bigger msg spills over to heap */
+#ifndef CTRL_MSG_ARENA_SIZE
+#ifdef MCU_SYS
+#define CTRL_MSG_ARENA_SIZE          (4 * 1024)
+#else
+#define CTRL_MSG_ARENA_SIZE          (16 * 1024)
+#endif
+#endif
+
 #define CLEANUP_APP_MSG(app_msg) do {                                         \
   if (app_msg) {                                                              \
     if (app_msg->free_buffer_handle) {                                        \
@@ -51,7 +71,8 @@
         app_msg->free_buffer_handle = NULL;                                   \
       }                                                                       \
     }                                                                         \
-    mem_free(app_msg);                                                        \
+    free_ctrl_msg(app_msg);                                                   \
+    app_msg = NULL;                                                           \
   }                                                                           \
 } while(0);
 
@@ -87,34 +108,65 @@
 
 struct ctrl_lib_context {
 	int state;
+	/* Event loop mode: no rx thread, application polls `poll_fd`
+	 * and calls ctrl_process_pending() */
+	bool poll_mode;
+	int poll_fd;
 };
 
-typedef void (*ctrl_rx_ind_t)(void);
-
-esp_queue_t* ctrl_msg_Q = NULL;
-static void * ctrl_rx_thread_handle;
-static void * read_sem;
-static void * ctrl_req_sem;
-static void * async_timer_handle;
-static struct ctrl_lib_context ctrl_lib_ctxt;
-
-static int call_event_callback(ctrl_cmd_t *app_event);
-static int is_async_resp_callback_registered_by_resp_msg_id(int resp_msg_id);
-static int call_async_resp_callback(ctrl_cmd_t *app_resp);
-
-
-/* Control response callbacks
- * These will be updated per control request received
+/* Control request waiting for its response
  * 1. If application wants to use synchrounous, i.e. Wait till the response received
  *    after current control request is sent or timeout occurs,
- *    application will pass this callback in request as NULL.
+ *    application will pass callback in request as NULL.
+ *    Response is handed over to the waiting thread through `resp` and `resp_sem`.
  * 2. If application wants to use `asynchrounous`, i.e. Just send the request and
  *    unblock for next processing, application will assign function pointer in
- *    control request, which will be registered here.
- *    When the response comes, the this registered callback function will be called
+ *    control request, which will be saved here along with its own timeout timer.
+ *    When the response comes, this callback function will be called
  *    with input as response
+ * Response is matched to request using `uid`, which ESP echoes back
  */
-static ctrl_resp_cb_t ctrl_resp_cb_table [CTRL_RESP_MAX - CTRL_RESP_BASE] = { NULL };
+typedef struct {
+	uint32_t uid;                  /* 0 if slot is free */
+	uint16_t resp_msg_id;
+	ctrl_resp_cb_t resp_cb;        /* NULL for synchronous request */
+	void *timer_handle;            /* async only */
+	uint64_t deadline_ms;          /* async in event loop mode only */
+	void *resp_sem;                /* sync only, posted when resp arrives */
+	ctrl_cmd_t *resp;              /* sync only, resp handed to waiter */
+} ctrl_req_slot_t;
+
+/* Pool of responses and events handed over to application
+ * Free elements are linked through `next` */
+typedef union ctrl_msg_pool_elem {
+	ctrl_cmd_t msg;
+	union ctrl_msg_pool_elem *next;
+} ctrl_msg_pool_elem_t;
+
+static ctrl_msg_pool_elem_t ctrl_msg_pool[CTRL_MSG_POOL_SIZE];
+static ctrl_msg_pool_elem_t *ctrl_msg_pool_free;
+static ctrl_msg_pool_stats_t ctrl_msg_pool_stats;
+/* Kept across de-init, as application may free messages late */
+static void * ctrl_msg_pool_lock;
+
+/* Used by ctrl_rx_thread only, reset after each msg is parsed */
+static uint64_t ctrl_msg_arena_buf[CTRL_MSG_ARENA_SIZE / sizeof(uint64_t)];
+static ctrl_msg_arena_t ctrl_msg_arena = {
+	.buf = (uint8_t *)ctrl_msg_arena_buf,
+	.size = sizeof(ctrl_msg_arena_buf),
+};
+static ProtobufCAllocator ctrl_msg_allocator =
+	CTRL_MSG_ARENA_ALLOCATOR(&ctrl_msg_arena);
+
+static void * ctrl_rx_thread_handle;
+static void * ctrl_req_sem;
+static void * ctrl_req_table_lock;
+static void * ctrl_tx_lock;
+static uint32_t ctrl_last_uid;
+static ctrl_req_slot_t ctrl_req_table[CTRL_MAX_OUTSTANDING_REQ];
+static struct ctrl_lib_context ctrl_lib_ctxt = { .poll_fd = -1 };
+
+static int call_event_callback(ctrl_cmd_t *app_event);
 
 /* Control event callbacks
  * These will be updated when user registers event callback
@@ -207,6 +259,50 @@ static int convert_mac_to_bytes(uint8_t *out, size_t out_size, char *s)
 
 
 
+/* Release msg unpacked by ctrl_rx_thread, along with its arena */
+static void free_ctrl_rx_msg(CtrlMsg *ctrl_msg)
+{
+	ctrl_msg_arena_free_unpacked(&ctrl_msg_arena, &ctrl_msg_allocator,
+			(ProtobufCMessage *)ctrl_msg);
+}
+
+/* Copy scan entries into list allocated for application
+ * Returns number of entries copied, 0 if none or on failure */
+static int copy_scan_result_entries(ScanResult **entries, size_t n_entries,
+		wifi_scanlist_t **out_list)
+{
+	wifi_scanlist_t *list = NULL;
+	size_t i = 0;
+
+	*out_list = NULL;
+	if (!n_entries || !entries)
+		return 0;
+
+	list = (wifi_scanlist_t *)hosted_calloc(n_entries, sizeof(wifi_scanlist_t));
+	if (!list) {
+		command_log("Malloc Failed\n");
+		return 0;
+	}
+
+	for (i=0; i<n_entries; i++) {
+
+		if (entries[i]->ssid.len)
+			memcpy(list[i].ssid, (char *)entries[i]->ssid.data,
+				min(entries[i]->ssid.len, SSID_LENGTH));
+
+		if (entries[i]->bssid.len)
+			memcpy(list[i].bssid, (char *)entries[i]->bssid.data,
+				min(entries[i]->bssid.len, BSSID_LENGTH));
+
+		list[i].channel = entries[i]->chnl;
+		list[i].rssi = entries[i]->rssi;
+		list[i].encryption_mode = entries[i]->sec_prot;
+	}
+
+	*out_list = list;
+	return n_entries;
+}
+
 /* This will copy control event from `CtrlMsg` into
  * application structure `ctrl_cmd_t`
  * This function is called after
@@ -255,6 +351,23 @@ static int ctrl_app_parse_event(CtrlMsg *ctrl_msg, ctrl_cmd_t *app_ntfy)
 					app_ntfy->u.e_sta_disconnected.mac);*/
 			}
 			break;
+		} case CTRL_EVENT_AP_SCAN_RESULT: {
+			CtrlMsgEventAPScanResult *ep = ctrl_msg->event_ap_scan_result;
+			event_ap_scan_result_t *p = &app_ntfy->u.e_ap_scan_result;
+
+			CHECK_CTRL_MSG_NON_NULL(event_ap_scan_result);
+			app_ntfy->resp_event_status = ep->resp;
+			p->channel = ep->chnl;
+			p->scan_done = ep->scan_done;
+			p->count = copy_scan_result_entries(ep->entries, ep->n_entries,
+					&p->out_list);
+			CHECK_CTRL_MSG_NON_NULL_VAL(((size_t)p->count == ep->n_entries),
+					"Failed to copy scan result");
+
+			/* Note allocation, to be freed later by app */
+			app_ntfy->free_buffer_func = hosted_free;
+			app_ntfy->free_buffer_handle = p->out_list;
+			break;
 		} default: {
 			printf("Invalid/unsupported event[%u] received\n",ctrl_msg->msg_id);
 			goto fail_parse_ctrl_msg;
@@ -262,12 +375,12 @@ static int ctrl_app_parse_event(CtrlMsg *ctrl_msg, ctrl_cmd_t *app_ntfy)
 		}
 	}
 
-	ctrl_msg__free_unpacked(ctrl_msg, NULL);
+	free_ctrl_rx_msg(ctrl_msg);
 	ctrl_msg = NULL;
 	return SUCCESS;
 
 fail_parse_ctrl_msg:
-	ctrl_msg__free_unpacked(ctrl_msg, NULL);
+	free_ctrl_rx_msg(ctrl_msg);
 	ctrl_msg = NULL;
 	app_ntfy->resp_event_status = FAILURE;
 	return FAILURE;
@@ -321,39 +434,21 @@ static int ctrl_app_parse_resp(CtrlMsg *ctrl_msg, ctrl_cmd_t *app_resp)
 		} case CTRL_RESP_GET_AP_SCAN_LIST : {
 			CtrlMsgRespScanResult *rp = ctrl_msg->resp_scan_ap_list;
 			wifi_ap_scan_list_t *ap = &app_resp->u.wifi_ap_scan;
-			wifi_scanlist_t *list = NULL;
+			size_t n_entries = 0;
 
 			CHECK_CTRL_MSG_NON_NULL(resp_scan_ap_list);
 			CHECK_CTRL_MSG_FAILED(resp_scan_ap_list);
 
-			ap->count = rp->count;
-			if (rp->count) {
-
-				CHECK_CTRL_MSG_NON_NULL_VAL(ap->count,"No APs available");
-				list = (wifi_scanlist_t *)hosted_calloc(ap->count,
-						sizeof(wifi_scanlist_t));
-				CHECK_CTRL_MSG_NON_NULL_VAL(list, "Malloc Failed");
-			}
-
-			for (i=0; i<rp->count; i++) {
-
-				if (rp->entries[i]->ssid.len)
-					memcpy(list[i].ssid, (char *)rp->entries[i]->ssid.data,
-						rp->entries[i]->ssid.len);
-
-				if (rp->entries[i]->bssid.len)
-					memcpy(list[i].bssid, (char *)rp->entries[i]->bssid.data,
-						rp->entries[i]->bssid.len);
+			/* Streamed scan responds with no entries, APs follow as events */
+			n_entries = min(rp->count, rp->n_entries);
+			ap->count = copy_scan_result_entries(rp->entries, n_entries,
+					&ap->out_list);
+			CHECK_CTRL_MSG_NON_NULL_VAL(((size_t)ap->count == n_entries),
+					"Failed to copy scan result");
 
-				list[i].channel = rp->entries[i]->chnl;
-				list[i].rssi = rp->entries[i]->rssi;
-				list[i].encryption_mode = rp->entries[i]->sec_prot;
-			}
-
-			ap->out_list = list;
 			/* Note allocation, to be freed later by app */
 			app_resp->free_buffer_func = hosted_free;
-			app_resp->free_buffer_handle = list;
+			app_resp->free_buffer_handle = ap->out_list;
 			break;
 		} case CTRL_RESP_GET_AP_CONFIG : {
 			CHECK_CTRL_MSG_NON_NULL(resp_get_ap_config);
@@ -374,10 +469,15 @@ static int ctrl_app_parse_resp(CtrlMsg *ctrl_msg, ctrl_cmd_t *app_resp)
 					strncpy(p->status, SUCCESS_STR, STATUS_LENGTH);
 					p->status[STATUS_LENGTH-1] = '\0';
 					if (ctrl_msg->resp_get_ap_config->ssid.data) {
+						/* bytes field is not NUL terminated */
+						uint8_t len_l = 0;
+
+						len_l = min(ctrl_msg->resp_get_ap_config->ssid.len,
+								MAX_SSID_LENGTH-1);
 						strncpy((char *)p->ssid,
 								(char *)ctrl_msg->resp_get_ap_config->ssid.data,
-								MAX_SSID_LENGTH-1);
-						p->ssid[MAX_SSID_LENGTH-1] ='\0';
+								len_l);
+						p->ssid[len_l] ='\0';
 					}
 					if (ctrl_msg->resp_get_ap_config->bssid.data) {
 						uint8_t len_l = 0;
@@ -538,9 +638,14 @@ static int ctrl_app_parse_resp(CtrlMsg *ctrl_msg, ctrl_cmd_t *app_resp)
 				command_log("OTA Begin Failed\n");
 				goto fail_parse_ctrl_msg;
 			}
+			app_resp->u.ota_begin.resume_offset =
+				ctrl_msg->resp_ota_begin->resume_offset;
 			break;
 		} case CTRL_RESP_OTA_WRITE : {
 			CHECK_CTRL_MSG_NON_NULL(resp_ota_write);
+			/* Valid even if write failed */
+			app_resp->u.ota_write.checkpoint =
+				ctrl_msg->resp_ota_write->checkpoint;
 			CHECK_CTRL_MSG_FAILED(resp_ota_write);
 			if (ctrl_msg->resp_ota_write->resp) {
 				command_log("OTA write failed\n");
@@ -592,28 +697,219 @@ static int ctrl_app_parse_resp(CtrlMsg *ctrl_msg, ctrl_cmd_t *app_resp)
 	}
 
 	/* 4. Free up buffers */
-	ctrl_msg__free_unpacked(ctrl_msg, NULL);
+	free_ctrl_rx_msg(ctrl_msg);
 	ctrl_msg = NULL;
 	app_resp->resp_event_status = SUCCESS;
 	return SUCCESS;
 
 	/* 5. Free up buffers in failure cases */
 fail_parse_ctrl_msg:
-	ctrl_msg__free_unpacked(ctrl_msg, NULL);
+	free_ctrl_rx_msg(ctrl_msg);
 	ctrl_msg = NULL;
 	app_resp->resp_event_status = FAILURE;
 	return FAILURE;
 
 fail_parse_ctrl_msg2:
-	ctrl_msg__free_unpacked(ctrl_msg, NULL);
+	free_ctrl_rx_msg(ctrl_msg);
 	ctrl_msg = NULL;
 	return FAILURE;
 }
 
-/* Control path RX indication */
-static void ctrl_rx_ind(void)
+/* Set up control message pool, once for life of process
+ * Messages still held by application stay valid across de-init and init */
+static int init_ctrl_msg_pool(void)
+{
+	int i = 0;
+
+	if (ctrl_msg_pool_lock)
+		return SUCCESS;
+
+	ctrl_msg_pool_lock = hosted_create_semaphore(1);
+	if (!ctrl_msg_pool_lock) {
+		printf("ctrl msg pool sem init failed\n");
+		return FAILURE;
+	}
+
+	ctrl_msg_pool_free = NULL;
+	for (i = CTRL_MSG_POOL_SIZE - 1; i >= 0; i--) {
+		ctrl_msg_pool[i].next = ctrl_msg_pool_free;
+		ctrl_msg_pool_free = &ctrl_msg_pool[i];
+	}
+
+	memset(&ctrl_msg_pool_stats, 0, sizeof(ctrl_msg_pool_stats));
+	ctrl_msg_pool_stats.capacity = CTRL_MSG_POOL_SIZE;
+
+	return SUCCESS;
+}
+
+static inline int is_ctrl_msg_from_pool(ctrl_cmd_t *app_msg)
+{
+	return (((uint8_t *)app_msg >= (uint8_t *)&ctrl_msg_pool[0]) &&
+	        ((uint8_t *)app_msg < (uint8_t *)&ctrl_msg_pool[CTRL_MSG_POOL_SIZE]));
+}
+
+/* Get zeroed response or event from pool
+ * If pool is empty, heap is used and accounted as exhausted */
+static ctrl_cmd_t * alloc_ctrl_msg(void)
+{
+	ctrl_msg_pool_elem_t *elem = NULL;
+
+	hosted_get_semaphore(ctrl_msg_pool_lock, HOSTED_SEM_BLOCKING);
+	elem = ctrl_msg_pool_free;
+	if (elem) {
+		ctrl_msg_pool_free = elem->next;
+		ctrl_msg_pool_stats.in_use++;
+		if (ctrl_msg_pool_stats.in_use > ctrl_msg_pool_stats.peak_in_use)
+			ctrl_msg_pool_stats.peak_in_use = ctrl_msg_pool_stats.in_use;
+	} else {
+		ctrl_msg_pool_stats.exhausted++;
+	}
+	hosted_post_semaphore(ctrl_msg_pool_lock);
+
+	if (elem) {
+		memset(elem, 0, sizeof(ctrl_msg_pool_elem_t));
+		return &elem->msg;
+	}
+
+	return (ctrl_cmd_t *)hosted_calloc(1, sizeof(ctrl_cmd_t));
+}
+
+void free_ctrl_msg(ctrl_cmd_t *app_msg)
+{
+	ctrl_msg_pool_elem_t *elem = (ctrl_msg_pool_elem_t *)app_msg;
+
+	if (!app_msg)
+		return;
+
+	if (app_msg->free_buffer_handle && app_msg->free_buffer_func) {
+		app_msg->free_buffer_func(app_msg->free_buffer_handle);
+		app_msg->free_buffer_handle = NULL;
+	}
+
+	if (!is_ctrl_msg_from_pool(app_msg)) {
+		hosted_free(app_msg);
+		return;
+	}
+
+	hosted_get_semaphore(ctrl_msg_pool_lock, HOSTED_SEM_BLOCKING);
+	elem->next = ctrl_msg_pool_free;
+	ctrl_msg_pool_free = elem;
+	ctrl_msg_pool_stats.in_use--;
+	hosted_post_semaphore(ctrl_msg_pool_lock);
+}
+
+int get_ctrl_msg_pool_stats(ctrl_msg_pool_stats_t *stats)
+{
+	if (!stats || !ctrl_msg_pool_lock)
+		return FAILURE;
+
+	hosted_get_semaphore(ctrl_msg_pool_lock, HOSTED_SEM_BLOCKING);
+	*stats = ctrl_msg_pool_stats;
+	hosted_post_semaphore(ctrl_msg_pool_lock);
+
+	return SUCCESS;
+}
+
+static inline void lock_req_table(void)
+{
+	hosted_get_semaphore(ctrl_req_table_lock, HOSTED_SEM_BLOCKING);
+}
+
+static inline void unlock_req_table(void)
+{
+	hosted_post_semaphore(ctrl_req_table_lock);
+}
+
+/* Reserve request slot and assign new uid to request
+ * If all slots are busy, wait for WAIT_TIME_B2B_CTRL_REQ for one to be freed
+ * In event loop mode, slots are freed only from the caller's own loop,
+ * so do not wait
+ * Returns slot or NULL
+ **/
+static ctrl_req_slot_t * alloc_req_slot(ctrl_cmd_t *app_req)
+{
+	ctrl_req_slot_t *slot = NULL;
+	int i = 0;
+
+	do {
+		lock_req_table();
+		for (i = 0; i < CTRL_MAX_OUTSTANDING_REQ; i++) {
+			if (ctrl_req_table[i].uid)
+				continue;
+
+			slot = &ctrl_req_table[i];
+
+			/* uid 0 is reserved: free slot or ESP not echoing uid */
+			if (!++ctrl_last_uid)
+				++ctrl_last_uid;
+
+			slot->uid = ctrl_last_uid;
+			slot->resp_msg_id = app_req->msg_id - CTRL_REQ_BASE + CTRL_RESP_BASE;
+			slot->resp_cb = app_req->ctrl_resp_cb;
+			slot->timer_handle = NULL;
+			slot->deadline_ms = 0;
+			slot->resp = NULL;
+			app_req->uid = slot->uid;
+			break;
+		}
+		unlock_req_table();
+
+		if (slot || ctrl_lib_ctxt.poll_mode)
+			return slot;
+
+		/* Posted every time a slot is freed */
+	} while (!hosted_get_semaphore(ctrl_req_sem, WAIT_TIME_B2B_CTRL_REQ));
+
+	return NULL;
+}
+
+/* Caller is expected to hold ctrl_req_table_lock */
+static void free_req_slot(ctrl_req_slot_t *slot)
 {
-	hosted_post_semaphore(read_sem);
+	slot->uid = 0;
+	slot->resp_cb = NULL;
+	slot->timer_handle = NULL;
+	slot->deadline_ms = 0;
+	slot->resp = NULL;
+}
+
+/* Find request slot for given uid
+ * Caller is expected to hold ctrl_req_table_lock */
+static ctrl_req_slot_t * find_req_slot(uint32_t uid)
+{
+	int i = 0;
+
+	for (i = 0; i < CTRL_MAX_OUTSTANDING_REQ; i++) {
+		if (uid && (ctrl_req_table[i].uid == uid))
+			return &ctrl_req_table[i];
+	}
+
+	return NULL;
+}
+
+/* Find request slot, response is meant for
+ * ESP firmware not aware of uid responds with uid 0. As ESP handles
+ * requests in order, such response is for oldest request of same msg id
+ * Caller is expected to hold ctrl_req_table_lock */
+static ctrl_req_slot_t * find_req_slot_for_resp(uint32_t uid, uint16_t resp_msg_id)
+{
+	ctrl_req_slot_t *slot = NULL, *oldest = NULL;
+	int i = 0;
+
+	if (uid)
+		return find_req_slot(uid);
+
+	for (i = 0; i < CTRL_MAX_OUTSTANDING_REQ; i++) {
+		slot = &ctrl_req_table[i];
+
+		if (!slot->uid || slot->resp || (slot->resp_msg_id != resp_msg_id))
+			continue;
+
+		if (!oldest || ((int32_t)(slot->uid - oldest->uid) < 0))
+			oldest = slot;
+	}
+
+	return oldest;
 }
 
 /* Returns CALLBACK_AVAILABLE if a non NULL control event
@@ -639,11 +935,14 @@ static int is_event_callback_registered(int event)
 
 
 /* Process control msg (response or event) received from ESP32 */
-static int process_ctrl_rx_msg(CtrlMsg * proto_msg, ctrl_rx_ind_t ctrl_rx_func)
+static int process_ctrl_rx_msg(CtrlMsg * proto_msg)
 {
-	esp_queue_elem_t *elem = NULL;
 	ctrl_cmd_t *app_resp = NULL;
 	ctrl_cmd_t *app_event = NULL;
+	ctrl_req_slot_t *slot = NULL;
+	ctrl_resp_cb_t resp_cb = NULL;
+	void *timer_handle = NULL;
+	uint32_t uid = 0;
 
 	/* 1. Check if valid proto msg */
 	if (!proto_msg) {
@@ -664,12 +963,11 @@ static int process_ctrl_rx_msg(CtrlMsg * proto_msg, ctrl_rx_ind_t ctrl_rx_func)
 			 **/
 
 			/* Allocate app struct for event */
-			app_event = (ctrl_cmd_t *)hosted_malloc(sizeof(ctrl_cmd_t));
+			app_event = alloc_ctrl_msg();
 			if (!app_event) {
 				printf("Failed to allocate app_event\n");
 				goto free_buffers;
 			}
-			memset(app_event, 0, sizeof(ctrl_cmd_t));
 
 			/* Decode protobuf buffer of event and
 			 * copy into app structures */
@@ -687,74 +985,62 @@ static int process_ctrl_rx_msg(CtrlMsg * proto_msg, ctrl_rx_ind_t ctrl_rx_func)
 	/* 3. Check if it is response msg */
 	} else if (proto_msg->msg_type == CTRL_MSG_TYPE__Resp) {
 
-		/* Ctrl responses are handled asynchronously and
-		 * asynchronpusly */
+		/* Ctrl responses are handled synchronously and
+		 * asynchronously, depending upon how request was sent */
 
 		/* Allocate app struct for response */
-		app_resp = (ctrl_cmd_t *)hosted_malloc(sizeof(ctrl_cmd_t));
+		app_resp = alloc_ctrl_msg();
 		if (!app_resp) {
 			printf("Failed to allocate app_resp\n");
 			goto free_buffers;
 		}
-		memset(app_resp, 0, sizeof(ctrl_cmd_t));
-
-		/* If this was async procedure, timer would have
-		 * been running for response.
-		 * As response received, stop timer */
-		if (async_timer_handle) {
-			/* async_timer_handle will be cleaned in hosted_timer_stop */
-			hosted_timer_stop(async_timer_handle);
-			async_timer_handle = NULL;
-		}
+
+		/* proto_msg is freed while parsing */
+		uid = proto_msg->uid;
 
 		/* Decode protobuf buffer of response and
 		 * copy into app structures */
 		ctrl_app_parse_resp(proto_msg, app_resp);
+		proto_msg = NULL;
 
-		/* Is callback is available,
-		 * progress as async response */
-		if (CALLBACK_AVAILABLE ==
-			is_async_resp_callback_registered_by_resp_msg_id(app_resp->msg_id)) {
-
-			/* User registered control async response callback
-			 * function is available for this proto_msg,
-			 * so call to that function should be done and
-			 * return to select
-			 */
-			call_async_resp_callback(app_resp);
-
-			//CLEANUP_APP_MSG(app_resp);
+		/* Match response with its outstanding request */
+		lock_req_table();
+		slot = find_req_slot_for_resp(uid, app_resp->msg_id);
+		if (!slot) {
+			unlock_req_table();
+			printf("Drop resp[%u] uid[%u]: no request waiting\n",
+					app_resp->msg_id, uid);
+			CLEANUP_APP_MSG(app_resp);
+			return FAILURE;
+		}
+		app_resp->uid = slot->uid;
 
-		} else {
+		if (slot->resp_cb) {
+			/* Async request: slot is done with,
+			 * stop its response timer and call callback */
+			resp_cb = slot->resp_cb;
+			timer_handle = slot->timer_handle;
+			free_req_slot(slot);
+			unlock_req_table();
+			hosted_post_semaphore(ctrl_req_sem);
 
-			/* as control async response callback function is
-			 * NOT available/registered, treat this response as
-			 * synchronous response. forward this response to app
-			 * using 'esp_queue' and help of semaphore
-			 **/
-
-			elem = (esp_queue_elem_t*)hosted_malloc(sizeof(esp_queue_elem_t));
-			if (!elem) {
-				printf("%s %u: Malloc failed\n",__func__,__LINE__);
-				goto free_buffers;
-			}
+			/* timer_handle will be cleaned in hosted_timer_stop */
+			if (timer_handle)
+				hosted_timer_stop(timer_handle);
 
 			/* User is RESPONSIBLE to free memory from
-			 * app_resp in case of async callbacks NOT provided
-			 * to free memory, please refer CLEANUP_APP_MSG macro
+			 * app_resp. To free memory, please refer
+			 * CLEANUP_APP_MSG macro
 			 **/
-			elem->buf = app_resp;
-			elem->buf_len = sizeof(ctrl_cmd_t);
-			if (esp_queue_put(ctrl_msg_Q, (void*)elem)) {
-				printf("%s %u: ctrl Q put fail\n",__func__,__LINE__);
-				goto free_buffers;
-			}
-
-			/* Call up rx ind to unblock user */
-			if (ctrl_rx_func)
-				ctrl_rx_func();
+			resp_cb(app_resp);
+		} else {
+			/* Sync request: hand over response to waiting thread,
+			 * which frees the slot. Post under table lock, so that
+			 * waiter which timed out and sees resp, finds post too */
+			slot->resp = app_resp;
+			hosted_post_semaphore(slot->resp_sem);
+			unlock_req_table();
 		}
-		hosted_post_semaphore(ctrl_req_sem);
 
 	} else {
 		/* 4. some unsupported msg, drop it */
@@ -765,44 +1051,49 @@ static int process_ctrl_rx_msg(CtrlMsg * proto_msg, ctrl_rx_ind_t ctrl_rx_func)
 
 	/* 5. cleanup */
 free_buffers:
-	mem_free(elem);
-	mem_free(app_event);
+	free_ctrl_msg(app_event);
 	if (proto_msg) {
-		ctrl_msg__free_unpacked(proto_msg, NULL);
+		free_ctrl_rx_msg(proto_msg);
 		proto_msg = NULL;
 	}
 	return FAILURE;
 }
 
+/* Decode received protobuf msg and process it as event or response
+ * Received msg is freed while processing */
+static int decode_ctrl_rx_msg(uint8_t *buf, uint32_t buf_len)
+{
+	CtrlMsg *resp = NULL;
+
+	resp = ctrl_msg__unpack(&ctrl_msg_allocator, buf_len, buf);
+	if (!resp) {
+		ctrl_msg_arena_reset(&ctrl_msg_arena);
+		return FAILURE;
+	}
+
+	return process_ctrl_rx_msg(resp);
+}
+
 /* Control path rx thread
  * This is entry point for control path messages received from ESP32 */
 static void ctrl_rx_thread(void const *arg)
 {
 	uint32_t buf_len = 0;
 
-	ctrl_rx_ind_t ctrl_rx_func;
-	ctrl_rx_func = (ctrl_rx_ind_t) arg;
-
-	/* 1. Get callback for synchronous procedure
-	 * for semaphore post */
-	if (!ctrl_rx_func) {
-		printf("ERROR: NULL rx async cb for esp_queue,sem\n");
-		return;
-	}
-
-	/* 2. This queue should already be created
+	/* 1. Request table lock should already be created
 	 * if NULL, exit here */
-	if (!ctrl_msg_Q) {
-		printf("Ctrl msg Q is not created\n");
+	if (!ctrl_req_table_lock) {
+		printf("Ctrl req table is not initialized\n");
 		return;
 	}
 
-	/* 3. Infinite loop to process incoming msg on serial interface */
+	/* 2. Infinite loop to process incoming msg on serial interface */
 	while (1) {
 		uint8_t *buf = NULL;
-		CtrlMsg *resp = NULL;
 
-		/* 3.1 Block on read of protobuf encoded msg */
+		/* 3.1 Block on read of protobuf encoded msg
+		 * buf is owned by serial driver and remains valid only till
+		 * next read, so it is not freed here */
 		if (is_ctrl_lib_state(CTRL_LIB_STATE_INACTIVE)) {
 			sleep(1);
 			continue;
@@ -811,28 +1102,12 @@ static void ctrl_rx_thread(void const *arg)
 
 		if (!buf_len || !buf) {
 			printf("%s buf_len read = 0\n",__func__);
-			goto free_bufs;
-		}
-
-		/* 3.2 Decode protobuf */
-		resp = ctrl_msg__unpack(NULL, buf_len, buf);
-		if (!resp) {
-			goto free_bufs;
+			continue;
 		}
-		/* 3.3 Free the read buffer */
-		mem_free(buf);
-
-		/* 3.4 Send for further processing as event or response */
-		process_ctrl_rx_msg(resp, ctrl_rx_func);
-		continue;
 
-		/* 4. cleanup */
-free_bufs:
-		mem_free(buf);
-		if (resp) {
-			ctrl_msg__free_unpacked(resp, NULL);
-			resp = NULL;
-		}
+		/* 3.2 Decode protobuf, into arena, and
+		 * send for further processing as event or response */
+		decode_ctrl_rx_msg(buf, buf_len);
 	}
 }
 
@@ -840,7 +1115,7 @@ free_bufs:
 /* create new thread for control RX path handling */
 static int spawn_ctrl_rx_thread(void)
 {
-	ctrl_rx_thread_handle = hosted_thread_create(ctrl_rx_thread, ctrl_rx_ind);
+	ctrl_rx_thread_handle = hosted_thread_create(ctrl_rx_thread, NULL);
 	if (!ctrl_rx_thread_handle) {
 		printf("Thread creation failed for ctrl_rx_thread\n");
 		return FAILURE;
@@ -857,85 +1132,12 @@ static int cancel_ctrl_rx_thread(void)
 		return FAILURE;
 	}
 
+	ctrl_rx_thread_handle = NULL;
 	return SUCCESS;
 }
 
 
 
-/* This function will be only invoked in synchrounous control response path,
- * i.e. if control response callbcak is not available i.e. NULL
- * This function is called after sending synchrounous control request to wait
- * for the response using semaphores and esp_queue
- **/
-static ctrl_cmd_t * get_response(int *read_len, int timeout_sec)
-{
-	void * data = NULL;
-	uint8_t * buf = NULL;
-	esp_queue_elem_t *elem = NULL;
-	int ret = 0;
-
-	/* 1. Any problems in response, return NULL */
-	if (!read_len) {
-		printf("Invalid input parameter\n");
-		return NULL;
-	}
-
-	/* 2. If timeout not specified, use default */
-	if (!timeout_sec)
-		timeout_sec = DEFAULT_CTRL_RESP_TIMEOUT;
-
-	/* 3. Wait for response */
-	ret = hosted_get_semaphore(read_sem, timeout_sec);
-	if (ret) {
-		if (errno == ETIMEDOUT)
-			printf("Control response timed out after %u sec\n", timeout_sec);
-		else
-			printf("ctrl lib error[%u] in sem of timeout[%u]\n", errno, timeout_sec);
-		/* Unlock semaphore in negative case */
-		hosted_post_semaphore(ctrl_req_sem);
-		return NULL;
-	}
-
-	/* 4. Fetch response from `esp_queue` */
-	data = esp_queue_get(ctrl_msg_Q);
-	if (data) {
-		elem = (esp_queue_elem_t*)data;
-		if (!elem)
-			return NULL;
-
-		*read_len = elem->buf_len;
-		buf = elem->buf;
-		mem_free(elem);
-		/* Free queue element and return the rx data */
-		return (ctrl_cmd_t*)buf;
-
-	} else {
-		printf("Ctrl Q empty or uninitialised\n");
-		return NULL;
-	}
-
-	return NULL;
-}
-
-/* Check and call control response asynchronous callback if available
- * else flag error
- *     MSG_ID_OUT_OF_ORDER - if response id is not understandable
- *     CALLBACK_NOT_REGISTERED - callback is not registered
- **/
-static int call_async_resp_callback(ctrl_cmd_t *app_resp)
-{
-	if ((app_resp->msg_id <= CTRL_RESP_BASE) ||
-	    (app_resp->msg_id >= CTRL_RESP_MAX)) {
-		return MSG_ID_OUT_OF_ORDER;
-	}
-
-	if (ctrl_resp_cb_table[app_resp->msg_id-CTRL_RESP_BASE]) {
-		return ctrl_resp_cb_table[app_resp->msg_id-CTRL_RESP_BASE](app_resp);
-	}
-
-	return CALLBACK_NOT_REGISTERED;
-}
-
 /* Check and call control event asynchronous callback if available
  * else flag error
  *     MSG_ID_OUT_OF_ORDER - if event id is not understandable
@@ -955,45 +1157,6 @@ static int call_event_callback(ctrl_cmd_t *app_event)
 	return CALLBACK_NOT_REGISTERED;
 }
 
-/* Set asynchronous control response callback from control **request**
- * In case of synchronous request, `resp_cb` will be NULL and table
- * `ctrl_resp_cb_table` will be updated with NULL
- * In case of asynchronous request, valid callback will be cached
- **/
-static int set_async_resp_callback(int req_msg_id, ctrl_resp_cb_t resp_cb)
-{
-	/* Assign(Replace) response callback passed */
-	int exp_resp_msg_id = (req_msg_id - CTRL_REQ_BASE + CTRL_RESP_BASE);
-	if (exp_resp_msg_id >= CTRL_RESP_MAX) {
-		printf("Not able to map new request to resp id\n");
-		return MSG_ID_OUT_OF_ORDER;
-	} else {
-		ctrl_resp_cb_table[exp_resp_msg_id-CTRL_RESP_BASE] = resp_cb;
-		return CALLBACK_SET_SUCCESS;
-	}
-}
-
-/* Set asynchronous control response callback from control **response**
- * In case of synchronous request, `resp_cb` will be NULL and table
- * `ctrl_resp_cb_table` will be updated with NULL
- * In case of asynchronous request, valid callback will be cached
- **/
-static int is_async_resp_callback_registered_by_resp_msg_id(int resp_msg_id)
-{
-	if ((resp_msg_id <= CTRL_RESP_BASE) || (resp_msg_id >= CTRL_RESP_MAX)) {
-		printf("resp id[%u] out of range\n", resp_msg_id);
-		return MSG_ID_OUT_OF_ORDER;
-	}
-
-	if (ctrl_resp_cb_table[resp_msg_id-CTRL_RESP_BASE]) {
-		return CALLBACK_AVAILABLE;
-	}
-
-	return CALLBACK_NOT_REGISTERED;
-}
-
-
-
 /* Check if async control response callback is available
  * Returns CALLBACK_AVAILABLE if a non NULL asynchrounous control response
  * callback is available. It will return failure -
@@ -1008,7 +1171,7 @@ int is_async_resp_callback_registered(ctrl_cmd_t req)
 		return MSG_ID_OUT_OF_ORDER;
 	}
 
-	if (ctrl_resp_cb_table[exp_resp_msg_id-CTRL_RESP_BASE]) {
+	if (req.ctrl_resp_cb) {
 		return CALLBACK_AVAILABLE;
 	}
 
@@ -1043,59 +1206,101 @@ int reset_event_callback(int event)
 /* This is only used in synchrounous control path
  * When request is sent without async callback, this function will be called
  * It will wait for control response or timeout for control response
+ * Other requests may be outstanding meanwhile, response is matched by uid
  **/
 ctrl_cmd_t * ctrl_wait_and_parse_sync_resp(ctrl_cmd_t *app_req)
 {
-	ctrl_cmd_t * rx_buf = NULL;
-	int rx_buf_len = 0;
+	ctrl_req_slot_t *slot = NULL;
+	ctrl_cmd_t *app_resp = NULL;
+	int timeout_sec = 0;
+	int ret = 0;
+	int wait_errno = 0;
+
+	lock_req_table();
+	slot = find_req_slot(app_req->uid);
+	unlock_req_table();
+
+	if (!slot || slot->resp_cb) {
+		printf("No sync request found for uid[%u]\n", app_req->uid);
+		return NULL;
+	}
+
+	/* If timeout not specified, use default */
+	timeout_sec = app_req->cmd_timeout_sec;
+	if (!timeout_sec)
+		timeout_sec = DEFAULT_CTRL_RESP_TIMEOUT;
 
-	rx_buf = get_response(&rx_buf_len, app_req->cmd_timeout_sec);
-	if (!rx_buf || !rx_buf_len) {
+	/* Only this thread frees the slot, so it is safe to wait on it */
+	ret = hosted_get_semaphore(slot->resp_sem, timeout_sec);
+	wait_errno = errno;
+
+	lock_req_table();
+	app_resp = slot->resp;
+	if (ret && app_resp) {
+		/* Response raced with timeout, consume its post */
+		hosted_get_semaphore(slot->resp_sem, 0);
+	}
+	free_req_slot(slot);
+	unlock_req_table();
+	hosted_post_semaphore(ctrl_req_sem);
+
+	if (!app_resp) {
+		if (wait_errno == ETIMEDOUT)
+			printf("Control response timed out after %u sec\n", timeout_sec);
+		else
+			printf("ctrl lib error[%u] in sem of timeout[%u]\n", wait_errno, timeout_sec);
 		printf("Response not received\n");
-		if (rx_buf) {
-			mem_free(rx_buf);
-		}
 	}
-	return rx_buf;
+
+	return app_resp;
 }
 
 
 /* This function is called for async procedure
- * Timer started when async control req is received
+ * Timer started when async control req is sent
  * But there was no response in due time, this function will
  * be called to send error to application
+ * Timer argument is uid of the request
  * */
 static void ctrl_async_timeout_handler(void const *arg)
 {
-	ctrl_resp_cb_t func = arg;
-	if (!func) {
-		printf("NULL func, failed to call callback\n");
+	uint32_t uid = (uint32_t)(uintptr_t)arg;
+	ctrl_req_slot_t *slot = NULL;
+	ctrl_resp_cb_t func = NULL;
+	ctrl_cmd_t *app_resp = NULL;
+	void *timer_handle = NULL;
+	uint16_t resp_msg_id = 0;
+
+	/* Response may have arrived meanwhile */
+	lock_req_table();
+	slot = find_req_slot(uid);
+	if (!slot || !slot->resp_cb) {
+		unlock_req_table();
+		return;
 	}
-	else {
-		ctrl_cmd_t *app_resp = NULL;
-		app_resp = (ctrl_cmd_t *)hosted_calloc(1, sizeof(ctrl_cmd_t));
-		if (!app_resp) {
-			printf("Failed to allocate app_resp\n");
-			return;
-		}
-		app_resp->msg_type = CTRL_RESP;
-		app_resp->resp_event_status = CTRL_ERR_REQUEST_TIMEOUT;
-
-		/* call func pointer to notify failure */
-		func(app_resp);
-
-		/* only one async timer at a time is handled
-		 * therefore, only one wifi request can be sent at a time
-		 */
-		if (async_timer_handle) {
-			/* async_timer_handle will be cleaned in hosted_timer_stop */
-			hosted_timer_stop(async_timer_handle);
-			async_timer_handle = NULL;
-		}
+	func = slot->resp_cb;
+	timer_handle = slot->timer_handle;
+	resp_msg_id = slot->resp_msg_id;
+	free_req_slot(slot);
+	unlock_req_table();
+	hosted_post_semaphore(ctrl_req_sem);
 
-		/* Unlock semaphore in negative case */
-		hosted_post_semaphore(ctrl_req_sem);
+	/* timer_handle will be cleaned in hosted_timer_stop */
+	if (timer_handle)
+		hosted_timer_stop(timer_handle);
+
+	app_resp = alloc_ctrl_msg();
+	if (!app_resp) {
+		printf("Failed to allocate app_resp\n");
+		return;
 	}
+	app_resp->msg_type = CTRL_RESP;
+	app_resp->msg_id = resp_msg_id;
+	app_resp->uid = uid;
+	app_resp->resp_event_status = CTRL_ERR_REQUEST_TIMEOUT;
+
+	/* call func pointer to notify failure */
+	func(app_resp);
 }
 
 /* This is entry level function when control request APIs are used
@@ -1112,6 +1317,8 @@ int ctrl_app_send_req(ctrl_cmd_t *app_req)
 	uint8_t  *buff_to_free1 = NULL;
 	void     *buff_to_free2 = NULL;
 	uint8_t   failure_status = 0;
+	ctrl_req_slot_t *slot = NULL;
+	void     *timer_handle = NULL;
 
 
 
@@ -1120,11 +1327,19 @@ int ctrl_app_send_req(ctrl_cmd_t *app_req)
 		goto fail_req;
 	}
 
+	/* In event loop mode, nothing would receive response while
+	 * the caller blocks for it */
+	if (ctrl_lib_ctxt.poll_mode && !app_req->ctrl_resp_cb) {
+		printf("Only async requests are allowed in event loop mode\n");
+		failure_status = CTRL_ERR_INCORRECT_ARG;
+		goto fail_req;
+	}
 
-	/* 1. Check if any ongoing request present
-	 * Send failure in that case */
-	ret = hosted_get_semaphore(ctrl_req_sem, WAIT_TIME_B2B_CTRL_REQ);
-	if (ret) {
+
+	/* 1. Reserve slot for request, to be matched with response
+	 * Send failure if too many requests are already outstanding */
+	slot = alloc_req_slot(app_req);
+	if (!slot) {
 		failure_status = CTRL_ERR_REQ_IN_PROG;
 		goto fail_req;
 	}
@@ -1135,6 +1350,7 @@ int ctrl_app_send_req(ctrl_cmd_t *app_req)
 	ctrl_msg__init(&req);
 
 	req.msg_id = app_req->msg_id;
+	req.uid = app_req->uid;
 	/* payload case is exact match to msg id in esp_hosted_config.pb-c.h */
 	req.payload_case = (CtrlMsg__PayloadCase) app_req->msg_id;
 
@@ -1147,14 +1363,31 @@ int ctrl_app_send_req(ctrl_cmd_t *app_req)
 		case CTRL_REQ_GET_SOFTAP_CONN_STA_LIST:
 		case CTRL_REQ_STOP_SOFTAP:
 		case CTRL_REQ_GET_PS_MODE:
-		case CTRL_REQ_OTA_BEGIN:
 		case CTRL_REQ_OTA_END:
 		case CTRL_REQ_GET_WIFI_CURR_TX_POWER: {
 			/* Intentional fallthrough & empty */
 			break;
+		} case CTRL_REQ_OTA_BEGIN: {
+			ota_begin_t *p = &app_req->u.ota_begin;
+
+			/* Left empty for plain image, as expected by older ESP */
+			if (p->compressed || p->image_id) {
+				CTRL_ALLOC_ASSIGN(CtrlMsgReqOTABegin, req_ota_begin);
+				ctrl_msg__req__otabegin__init(req_payload);
+				req_payload->compressed = p->compressed;
+				req_payload->image_id = p->image_id;
+				req_payload->image_size = p->image_size;
+			}
+			break;
 		} case CTRL_REQ_GET_AP_SCAN_LIST: {
-			if (app_req->cmd_timeout_sec < DEFAULT_CTRL_RESP_AP_SCAN_TIMEOUT)
+			if (app_req->u.wifi_ap_scan.stream) {
+				/* Responded as soon as scan starts */
+				CTRL_ALLOC_ASSIGN(CtrlMsgReqScanResult, req_scan_ap_list);
+				ctrl_msg__req__scan_result__init(req_payload);
+				req_payload->stream = true;
+			} else if (app_req->cmd_timeout_sec < DEFAULT_CTRL_RESP_AP_SCAN_TIMEOUT) {
 				app_req->cmd_timeout_sec = DEFAULT_CTRL_RESP_AP_SCAN_TIMEOUT;
+			}
 			break;
 		} case CTRL_REQ_GET_MAC_ADDR: {
 			CTRL_ALLOC_ASSIGN(CtrlMsgReqGetMacAddress, req_get_mac_address);
@@ -1362,6 +1595,7 @@ int ctrl_app_send_req(ctrl_cmd_t *app_req)
 			ctrl_msg__req__otawrite__init(req_payload);
 			req_payload->ota_data.data = p->ota_data;
 			req_payload->ota_data.len = p->ota_data_len;
+			req_payload->offset = p->offset;
 			break;
 		} case CTRL_REQ_SET_WIFI_MAX_TX_POWER: {
 			CTRL_ALLOC_ASSIGN(CtrlMsgReqSetWifiMaxTxPower,
@@ -1398,41 +1632,51 @@ int ctrl_app_send_req(ctrl_cmd_t *app_req)
 		goto fail_req;
 	}
 
-	/* 5. Allocate protobuf msg */
-	tx_data = (uint8_t *)hosted_calloc(1, tx_len);
+	/* 5. Allocate protobuf msg
+	 * Room for TLV header is kept ahead, so that msg is packed only once
+	 * and sent from same buffer without copy */
+	tx_data = (uint8_t *)hosted_malloc(SERIAL_TLV_HEADER_LEN + tx_len);
 	if (!tx_data) {
 		command_log("Failed to allocate memory for tx_data\n");
 		failure_status = CTRL_ERR_MEMORY_FAILURE;
 		goto fail_req;
 	}
 
-	/* 6. Assign response callback
-	 * a. If the response callback is not set, this will reset the
-	 *    callback to NULL.
-	 * b. If the non NULL response is assigned, this will set the
-	 *    callback to user defined callback function */
-	ret = set_async_resp_callback(app_req->msg_id, app_req->ctrl_resp_cb);
-	if (ret < 0) {
-		printf("could not set callback for req[%u]\n",req.msg_id);
-		failure_status = CTRL_ERR_SET_ASYNC_CB;
-		goto fail_req;
-	}
+	/* 6. Response callback, if any, is already saved in request slot */
 
 	/* 7. Start timeout for response for async only
 	 * For sync procedures, hosted_get_semaphore takes care to
-	 * handle timeout situations */
-	if (app_req->ctrl_resp_cb) {
-		async_timer_handle = hosted_timer_start(app_req->cmd_timeout_sec, CTRL__TIMER_ONESHOT,
-				ctrl_async_timeout_handler, app_req->ctrl_resp_cb);
-		if (!async_timer_handle) {
+	 * handle timeout situations
+	 * In event loop mode, ctrl_process_pending() checks the deadline */
+	if (app_req->ctrl_resp_cb && ctrl_lib_ctxt.poll_mode) {
+		int timeout_sec = app_req->cmd_timeout_sec;
+
+		if (!timeout_sec)
+			timeout_sec = DEFAULT_CTRL_RESP_TIMEOUT;
+		lock_req_table();
+		slot->deadline_ms = hosted_get_time_ms() + (uint64_t)timeout_sec * 1000;
+		unlock_req_table();
+	} else if (app_req->ctrl_resp_cb) {
+		timer_handle = hosted_timer_start(app_req->cmd_timeout_sec, CTRL__TIMER_ONESHOT,
+				ctrl_async_timeout_handler, (void *)(uintptr_t)app_req->uid);
+		if (!timer_handle) {
 			printf("Failed to start async resp timer\n");
 			goto fail_req;
 		}
-	}
-
-	/* 8. Pack in protobuf and send the request */
-	ctrl_msg__pack(&req, tx_data);
-	if (transport_pserial_send(tx_data, tx_len)) {
+		lock_req_table();
+		slot->timer_handle = timer_handle;
+		unlock_req_table();
+	}
+
+	/* 8. Pack in protobuf and send the request
+	 * Requests from different threads must not interleave on serial */
+	ctrl_msg__pack(&req, tx_data + SERIAL_TLV_HEADER_LEN);
+	hosted_get_semaphore(ctrl_tx_lock, HOSTED_SEM_BLOCKING);
+	ret = transport_pserial_send_buf(tx_data, tx_len);
+	hosted_post_semaphore(ctrl_tx_lock);
+	/* tx_data is freed by transport */
+	tx_data = NULL;
+	if (ret) {
 		command_log("Send control req[%u] failed\n",req.msg_id);
 		failure_status = CTRL_ERR_TRANSPORT_SEND;
 		goto fail_req;
@@ -1455,21 +1699,39 @@ int ctrl_app_send_req(ctrl_cmd_t *app_req)
 
 fail_req:
 
+	/* Request is not going out, release its slot */
+	if (slot) {
+		lock_req_table();
+		if (slot->uid != app_req->uid) {
+			/* Timeout handler already took the slot and
+			 * notified application */
+			unlock_req_table();
+			goto fail_req2;
+		}
+		timer_handle = slot->timer_handle;
+		free_req_slot(slot);
+		unlock_req_table();
+		hosted_post_semaphore(ctrl_req_sem);
+
+		if (timer_handle)
+			hosted_timer_stop(timer_handle);
+	}
 
 	if (app_req->ctrl_resp_cb) {
 		/* 11. In case of async procedure,
 		 * Let application know of failure using callback itself
 		 **/
 		ctrl_cmd_t *app_resp = NULL;
-		app_resp = (ctrl_cmd_t *)hosted_malloc(sizeof(ctrl_cmd_t));
+		app_resp = alloc_ctrl_msg();
 		if (!app_resp) {
 			printf("Failed to allocate app_resp\n");
 			goto fail_req2;
 		}
-		memset(app_resp, 0, sizeof(ctrl_cmd_t));
 		app_resp->msg_type = CTRL_RESP;
 		app_resp->msg_id = (app_req->msg_id - CTRL_REQ_BASE + CTRL_RESP_BASE);
 		app_resp->resp_event_status = failure_status;
+		/* 0 if request failed before it got uid */
+		app_resp->uid = app_req->uid;
 
 		/* 12. In async procedure, it is important to get
 		 * some kind of acknowledgement to user */
@@ -1490,32 +1752,125 @@ fail_req2:
 	return FAILURE;
 }
 
+/* Event loop mode: fail async requests whose response is overdue
+ * Same as timer expiry in threaded mode */
+static void expire_overdue_ctrl_reqs(void)
+{
+	uint64_t now = hosted_get_time_ms();
+	uint32_t uid = 0;
+	int i = 0;
+
+	for (i = 0; i < CTRL_MAX_OUTSTANDING_REQ; i++) {
+		lock_req_table();
+		uid = ctrl_req_table[i].uid;
+		if (!ctrl_req_table[i].deadline_ms ||
+		    (now < ctrl_req_table[i].deadline_ms))
+			uid = 0;
+		unlock_req_table();
+
+		if (uid)
+			ctrl_async_timeout_handler((void *)(uintptr_t)uid);
+	}
+}
+
+int get_ctrl_poll_fd(void)
+{
+	if (!ctrl_lib_ctxt.poll_mode)
+		return FAILURE;
+
+	return ctrl_lib_ctxt.poll_fd;
+}
+
+int get_ctrl_poll_timeout_ms(void)
+{
+	uint64_t now = 0, next = 0;
+	int i = 0;
+
+	if (!ctrl_lib_ctxt.poll_mode)
+		return -1;
+
+	lock_req_table();
+	for (i = 0; i < CTRL_MAX_OUTSTANDING_REQ; i++) {
+		uint64_t deadline = ctrl_req_table[i].deadline_ms;
+
+		if (ctrl_req_table[i].uid && deadline && (!next || (deadline < next)))
+			next = deadline;
+	}
+	unlock_req_table();
+
+	if (!next)
+		return -1;
+
+	now = hosted_get_time_ms();
+	return (next > now) ? (int)(next - now) : 0;
+}
+
+int ctrl_process_pending(void)
+{
+	uint8_t *buf = NULL;
+	uint32_t buf_len = 0;
+	int count = 0;
+
+	if (!ctrl_lib_ctxt.poll_mode ||
+	    !is_ctrl_lib_state(CTRL_LIB_STATE_READY)) {
+		printf("Control lib not initialized in event loop mode\n");
+		return FAILURE;
+	}
+
+	/* Handle every complete frame already received, without blocking
+	 * buf is owned by serial driver, valid till next read */
+	while ((buf = transport_pserial_read(&buf_len)) && buf_len) {
+		decode_ctrl_rx_msg(buf, buf_len);
+		count++;
+	}
+
+	expire_overdue_ctrl_reqs();
+
+	return count;
+}
+
 /* De-init hosted control lib */
 int deinit_hosted_control_lib_internal(void)
 {
 	int ret = SUCCESS;
+	int i = 0;
 
 	set_ctrl_lib_state(CTRL_LIB_STATE_INACTIVE);
 
-	if (ctrl_msg_Q) {
-		esp_queue_destroy(&ctrl_msg_Q);
+	for (i = 0; i < CTRL_MAX_OUTSTANDING_REQ; i++) {
+		ctrl_req_slot_t *slot = &ctrl_req_table[i];
+
+		if (slot->timer_handle) {
+			/* timer_handle will be cleaned in hosted_timer_stop */
+			hosted_timer_stop(slot->timer_handle);
+		}
+		CLEANUP_APP_MSG(slot->resp);
+		free_req_slot(slot);
+
+		if (slot->resp_sem && hosted_destroy_semaphore(slot->resp_sem)) {
+			ret = FAILURE;
+			printf("ctrl resp sem deinit failed\n");
+		}
+		slot->resp_sem = NULL;
 	}
 
 	if (ctrl_req_sem && hosted_destroy_semaphore(ctrl_req_sem)) {
 		ret = FAILURE;
 		printf("ctrl req sem deinit failed\n");
 	}
+	ctrl_req_sem = NULL;
 
-	if (read_sem && hosted_destroy_semaphore(read_sem)) {
+	if (ctrl_req_table_lock && hosted_destroy_semaphore(ctrl_req_table_lock)) {
 		ret = FAILURE;
-		printf("read sem deinit failed\n");
+		printf("ctrl req table lock deinit failed\n");
 	}
+	ctrl_req_table_lock = NULL;
 
-	if (async_timer_handle) {
-		/* async_timer_handle will be cleaned in hosted_timer_stop */
-		hosted_timer_stop(async_timer_handle);
-		async_timer_handle = NULL;
+	if (ctrl_tx_lock && hosted_destroy_semaphore(ctrl_tx_lock)) {
+		ret = FAILURE;
+		printf("ctrl tx lock deinit failed\n");
 	}
+	ctrl_tx_lock = NULL;
 
 	if (serial_deinit()) {
 		ret = FAILURE;
@@ -1527,48 +1882,80 @@ int deinit_hosted_control_lib_internal(void)
 		printf("cancel ctrl rx thread failed\n");
 	}
 
+	ctrl_lib_ctxt.poll_mode = false;
+	ctrl_lib_ctxt.poll_fd = -1;
+
 	return ret;
 }
 
-/* Init hosted control lib */
-int init_hosted_control_lib_internal(void)
+/* Init hosted control lib
+ * poll_mode: no rx thread, application drives rx from its event loop */
+static int init_hosted_control_lib_mode(bool poll_mode)
 {
 	int ret = SUCCESS;
-#ifndef MCU_SYS
+	int i = 0;
+#if !defined(MCU_SYS) && !defined(CTRL_LIB_SKIP_ROOT_CHECK)
 	if(getuid()) {
 		printf("Please re-run program with superuser access\n");
 		return FAILURE;
 	}
 #endif
 
+	/* response and event pool init */
+	if (init_ctrl_msg_pool())
+		goto free_bufs;
+
 	/* semaphore init */
-	read_sem = hosted_create_semaphore(1);
 	ctrl_req_sem = hosted_create_semaphore(1);
-	if (!read_sem || !ctrl_req_sem) {
+	ctrl_req_table_lock = hosted_create_semaphore(1);
+	ctrl_tx_lock = hosted_create_semaphore(1);
+	if (!ctrl_req_sem || !ctrl_req_table_lock || !ctrl_tx_lock) {
 		printf("sem init failed, exiting\n");
 		goto free_bufs;
 	}
 
+	/* Get req semaphore for first time, it is posted when
+	 * an outstanding request completes */
+	hosted_get_semaphore(ctrl_req_sem, HOSTED_SEM_BLOCKING);
+
+	ctrl_lib_ctxt.poll_mode = poll_mode;
+
+	/* request table init
+	 * Only sync requests wait on resp_sem, not used in event loop mode */
+	for (i = 0; i < CTRL_MAX_OUTSTANDING_REQ; i++) {
+		ctrl_req_slot_t *slot = &ctrl_req_table[i];
+
+		free_req_slot(slot);
+		if (poll_mode)
+			continue;
+		slot->resp_sem = hosted_create_semaphore(1);
+		if (!slot->resp_sem) {
+			printf("sem init failed, exiting\n");
+			goto free_bufs;
+		}
+		/* Posted once response is received */
+		hosted_get_semaphore(slot->resp_sem, HOSTED_SEM_BLOCKING);
+	}
+
 	/* serial init */
 	if (serial_init()) {
 		printf("Failed to serial_init\n");
 		goto free_bufs;
 	}
 
-	/* queue init */
-	ctrl_msg_Q = create_esp_queue();
-	if (!ctrl_msg_Q) {
-		printf("Failed to create app ctrl msg Q\n");
-		goto free_bufs;
+	if (poll_mode) {
+		/* application waits on fd instead of rx thread blocking on read */
+		ctrl_lib_ctxt.poll_fd = transport_pserial_get_poll_fd();
+		if (ctrl_lib_ctxt.poll_fd < 0) {
+			printf("Event loop mode not supported\n");
+			goto free_bufs;
+		}
+	} else {
+		/* thread init */
+		if (spawn_ctrl_rx_thread())
+			goto free_bufs;
 	}
 
-	/* Get read semaphore for first time */
-	hosted_get_semaphore(read_sem, HOSTED_SEM_BLOCKING);
-
-	/* thread init */
-	if (spawn_ctrl_rx_thread())
-		goto free_bufs;
-
 	/* state init */
 	set_ctrl_lib_state(CTRL_LIB_STATE_READY);
 
@@ -1580,6 +1967,16 @@ free_bufs:
 
 }
 
+int init_hosted_control_lib_internal(void)
+{
+	return init_hosted_control_lib_mode(false);
+}
+
+int init_hosted_control_lib_poll_mode_internal(void)
+{
+	return init_hosted_control_lib_mode(true);
+}
+
 
 
 #ifndef MCU_SYS
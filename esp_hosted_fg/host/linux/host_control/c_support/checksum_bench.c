@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Espressif Systems Wireless LAN device driver
+ *
+ * Copyright (C) 2015-2024 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+
+/* Equivalence check and micro benchmark of compute_checksum() from adapter.h
+ * against byte-wise reference implementation.
+ *
+ * Usage: ./checksum_bench.out [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "adapter.h"
+
+#define SUCCESS                 0
+#define FAILURE                 -1
+
+#define MAX_BUF_LEN             2048
+#define MAX_ALIGN_OFFSET        8
+#define NUM_RANDOM_CHECKS       200000
+#define DEFAULT_ITERATIONS      200000
+
+static uint8_t buffer[MAX_BUF_LEN + MAX_ALIGN_OFFSET];
+
+/* Reference: checksum as originally defined, one byte at a time */
+static uint16_t compute_checksum_ref(uint8_t *buf, uint16_t len)
+{
+	uint16_t checksum = 0;
+	uint16_t i = 0;
+
+	while(i < len) {
+		checksum += buf[i];
+		i++;
+	}
+
+	return checksum;
+}
+
+static void fill_buffer(uint8_t pattern)
+{
+	size_t i = 0;
+
+	for (i = 0; i < sizeof(buffer); i++) {
+		if (pattern)
+			buffer[i] = pattern;
+		else
+			buffer[i] = rand() & 0xFF;
+	}
+}
+
+static int check_equivalence(void)
+{
+	uint16_t len = 0, offset = 0, exp = 0, got = 0;
+	int i = 0;
+
+	/* All 0xFF stresses lane folding, as every byte is max */
+	fill_buffer(0xFF);
+	for (offset = 0; offset < MAX_ALIGN_OFFSET; offset++) {
+		for (len = 0; len <= MAX_BUF_LEN; len++) {
+			exp = compute_checksum_ref(buffer + offset, len);
+			got = compute_checksum(buffer + offset, len);
+			if (exp != got) {
+				printf("Mismatch: pattern 0xFF offset[%u] len[%u] exp[%u] got[%u]\n",
+						offset, len, exp, got);
+				return FAILURE;
+			}
+		}
+	}
+
+	for (i = 0; i < NUM_RANDOM_CHECKS; i++) {
+		if (!(i % 1000))
+			fill_buffer(0);
+
+		offset = rand() % MAX_ALIGN_OFFSET;
+		len = rand() % (MAX_BUF_LEN + 1);
+
+		exp = compute_checksum_ref(buffer + offset, len);
+		got = compute_checksum(buffer + offset, len);
+		if (exp != got) {
+			printf("Mismatch: offset[%u] len[%u] exp[%u] got[%u]\n",
+					offset, len, exp, got);
+			return FAILURE;
+		}
+	}
+
+	printf("Equivalence: %u exhaustive + %u random checks passed\n",
+			MAX_ALIGN_OFFSET * (MAX_BUF_LEN + 1), NUM_RANDOM_CHECKS);
+	return SUCCESS;
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void benchmark(uint16_t len, uint16_t offset, int iterations)
+{
+	struct timespec start, end;
+	volatile uint16_t sink = 0;
+	double ref_ns = 0, opt_ns = 0;
+	int i = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++)
+		sink += compute_checksum_ref(buffer + offset, len);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ref_ns = elapsed_ns(&start, &end) / iterations;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++)
+		sink += compute_checksum(buffer + offset, len);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	opt_ns = elapsed_ns(&start, &end) / iterations;
+
+	printf("len %4u offset %u: byte-wise %8.1f ns  word-wise %8.1f ns  speedup %5.2fx  (%6.0f MB/s)\n",
+			len, offset, ref_ns, opt_ns, ref_ns / opt_ns, len * 1e3 / opt_ns);
+	(void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = DEFAULT_ITERATIONS;
+	uint16_t lens[] = { 64, 256, 576, 1024, 1500, 1600 };
+	size_t i = 0;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+
+	if (iterations <= 0) {
+		printf("Usage: %s [iterations]\n", argv[0]);
+		return FAILURE;
+	}
+
+	srand(time(NULL));
+
+	if (check_equivalence())
+		return FAILURE;
+
+	fill_buffer(0);
+	for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+		benchmark(lens[i], 0, iterations);
+		benchmark(lens[i], 2, iterations);
+	}
+
+	return SUCCESS;
+}
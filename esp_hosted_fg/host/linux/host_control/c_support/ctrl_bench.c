@@ -0,0 +1,449 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Espressif Systems Wireless LAN device driver
+ *
+ * Copyright (C) 2015-2024 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+
+/* Control path latency benchmark
+ *
+ * Measures round trip latency (p50/p99/p999) and requests/sec of every
+ * control request, through the complete control lib and serial interface
+ * stack. No ESP or driver is needed: a pty stands in for `SERIAL_IF_FILE`
+ * and a firmware stand-in thread answers each request with a valid
+ * response of the expected type, echoing its uid.
+ *
+ * Build with 'make ctrl_bench', which points `SERIAL_IF_FILE` to a symlink
+ * created here to the pty. Root access is not needed.
+ *
+ * Usage: ./ctrl_bench.out [-n iterations] [-w window] [-e] [-d fw_delay_us] [-v]
+ *   -n  requests measured per control request type (default 1000)
+ *   -w  additionally run with up to <window> async requests outstanding
+ *   -e  additionally run async requests from own event loop, using
+ *       control lib event loop mode, with up to <window> (at least 1)
+ *   -d  processing delay added by firmware stand-in per request
+ *   -v  do not suppress control lib logs
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "ctrl_api.h"
+#include "serial_if.h"
+#include "fw_stand_in.h"
+
+#define DEFAULT_ITERATIONS      1000
+#define WARMUP_ITERATIONS       10
+#define BENCH_OTA_CHUNK_SIZE    4000
+#define BENCH_MAC_STR           "aa:bb:cc:dd:ee:ff"
+#define BENCH_VENDOR_IE_ID      0xDD
+
+typedef ctrl_cmd_t * (*ctrl_api_t)(ctrl_cmd_t req);
+
+struct bench_req {
+	int msg_id;
+	const char *name;
+	ctrl_api_t api;
+};
+
+static const struct bench_req bench_reqs[] = {
+	{ CTRL_REQ_GET_MAC_ADDR,             "get_mac_addr",             wifi_get_mac },
+	{ CTRL_REQ_SET_MAC_ADDR,             "set_mac_addr",             wifi_set_mac },
+	{ CTRL_REQ_GET_WIFI_MODE,            "get_wifi_mode",            wifi_get_mode },
+	{ CTRL_REQ_SET_WIFI_MODE,            "set_wifi_mode",            wifi_set_mode },
+	{ CTRL_REQ_GET_AP_SCAN_LIST,         "get_ap_scan_list",         wifi_ap_scan_list },
+	{ CTRL_REQ_GET_AP_CONFIG,            "get_ap_config",            wifi_get_ap_config },
+	{ CTRL_REQ_CONNECT_AP,               "connect_ap",               wifi_connect_ap },
+	{ CTRL_REQ_DISCONNECT_AP,            "disconnect_ap",            wifi_disconnect_ap },
+	{ CTRL_REQ_GET_SOFTAP_CONFIG,        "get_softap_config",        wifi_get_softap_config },
+	{ CTRL_REQ_SET_SOFTAP_VND_IE,        "set_softap_vendor_ie",     wifi_set_vendor_specific_ie },
+	{ CTRL_REQ_START_SOFTAP,             "start_softap",             wifi_start_softap },
+	{ CTRL_REQ_GET_SOFTAP_CONN_STA_LIST, "get_softap_conn_sta_list", wifi_get_softap_connected_station_list },
+	{ CTRL_REQ_STOP_SOFTAP,              "stop_softap",              wifi_stop_softap },
+	{ CTRL_REQ_SET_PS_MODE,              "set_ps_mode",              wifi_set_power_save_mode },
+	{ CTRL_REQ_GET_PS_MODE,              "get_ps_mode",              wifi_get_power_save_mode },
+	{ CTRL_REQ_OTA_BEGIN,                "ota_begin",                ota_begin },
+	{ CTRL_REQ_OTA_WRITE,                "ota_write",                ota_write },
+	{ CTRL_REQ_OTA_END,                  "ota_end",                  ota_end },
+	{ CTRL_REQ_SET_WIFI_MAX_TX_POWER,    "set_wifi_max_tx_power",    wifi_set_max_tx_power },
+	{ CTRL_REQ_GET_WIFI_CURR_TX_POWER,   "get_wifi_curr_tx_power",   wifi_get_curr_tx_power },
+	{ CTRL_REQ_CONFIG_HEARTBEAT,         "config_heartbeat",         config_heartbeat },
+};
+
+static int report_fd = -1;
+static FILE *report;
+
+static uint8_t ota_chunk[BENCH_OTA_CHUNK_SIZE];
+static uint8_t vendor_ie_payload[] = "ctrl_bench";
+
+/* Async completion tracking. Firmware stand-in answers in order,
+ * so responses complete in the order requests were sent */
+static sem_t async_window_sem;
+static sem_t async_done_sem;
+static double *async_send_ts;
+static double *async_lat;
+static volatile int async_done;
+static volatile int async_failed;
+static int async_total;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* ------------- Host side ------------- */
+
+/* Fill in valid arguments, so that request passes control lib checks */
+static void fill_req(ctrl_cmd_t *req, int msg_id)
+{
+	memset(req, 0, sizeof(ctrl_cmd_t));
+	req->msg_type = CTRL_REQ;
+	req->cmd_timeout_sec = DEFAULT_CTRL_RESP_TIMEOUT;
+
+	switch (msg_id) {
+	case CTRL_REQ_GET_MAC_ADDR:
+		req->u.wifi_mac.mode = WIFI_MODE_STA;
+		break;
+	case CTRL_REQ_SET_MAC_ADDR:
+		req->u.wifi_mac.mode = WIFI_MODE_STA;
+		strcpy(req->u.wifi_mac.mac, BENCH_MAC_STR);
+		break;
+	case CTRL_REQ_SET_WIFI_MODE:
+		req->u.wifi_mode.mode = WIFI_MODE_STA;
+		break;
+	case CTRL_REQ_CONNECT_AP:
+		strcpy((char *)req->u.wifi_ap_config.ssid, "ctrl_bench");
+		strcpy((char *)req->u.wifi_ap_config.pwd, "ctrl_bench");
+		break;
+	case CTRL_REQ_SET_SOFTAP_VND_IE:
+		req->u.wifi_softap_vendor_ie.enable = true;
+		req->u.wifi_softap_vendor_ie.type = WIFI_VND_IE_TYPE_BEACON;
+		req->u.wifi_softap_vendor_ie.idx = WIFI_VND_IE_ID_0;
+		req->u.wifi_softap_vendor_ie.vnd_ie.element_id = BENCH_VENDOR_IE_ID;
+		req->u.wifi_softap_vendor_ie.vnd_ie.length = sizeof(vendor_ie_payload) + 4;
+		req->u.wifi_softap_vendor_ie.vnd_ie.payload = vendor_ie_payload;
+		req->u.wifi_softap_vendor_ie.vnd_ie.payload_len = sizeof(vendor_ie_payload);
+		break;
+	case CTRL_REQ_START_SOFTAP:
+		strcpy((char *)req->u.wifi_softap_config.ssid, "ctrl_bench");
+		strcpy((char *)req->u.wifi_softap_config.pwd, "ctrl_bench");
+		req->u.wifi_softap_config.channel = 1;
+		req->u.wifi_softap_config.encryption_mode = WIFI_AUTH_WPA2_PSK;
+		req->u.wifi_softap_config.max_connections = 4;
+		req->u.wifi_softap_config.bandwidth = WIFI_BW_HT20;
+		break;
+	case CTRL_REQ_SET_PS_MODE:
+		req->u.wifi_ps.ps_mode = WIFI_PS_MIN_MODEM;
+		break;
+	case CTRL_REQ_OTA_WRITE:
+		req->u.ota_write.ota_data = ota_chunk;
+		req->u.ota_write.ota_data_len = sizeof(ota_chunk);
+		break;
+	case CTRL_REQ_SET_WIFI_MAX_TX_POWER:
+		req->u.wifi_tx_power.power = 20;
+		break;
+	default:
+		break;
+	}
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank percentile of sorted samples */
+static double percentile(double *sorted, int n, double p)
+{
+	int rank = (int)(p * n + 0.999999);
+
+	if (rank < 1)
+		rank = 1;
+	if (rank > n)
+		rank = n;
+	return sorted[rank - 1];
+}
+
+static void print_row(const char *name, double *lat, int n, int failed, double total_us)
+{
+	qsort(lat, n, sizeof(double), cmp_double);
+
+	fprintf(report, "%-26s %7d %5d %9.1f %9.1f %9.1f %9.1f %10.0f\n",
+			name, n, failed,
+			percentile(lat, n, 0.50), percentile(lat, n, 0.99),
+			percentile(lat, n, 0.999), lat[n - 1],
+			n * 1e6 / total_us);
+	fflush(report);
+}
+
+static void print_header(const char *mode)
+{
+	fprintf(report, "\n%s\n", mode);
+	fprintf(report, "%-26s %7s %5s %9s %9s %9s %9s %10s\n",
+			"request", "n", "fail", "p50(us)", "p99(us)", "p999(us)",
+			"max(us)", "req/s");
+	fflush(report);
+}
+
+static void bench_sync(const struct bench_req *br, int iterations, double *lat)
+{
+	ctrl_cmd_t req, *resp = NULL;
+	double start = 0, t0 = 0;
+	int i = 0, failed = 0;
+
+	for (i = 0; i < WARMUP_ITERATIONS; i++) {
+		fill_req(&req, br->msg_id);
+		free_ctrl_msg(br->api(req));
+	}
+
+	start = now_us();
+	for (i = 0; i < iterations; i++) {
+		fill_req(&req, br->msg_id);
+		t0 = now_us();
+		resp = br->api(req);
+		lat[i] = now_us() - t0;
+		if (!resp || resp->resp_event_status != SUCCESS)
+			failed++;
+		free_ctrl_msg(resp);
+	}
+
+	print_row(br->name, lat, iterations, failed, now_us() - start);
+}
+
+static int async_resp_cb(ctrl_cmd_t *resp)
+{
+	int idx = async_done;
+
+	if (resp->resp_event_status != SUCCESS)
+		async_failed++;
+
+	if (idx < async_total)
+		async_lat[idx] = now_us() - async_send_ts[idx];
+
+	free_ctrl_msg(resp);
+
+	if (++async_done == async_total)
+		sem_post(&async_done_sem);
+	sem_post(&async_window_sem);
+	return SUCCESS;
+}
+
+static void bench_async(const struct bench_req *br, int iterations, int window)
+{
+	ctrl_cmd_t req;
+	double start = 0;
+	int i = 0;
+
+	async_done = 0;
+	async_failed = 0;
+	async_total = iterations;
+	sem_init(&async_window_sem, 0, window);
+	sem_init(&async_done_sem, 0, 0);
+
+	start = now_us();
+	for (i = 0; i < iterations; i++) {
+		sem_wait(&async_window_sem);
+		fill_req(&req, br->msg_id);
+		req.ctrl_resp_cb = async_resp_cb;
+		async_send_ts[i] = now_us();
+		br->api(req);
+	}
+	sem_wait(&async_done_sem);
+
+	print_row(br->name, async_lat, iterations, async_failed, now_us() - start);
+
+	sem_destroy(&async_window_sem);
+	sem_destroy(&async_done_sem);
+}
+
+/* Same as bench_async, but single threaded: requests are sent and
+ * responses are processed from this poll() loop, no control lib thread */
+static int evloop_resp_cb(ctrl_cmd_t *resp)
+{
+	int idx = async_done;
+
+	if (resp->resp_event_status != SUCCESS)
+		async_failed++;
+
+	if (idx < async_total)
+		async_lat[idx] = now_us() - async_send_ts[idx];
+
+	free_ctrl_msg(resp);
+	async_done++;
+	return SUCCESS;
+}
+
+static void bench_evloop(const struct bench_req *br, int iterations, int window)
+{
+	struct pollfd pfd = { .fd = get_ctrl_poll_fd(), .events = POLLIN };
+	ctrl_cmd_t req;
+	double start = 0;
+	int sent = 0;
+
+	async_done = 0;
+	async_failed = 0;
+	async_total = iterations;
+
+	start = now_us();
+	while (async_done < iterations) {
+		while ((sent < iterations) && (sent - async_done < window)) {
+			fill_req(&req, br->msg_id);
+			req.ctrl_resp_cb = evloop_resp_cb;
+			async_send_ts[sent++] = now_us();
+			br->api(req);
+		}
+
+		if (poll(&pfd, 1, get_ctrl_poll_timeout_ms()) < 0 && errno != EINTR)
+			break;
+		ctrl_process_pending();
+	}
+
+	print_row(br->name, async_lat, iterations, async_failed, now_us() - start);
+}
+
+/* Keep control lib logs out of report unless asked for */
+static void quiet_stdout(int verbose)
+{
+	int null_fd = -1;
+
+	report_fd = dup(STDOUT_FILENO);
+	report = fdopen(report_fd, "w");
+
+	if (verbose)
+		return;
+
+	null_fd = open("/dev/null", O_WRONLY);
+	if (null_fd >= 0) {
+		fflush(stdout);
+		dup2(null_fd, STDOUT_FILENO);
+		close(null_fd);
+	}
+}
+
+static void usage(char *argv[])
+{
+	printf("Usage: %s [-n iterations] [-w window] [-e] [-d fw_delay_us] [-v]\n", argv[0]);
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = DEFAULT_ITERATIONS;
+	int window = 0, verbose = 0, evloop = 0, opt = 0, ret = FAILURE;
+	double *lat = NULL;
+	ctrl_msg_pool_stats_t pool_stats;
+	int i = 0;
+
+	while ((opt = getopt(argc, argv, "n:w:ed:vh")) != -1) {
+		switch (opt) {
+		case 'n': iterations = atoi(optarg); break;
+		case 'w': window = atoi(optarg); break;
+		case 'e': evloop = 1; break;
+		case 'd': fw_delay_us = atoi(optarg); break;
+		case 'v': verbose = 1; break;
+		default: usage(argv); return FAILURE;
+		}
+	}
+
+	if (iterations <= 0 || window < 0 || fw_delay_us < 0) {
+		usage(argv);
+		return FAILURE;
+	}
+
+	lat = calloc(iterations, sizeof(double));
+	async_lat = calloc(iterations, sizeof(double));
+	async_send_ts = calloc(iterations, sizeof(double));
+	if (!lat || !async_lat || !async_send_ts) {
+		printf("Failed to allocate memory\n");
+		goto free_bufs;
+	}
+
+	memset(ota_chunk, 0xA5, sizeof(ota_chunk));
+
+	if (fw_start())
+		goto free_bufs;
+
+	quiet_stdout(verbose);
+
+	if (init_hosted_control_lib()) {
+		fprintf(report, "init hosted control lib failed\n");
+		fw_stop();
+		goto free_bufs;
+	}
+
+	fprintf(report, "Serial: %s -> %s, firmware delay %d us\n",
+			SERIAL_IF_FILE, fw_pty_name(), fw_delay_us);
+
+	print_header("Synchronous, one request outstanding");
+	for (i = 0; i < sizeof(bench_reqs)/sizeof(bench_reqs[0]); i++)
+		bench_sync(&bench_reqs[i], iterations, lat);
+
+	if (window) {
+		char mode[64];
+
+		snprintf(mode, sizeof(mode), "Asynchronous, up to %d requests outstanding", window);
+		print_header(mode);
+		for (i = 0; i < sizeof(bench_reqs)/sizeof(bench_reqs[0]); i++)
+			bench_async(&bench_reqs[i], iterations, window);
+	}
+
+	if (evloop) {
+		char mode[64];
+
+		deinit_hosted_control_lib();
+		if (init_hosted_control_lib_poll_mode()) {
+			fprintf(report, "init hosted control lib in event loop mode failed\n");
+			fw_stop();
+			goto free_bufs;
+		}
+
+		snprintf(mode, sizeof(mode), "Event loop, up to %d requests outstanding",
+				window ? window : 1);
+		print_header(mode);
+		for (i = 0; i < sizeof(bench_reqs)/sizeof(bench_reqs[0]); i++)
+			bench_evloop(&bench_reqs[i], iterations, window ? window : 1);
+	}
+
+	if (!get_ctrl_msg_pool_stats(&pool_stats))
+		fprintf(report, "\nCtrl msg pool: capacity %u peak in use %u exhausted %u\n",
+				pool_stats.capacity, pool_stats.peak_in_use, pool_stats.exhausted);
+
+	ret = SUCCESS;
+
+	deinit_hosted_control_lib();
+	fw_stop();
+
+free_bufs:
+	if (report)
+		fclose(report);
+	free(async_send_ts);
+	free(async_lat);
+	free(lat);
+	return ret;
+}
@@ -31,6 +31,7 @@
 #define SET_WIFI_MODE                      "set_wifi_mode"
 
 #define GET_AP_SCAN_LIST                   "get_ap_scan_list"
+#define GET_AP_SCAN_LIST_STREAM            "get_ap_scan_list_stream"
 #define STA_CONNECT                        "sta_connect"
 #define GET_STA_CONFIG                     "get_sta_config"
 #define STA_DISCONNECT                     "sta_disconnect"
@@ -52,6 +53,10 @@
 #define SSID_LENGTH                         32
 #define PWD_LENGTH                          64
 #define CHUNK_SIZE                          4000
+/* OTA writes in flight, up to CTRL_OTA_MAX_WINDOW */
+#define OTA_WINDOW                          4
+/* Times interrupted OTA is resumed from ESP checkpoint */
+#define OTA_RESUME_RETRIES                  3
 
 /* station mode */
 #define STATION_MODE_MAC_ADDRESS            "aa:bb:cc:dd:ee:ff"
@@ -0,0 +1,408 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Espressif Systems Wireless LAN device driver
+ *
+ * Copyright (C) 2015-2024 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+
+/* Firmware stand-in for host side benchmarks
+ *
+ * A pty stands in for `SERIAL_IF_FILE` and threads, in place of ESP,
+ * answer each control request with a valid response of the expected type,
+ * echoing its uid.
+ *
+ * Like ESP, one thread receives requests and queues them, up to
+ * FW_REQ_Q_MAX, to another which serves them one at a time, in order.
+ * So next request is received while current one is processed.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <pthread.h>
+#include "ctrl_api.h"
+#include "serial_if.h"
+#include "fw_stand_in.h"
+
+#define FW_MAC_STR              "aa:bb:cc:dd:ee:ff"
+#define FW_HDR_LEN              (SIZE_OF_TYPE + SIZE_OF_LENGTH + \
+                                 sizeof(CTRL_EP_NAME_RESP) - 1 + \
+                                 SIZE_OF_TYPE + SIZE_OF_LENGTH)
+/* Same as ESP pserial queue */
+#define FW_REQ_Q_MAX            10
+
+int fw_delay_us;
+int fw_link_kbps;
+fw_req_hook_t fw_req_hook;
+
+static int fw_fd = -1;
+static int fw_slave_fd = -1;
+static pthread_t fw_rx_thread;
+static pthread_t fw_proc_thread;
+
+/* Received requests, yet to be served */
+static struct {
+	struct {
+		uint8_t *buf;
+		uint32_t len;
+	} req[FW_REQ_Q_MAX];
+	int head;
+	int count;
+	int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+} fw_q = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.not_empty = PTHREAD_COND_INITIALIZER,
+	.not_full = PTHREAD_COND_INITIALIZER,
+};
+
+/* Time taken by `len` bytes on simulated link */
+static void fw_link_delay(uint32_t len)
+{
+	if (fw_link_kbps)
+		usleep((uint64_t)len * 1000000 / ((uint64_t)fw_link_kbps * 1024));
+}
+
+static int fw_read_full(uint8_t *buf, int len)
+{
+	int total = 0, count = 0;
+
+	while (total < len) {
+		count = read(fw_fd, buf + total, len - total);
+		if (count <= 0) {
+			if (count < 0 && errno == EINTR)
+				continue;
+			return FAILURE;
+		}
+		total += count;
+	}
+	return SUCCESS;
+}
+
+static int fw_write_full(uint8_t *buf, int len)
+{
+	int total = 0, count = 0;
+
+	while (total < len) {
+		count = write(fw_fd, buf + total, len - total);
+		if (count <= 0) {
+			if (count < 0 && errno == EINTR)
+				continue;
+			return FAILURE;
+		}
+		total += count;
+	}
+	return SUCCESS;
+}
+
+/* Allocate response message with every field populated enough for
+ * control lib to parse it successfully:
+ * bytes carry a MAC string, sub messages are allocated, repeated
+ * messages carry one entry and count fields say so */
+static ProtobufCMessage * fw_alloc_msg(const ProtobufCMessageDescriptor *desc)
+{
+	ProtobufCMessage *msg = calloc(1, desc->sizeof_message);
+	unsigned i = 0;
+
+	if (!msg)
+		return NULL;
+
+	desc->message_init(msg);
+
+	for (i = 0; i < desc->n_fields; i++) {
+		const ProtobufCFieldDescriptor *f = &desc->fields[i];
+		void *member = (uint8_t *)msg + f->offset;
+
+		switch (f->type) {
+		case PROTOBUF_C_TYPE_BYTES:
+			if (f->label != PROTOBUF_C_LABEL_REPEATED) {
+				((ProtobufCBinaryData *)member)->data = (uint8_t *)FW_MAC_STR;
+				((ProtobufCBinaryData *)member)->len = strlen(FW_MAC_STR);
+			}
+			break;
+		case PROTOBUF_C_TYPE_MESSAGE:
+			if (f->label == PROTOBUF_C_LABEL_REPEATED) {
+				ProtobufCMessage **arr = calloc(1, sizeof(*arr));
+
+				if (arr) {
+					arr[0] = fw_alloc_msg(f->descriptor);
+					*(ProtobufCMessage ***)member = arr;
+					*(size_t *)((uint8_t *)msg + f->quantifier_offset) = arr[0] ? 1 : 0;
+				}
+			} else {
+				*(ProtobufCMessage **)member = fw_alloc_msg(f->descriptor);
+			}
+			break;
+		case PROTOBUF_C_TYPE_INT32:
+		case PROTOBUF_C_TYPE_UINT32:
+			if (!strcmp(f->name, "count") || !strcmp(f->name, "num"))
+				*(uint32_t *)member = 1;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return msg;
+}
+
+static void fw_free_msg(ProtobufCMessage *msg)
+{
+	const ProtobufCMessageDescriptor *desc = NULL;
+	unsigned i = 0;
+
+	if (!msg)
+		return;
+
+	desc = msg->descriptor;
+	for (i = 0; i < desc->n_fields; i++) {
+		const ProtobufCFieldDescriptor *f = &desc->fields[i];
+		void *member = (uint8_t *)msg + f->offset;
+
+		if (f->type != PROTOBUF_C_TYPE_MESSAGE)
+			continue;
+
+		if (f->label == PROTOBUF_C_LABEL_REPEATED) {
+			ProtobufCMessage **arr = *(ProtobufCMessage ***)member;
+			size_t n = *(size_t *)((uint8_t *)msg + f->quantifier_offset), j = 0;
+
+			for (j = 0; j < n; j++)
+				fw_free_msg(arr[j]);
+			free(arr);
+		} else {
+			fw_free_msg(*(ProtobufCMessage **)member);
+		}
+	}
+	free(msg);
+}
+
+static int fw_respond(CtrlMsg *req)
+{
+	const ProtobufCFieldDescriptor *f = NULL;
+	ProtobufCMessage *payload = NULL;
+	CtrlMsg resp;
+	uint8_t *data = NULL, *tlv = NULL;
+	size_t data_len = 0;
+	int tlv_len = 0, ret = FAILURE;
+
+	ctrl_msg__init(&resp);
+	resp.msg_type = CTRL_MSG_TYPE__Resp;
+	resp.msg_id = req->msg_id - CTRL_MSG_ID__Req_Base + CTRL_MSG_ID__Resp_Base;
+	resp.uid = req->uid;
+
+	/* Payload field number is same as response msg id */
+	f = protobuf_c_message_descriptor_get_field(&ctrl_msg__descriptor, resp.msg_id);
+	if (!f) {
+		fprintf(stderr, "fw: no response defined for req[%u]\n", req->msg_id);
+		return FAILURE;
+	}
+
+	payload = fw_alloc_msg(f->descriptor);
+	if (!payload)
+		return FAILURE;
+
+	resp.payload_case = (CtrlMsg__PayloadCase) resp.msg_id;
+	*(ProtobufCMessage **)((uint8_t *)&resp + f->offset) = payload;
+
+	if (fw_req_hook)
+		fw_req_hook(req, &resp);
+
+	data_len = ctrl_msg__get_packed_size(&resp);
+	data = malloc(data_len);
+	tlv = malloc(FW_HDR_LEN + data_len);
+	if (!data || !tlv)
+		goto done;
+
+	ctrl_msg__pack(&resp, data);
+	tlv_len = compose_tlv(tlv, data, data_len);
+
+	if (fw_delay_us)
+		usleep(fw_delay_us);
+
+	fw_link_delay(tlv_len);
+	ret = fw_write_full(tlv, tlv_len);
+
+done:
+	free(tlv);
+	free(data);
+	fw_free_msg(payload);
+	return ret;
+}
+
+/* Serves queued requests, one at a time */
+static void * fw_proc_thread_fn(void *arg)
+{
+	uint8_t *buf = NULL;
+	uint32_t len = 0;
+	CtrlMsg *req = NULL;
+
+	while (1) {
+		pthread_mutex_lock(&fw_q.lock);
+		while (!fw_q.count && !fw_q.stop)
+			pthread_cond_wait(&fw_q.not_empty, &fw_q.lock);
+		if (fw_q.stop) {
+			pthread_mutex_unlock(&fw_q.lock);
+			break;
+		}
+		buf = fw_q.req[fw_q.head].buf;
+		len = fw_q.req[fw_q.head].len;
+		fw_q.head = (fw_q.head + 1) % FW_REQ_Q_MAX;
+		fw_q.count--;
+		pthread_cond_signal(&fw_q.not_full);
+		pthread_mutex_unlock(&fw_q.lock);
+
+		req = ctrl_msg__unpack(NULL, len, buf);
+		free(buf);
+		if (!req) {
+			fprintf(stderr, "fw: protobuf decode failed\n");
+			continue;
+		}
+
+		/* Like ESP, rely on msg id alone, host leaves msg_type unset */
+		if ((req->msg_id > CTRL_MSG_ID__Req_Base) &&
+		    (req->msg_id < CTRL_MSG_ID__Req_Max))
+			fw_respond(req);
+
+		ctrl_msg__free_unpacked(req, NULL);
+	}
+
+	return NULL;
+}
+
+/* Receives requests and queues them to be served */
+static void * fw_rx_thread_fn(void *arg)
+{
+	uint8_t hdr[FW_HDR_LEN];
+	uint8_t *buf = NULL;
+	uint32_t len = 0;
+
+	while (1) {
+		if (fw_read_full(hdr, FW_HDR_LEN))
+			break;
+
+		if (parse_tlv(hdr, &len) || !len) {
+			fprintf(stderr, "fw: bad TLV header\n");
+			break;
+		}
+
+		buf = malloc(len);
+		if (!buf || fw_read_full(buf, len)) {
+			free(buf);
+			break;
+		}
+		fw_link_delay(FW_HDR_LEN + len);
+
+		pthread_mutex_lock(&fw_q.lock);
+		while (fw_q.count == FW_REQ_Q_MAX)
+			pthread_cond_wait(&fw_q.not_full, &fw_q.lock);
+		fw_q.req[(fw_q.head + fw_q.count) % FW_REQ_Q_MAX].buf = buf;
+		fw_q.req[(fw_q.head + fw_q.count) % FW_REQ_Q_MAX].len = len;
+		fw_q.count++;
+		pthread_cond_signal(&fw_q.not_empty);
+		pthread_mutex_unlock(&fw_q.lock);
+	}
+
+	return NULL;
+}
+
+int fw_start(void)
+{
+	struct termios tio;
+	char *slave = NULL;
+
+	fw_fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fw_fd < 0 || grantpt(fw_fd) || unlockpt(fw_fd)) {
+		perror("pty");
+		return FAILURE;
+	}
+
+	slave = ptsname(fw_fd);
+	if (!slave) {
+		perror("ptsname");
+		return FAILURE;
+	}
+
+	/* Raw mode, no echo or line discipline processing on binary data.
+	 * Keep slave open, so that pty persists across host open/close */
+	fw_slave_fd = open(slave, O_RDWR | O_NOCTTY);
+	if (fw_slave_fd < 0 || tcgetattr(fw_slave_fd, &tio)) {
+		perror("pty slave");
+		return FAILURE;
+	}
+	cfmakeraw(&tio);
+	if (tcsetattr(fw_slave_fd, TCSANOW, &tio)) {
+		perror("tcsetattr");
+		return FAILURE;
+	}
+
+	unlink(SERIAL_IF_FILE);
+	if (symlink(slave, SERIAL_IF_FILE)) {
+		perror("symlink " SERIAL_IF_FILE);
+		return FAILURE;
+	}
+
+	fw_q.head = 0;
+	fw_q.count = 0;
+	fw_q.stop = 0;
+
+	if (pthread_create(&fw_proc_thread, NULL, fw_proc_thread_fn, NULL)) {
+		perror("pthread_create");
+		return FAILURE;
+	}
+	if (pthread_create(&fw_rx_thread, NULL, fw_rx_thread_fn, NULL)) {
+		perror("pthread_create");
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+void fw_stop(void)
+{
+	/* rx thread is mostly blocked in read(), a cancellation point,
+	 * or waiting for queue, which is never held long */
+	pthread_cancel(fw_rx_thread);
+	pthread_join(fw_rx_thread, NULL);
+
+	pthread_mutex_lock(&fw_q.lock);
+	fw_q.stop = 1;
+	pthread_cond_signal(&fw_q.not_empty);
+	pthread_mutex_unlock(&fw_q.lock);
+	pthread_join(fw_proc_thread, NULL);
+
+	while (fw_q.count) {
+		free(fw_q.req[fw_q.head].buf);
+		fw_q.head = (fw_q.head + 1) % FW_REQ_Q_MAX;
+		fw_q.count--;
+	}
+
+	unlink(SERIAL_IF_FILE);
+	close(fw_slave_fd);
+	close(fw_fd);
+}
+
+const char * fw_pty_name(void)
+{
+	return ptsname(fw_fd);
+}
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Espressif Systems Wireless LAN device driver
+ *
+ * Copyright (C) 2015-2024 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+
+/* Firmware stand-in for host side benchmarks, see fw_stand_in.c */
+
+#ifndef __FW_STAND_IN_H
+#define __FW_STAND_IN_H
+
+#include "esp_hosted_config.pb-c.h"
+
+/* Called for every request, just before its response is packed.
+ * Response payload is already populated and may be altered */
+typedef void (*fw_req_hook_t)(CtrlMsg *req, CtrlMsg *resp);
+
+/* Processing delay added per request */
+extern int fw_delay_us;
+
+/* Simulated link speed in KB/s, each way. 0 for no limit */
+extern int fw_link_kbps;
+
+/* Optional, set before fw_start() */
+extern fw_req_hook_t fw_req_hook;
+
+/* Create pty, make `SERIAL_IF_FILE` point to its slave end
+ * and start serving requests */
+int fw_start(void);
+
+void fw_stop(void);
+
+const char * fw_pty_name(void);
+
+#endif
@@ -0,0 +1,470 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Espressif Systems Wireless LAN device driver
+ *
+ * Copyright (C) 2015-2024 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+
+/* OTA throughput benchmark
+ *
+ * Measures end to end time of ota_update(), OTA begin to OTA end, for
+ * window of 1 (i.e. one write at a time, as done so far) doubling up to
+ * given window. Firmware stand-in, as in ctrl_bench, writes image to
+ * simulated flash and fails OTA end unless flash content is byte
+ * identical to image.
+ *
+ * Gain of window comes from overlapping transfer of next writes with
+ * flash write of current one, so simulate both, e.g. '-l 1000 -k 200'.
+ *
+ * With -z, each window is measured again with image sent as zlib stream,
+ * which firmware stand-in inflates as it arrives, like ESP does with ROM
+ * tinfl. Half of the generated image is random, so that it compresses
+ * about as well as a network adapter image. KB/s is of image as in flash.
+ *
+ * With -r, firmware stand-in resets once per OTA, as given percent of
+ * image is written. OTA is resumed with image_id, from last checkpoint
+ * which firmware stand-in keeps as ESP does in NVS. sent(KB) then shows
+ * how much of image had to be sent again.
+ *
+ * Build with 'make ota_bench'. Root access is not needed.
+ *
+ * Usage: ./ota_bench.out [-s image_kb] [-w window] [-c chunk_size] [-f frag_size]
+ *                        [-d fw_delay_us] [-l link_kbps] [-k flash_kbps] [-z]
+ *                        [-r reset_pct] [-v]
+ *   -s  image size in KB (default 1024)
+ *   -w  largest window measured (default CTRL_OTA_MAX_WINDOW)
+ *   -c  bytes read from image at a time (default frag_size)
+ *   -f  bytes per OTA write (default CTRL_OTA_WRITE_MAX_FRAG_SIZE)
+ *   -d  processing delay added by firmware stand-in per request
+ *   -l  serial link speed simulated by firmware stand-in, KB/s each way
+ *   -k  flash write speed simulated by firmware stand-in, KB/s
+ *   -z  also measure compressed OTA
+ *   -r  reset firmware stand-in once, at given percent of image
+ *   -v  do not suppress control lib logs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+#include "ctrl_api.h"
+#include "serial_if.h"
+#include "fw_stand_in.h"
+
+#define DEFAULT_IMAGE_KB        1024
+#define WARMUP_ITERATIONS       10
+
+/* As ESP checkpoints resumable OTA */
+#define FW_CKPT_INTERVAL        (64*1024)
+#define FW_CKPT_ALIGN           (4096)
+
+static uint8_t *image;
+static uint32_t image_len;
+static uint8_t *image_z;
+static uint32_t image_z_len;
+static int flash_kbps;
+static int reset_pct;
+static FILE *report;
+
+/* Firmware stand-in OTA state, flash is OTA partition */
+static uint8_t *fw_flash;
+static uint32_t fw_ota_offset;
+static int fw_ota_corrupt;
+static int fw_ota_compressed;
+static int fw_ota_stream_end;
+static z_stream fw_strm;
+
+/* Resumable OTA, checkpoint survives firmware stand-in reset like NVS */
+static uint32_t fw_ota_image_id;
+static uint32_t fw_ota_rx_offset;
+static uint32_t fw_ota_reset_at;
+static int fw_ota_write_failed;
+static struct {
+	uint32_t image_id;
+	uint32_t image_size;
+	uint32_t offset;
+} fw_ckpt;
+
+/* Host side image reader */
+struct image_src {
+	const uint8_t *data;
+	uint32_t len;
+	uint32_t offset;
+};
+
+static void fw_flash_write(const uint8_t *data, uint32_t len)
+{
+	if (len > image_len - fw_ota_offset) {
+		fw_ota_corrupt = 1;
+		return;
+	}
+
+	memcpy(fw_flash + fw_ota_offset, data, len);
+	fw_ota_offset += len;
+
+	if (flash_kbps)
+		usleep((uint64_t)len * 1000000 / (flash_kbps * 1024));
+}
+
+/* Inflate into flash in pieces, as ESP does out of its dictionary */
+static void fw_inflate_write(const uint8_t *data, uint32_t len)
+{
+	uint8_t out[CTRL_OTA_WRITE_MAX_FRAG_SIZE];
+	int ret = Z_OK;
+
+	fw_strm.next_in = (uint8_t *)data;
+	fw_strm.avail_in = len;
+
+	do {
+		if (fw_ota_stream_end) {
+			fw_ota_corrupt = 1;
+			return;
+		}
+		fw_strm.next_out = out;
+		fw_strm.avail_out = sizeof(out);
+		ret = inflate(&fw_strm, Z_NO_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+			fw_ota_corrupt = 1;
+			return;
+		}
+		fw_flash_write(out, sizeof(out) - fw_strm.avail_out);
+		if (ret == Z_STREAM_END)
+			fw_ota_stream_end = 1;
+	} while (fw_strm.avail_in || (!fw_strm.avail_out && ret != Z_STREAM_END));
+}
+
+static void fw_ota_begin(CtrlMsgReqOTABegin *r, CtrlMsgRespOTABegin *resp)
+{
+	uint32_t image_id = r ? r->image_id : 0;
+	uint32_t resume_offset = 0;
+
+	if (fw_ota_compressed)
+		inflateEnd(&fw_strm);
+	fw_ota_compressed = r && r->compressed;
+	fw_ota_corrupt = 0;
+	fw_ota_stream_end = 0;
+	fw_ota_write_failed = 0;
+
+	if (image_id && !fw_ota_compressed &&
+	    fw_ckpt.image_id == image_id && fw_ckpt.image_size == r->image_size)
+		resume_offset = fw_ckpt.offset;
+
+	/* Partition is erased from resume offset on */
+	memset(fw_flash + resume_offset, 0xff, image_len - resume_offset);
+	fw_ota_offset = resume_offset;
+	fw_ota_rx_offset = resume_offset;
+	fw_ota_image_id = image_id;
+
+	memset(&fw_ckpt, 0, sizeof(fw_ckpt));
+	if (image_id && !fw_ota_compressed) {
+		fw_ckpt.image_id = image_id;
+		fw_ckpt.image_size = r->image_size;
+		fw_ckpt.offset = resume_offset;
+	}
+	resp->resume_offset = resume_offset;
+
+	if (fw_ota_compressed) {
+		memset(&fw_strm, 0, sizeof(fw_strm));
+		if (inflateInit(&fw_strm) != Z_OK) {
+			fw_ota_compressed = 0;
+			resp->resp = FAILURE;
+		}
+	}
+}
+
+static void fw_ota_write(CtrlMsgReqOTAWrite *r, CtrlMsgRespOTAWrite *resp)
+{
+	ProtobufCBinaryData *d = &r->ota_data;
+
+	resp->checkpoint = fw_ckpt.offset;
+
+	/* Reset loses all but flash and checkpoint */
+	if (fw_ota_reset_at && fw_ota_rx_offset + d->len >= fw_ota_reset_at) {
+		fw_ota_reset_at = 0;
+		fw_ota_write_failed = 1;
+	}
+
+	if (fw_ota_write_failed ||
+	    (fw_ota_image_id && r->offset != fw_ota_rx_offset)) {
+		fw_ota_write_failed = 1;
+		resp->resp = FAILURE;
+		return;
+	}
+
+	if (fw_ota_compressed)
+		fw_inflate_write(d->data, d->len);
+	else
+		fw_flash_write(d->data, d->len);
+	fw_ota_rx_offset += d->len;
+
+	if (fw_ckpt.image_id &&
+	    (fw_ota_rx_offset - fw_ckpt.offset >= FW_CKPT_INTERVAL)) {
+		fw_ckpt.offset = fw_ota_rx_offset & ~(FW_CKPT_ALIGN - 1);
+		resp->checkpoint = fw_ckpt.offset;
+	}
+}
+
+static void fw_ota_hook(CtrlMsg *req, CtrlMsg *resp)
+{
+	switch (req->msg_id) {
+	case CTRL_MSG_ID__Req_OTABegin:
+		fw_ota_begin(req->req_ota_begin, resp->resp_ota_begin);
+		break;
+	case CTRL_MSG_ID__Req_OTAWrite:
+		fw_ota_write(req->req_ota_write, resp->resp_ota_write);
+		break;
+	case CTRL_MSG_ID__Req_OTAEnd:
+		if (fw_ota_corrupt || fw_ota_offset != image_len ||
+		    (fw_ota_compressed && !fw_ota_stream_end) ||
+		    memcmp(fw_flash, image, image_len))
+			resp->resp_ota_end->resp = FAILURE;
+		if (fw_ota_compressed)
+			inflateEnd(&fw_strm);
+		fw_ota_compressed = 0;
+		memset(&fw_ckpt, 0, sizeof(fw_ckpt));
+		break;
+	default:
+		break;
+	}
+}
+
+static int read_image(void *priv, uint8_t *buf, uint32_t len)
+{
+	struct image_src *src = priv;
+
+	if (len > src->len - src->offset)
+		len = src->len - src->offset;
+
+	memcpy(buf, src->data + src->offset, len);
+	src->offset += len;
+	return len;
+}
+
+static int seek_image(void *priv, uint32_t offset)
+{
+	struct image_src *src = priv;
+
+	if (offset > src->len)
+		return FAILURE;
+
+	src->offset = offset;
+	return SUCCESS;
+}
+
+/* Untimed round trips, so that control lib start up, which includes
+ * initial sleep of its rx thread, is not measured as part of window 1,
+ * which speedup of every other row is relative to */
+static void warm_up(void)
+{
+	ctrl_cmd_t req = {0};
+	int i = 0;
+
+	for (i = 0; i < WARMUP_ITERATIONS; i++) {
+		memset(&req, 0, sizeof(ctrl_cmd_t));
+		req.msg_type = CTRL_REQ;
+		req.cmd_timeout_sec = DEFAULT_CTRL_RESP_TIMEOUT;
+		free_ctrl_msg(wifi_get_mode(req));
+	}
+}
+
+static void bench_window(int window, uint32_t chunk_size, uint32_t frag_size,
+		int compressed, double *base_ms)
+{
+	ota_update_config_t config = {0};
+	ota_progress_t progress = {0};
+	struct image_src src = {0};
+	int ret = FAILURE;
+
+	src.data = compressed ? image_z : image;
+	src.len = compressed ? image_z_len : image_len;
+
+	config.read_cb = read_image;
+	config.priv = &src;
+	config.total_bytes = src.len;
+	config.chunk_size = chunk_size;
+	config.frag_size = frag_size;
+	config.window = window;
+	config.compressed = compressed;
+
+	if (reset_pct) {
+		config.image_id = crc32(0, src.data, src.len);
+		config.retries = 1;
+		config.seek_cb = seek_image;
+		fw_ota_reset_at = (uint64_t)src.len * reset_pct / 100;
+	}
+
+	ret = ota_update(&config, &progress);
+
+	if (!*base_ms)
+		*base_ms = progress.elapsed_ms;
+
+	fprintf(report, "%6d %5s %10u %10u %10u %10u %10.1f %8.2fx %s",
+			window, compressed ? "zlib" : "plain",
+			chunk_size ? chunk_size : frag_size, frag_size,
+			progress.bytes_sent / 1024, progress.elapsed_ms,
+			progress.elapsed_ms ?
+			(double)image_len * 1000 / progress.elapsed_ms / 1024 : 0,
+			progress.elapsed_ms ? *base_ms / progress.elapsed_ms : 0,
+			ret ? "FAIL" : "ok");
+	if (reset_pct)
+		fprintf(report, ", resumed at %u KB", progress.resume_offset / 1024);
+	fprintf(report, "\n");
+	fflush(report);
+}
+
+static int compress_image(void)
+{
+	uLongf len = compressBound(image_len);
+
+	image_z = malloc(len);
+	if (!image_z)
+		return FAILURE;
+
+	if (compress2(image_z, &len, image, image_len, Z_BEST_COMPRESSION) != Z_OK)
+		return FAILURE;
+
+	image_z_len = len;
+	return SUCCESS;
+}
+
+/* Keep control lib logs out of report unless asked for */
+static void quiet_stdout(int verbose)
+{
+	int null_fd = -1;
+
+	report = fdopen(dup(STDOUT_FILENO), "w");
+
+	if (verbose)
+		return;
+
+	null_fd = open("/dev/null", O_WRONLY);
+	if (null_fd >= 0) {
+		fflush(stdout);
+		dup2(null_fd, STDOUT_FILENO);
+		close(null_fd);
+	}
+}
+
+static void usage(char *argv[])
+{
+	printf("Usage: %s [-s image_kb] [-w window] [-c chunk_size] [-f frag_size] "
+			"[-d fw_delay_us] [-l link_kbps] [-k flash_kbps] [-z] [-r reset_pct] [-v]\n", argv[0]);
+}
+
+int main(int argc, char *argv[])
+{
+	int image_kb = DEFAULT_IMAGE_KB, max_window = CTRL_OTA_MAX_WINDOW;
+	int chunk_size = 0, frag_size = CTRL_OTA_WRITE_MAX_FRAG_SIZE;
+	int verbose = 0, opt = 0, window = 0, with_zlib = 0;
+	double base_ms = 0;
+	uint32_t i = 0, rand_state = 1;
+
+	while ((opt = getopt(argc, argv, "s:w:c:f:d:l:k:zr:vh")) != -1) {
+		switch (opt) {
+		case 's': image_kb = atoi(optarg); break;
+		case 'w': max_window = atoi(optarg); break;
+		case 'c': chunk_size = atoi(optarg); break;
+		case 'f': frag_size = atoi(optarg); break;
+		case 'd': fw_delay_us = atoi(optarg); break;
+		case 'l': fw_link_kbps = atoi(optarg); break;
+		case 'k': flash_kbps = atoi(optarg); break;
+		case 'z': with_zlib = 1; break;
+		case 'r': reset_pct = atoi(optarg); break;
+		case 'v': verbose = 1; break;
+		default: usage(argv); return FAILURE;
+		}
+	}
+
+	if (image_kb <= 0 || max_window <= 0 || max_window > CTRL_OTA_MAX_WINDOW ||
+	    chunk_size < 0 || frag_size <= 0 ||
+	    frag_size > CTRL_OTA_WRITE_MAX_FRAG_SIZE ||
+	    fw_delay_us < 0 || fw_link_kbps < 0 || flash_kbps < 0 ||
+	    reset_pct < 0 || reset_pct >= 100) {
+		usage(argv);
+		return FAILURE;
+	}
+
+	image_len = image_kb * 1024;
+	image = malloc(image_len);
+	fw_flash = malloc(image_len);
+	if (!image || !fw_flash) {
+		printf("Failed to allocate memory\n");
+		goto free_image;
+	}
+	for (i = 0; i < image_len; i++) {
+		rand_state = rand_state * 1103515245 + 12345;
+		image[i] = (i & 0x100) ? (uint8_t)(rand_state >> 16) :
+			(uint8_t)(i * 31 + (i >> 8));
+	}
+
+	if (with_zlib && compress_image()) {
+		printf("Failed to compress image\n");
+		goto free_image;
+	}
+
+	fw_req_hook = fw_ota_hook;
+	if (fw_start())
+		goto free_image;
+
+	quiet_stdout(verbose);
+
+	if (init_hosted_control_lib()) {
+		fprintf(report, "init hosted control lib failed\n");
+		fw_stop();
+		fclose(report);
+		goto free_image;
+	}
+
+	fprintf(report, "Serial: %s -> %s, image %d KB, firmware delay %d us, "
+			"link %d KB/s, flash %d KB/s\n",
+			SERIAL_IF_FILE, fw_pty_name(), image_kb, fw_delay_us,
+			fw_link_kbps, flash_kbps);
+	if (with_zlib)
+		fprintf(report, "Compressed image %u KB (%.1f%%)\n",
+				image_z_len / 1024, 100.0 * image_z_len / image_len);
+	fprintf(report, "\n%6s %5s %10s %10s %10s %10s %10s %9s %s\n",
+			"window", "mode", "chunk", "frag", "sent(KB)", "time(ms)",
+			"KB/s", "speedup", "image");
+
+	warm_up();
+
+	for (window = 1; ; window *= 2) {
+		if (window > max_window)
+			window = max_window;
+		bench_window(window, chunk_size, frag_size, 0, &base_ms);
+		if (with_zlib)
+			bench_window(window, chunk_size, frag_size, 1, &base_ms);
+		if (window == max_window)
+			break;
+	}
+
+	deinit_hosted_control_lib();
+	fw_stop();
+	fclose(report);
+	free(image_z);
+	free(fw_flash);
+	free(image);
+	return SUCCESS;
+
+free_image:
+	free(image_z);
+	free(fw_flash);
+	free(image);
+	return FAILURE;
+}
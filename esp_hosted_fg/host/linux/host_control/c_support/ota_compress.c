@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Espressif Systems Wireless LAN device driver
+ *
+ * Copyright (C) 2015-2024 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+
+/* Compress ESP firmware image for compressed OTA
+ *
+ * Output is zlib stream (RFC 1950) with 32 KB window, as inflated by ROM
+ * tinfl at ESP. Adler-32 of image at end of stream is checked by ESP
+ * before OTA end is accepted.
+ *
+ * Build with 'make ota_compress'.
+ *
+ * Usage: ./ota_compress.out <network_adapter.bin> <network_adapter.bin.zlib>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#define SUCCESS                 0
+#define FAILURE                 -1
+
+#define OTA_COMPRESS_CHUNK      4096
+
+static int compress_image(FILE *in, FILE *out, uint64_t *in_bytes,
+		uint64_t *out_bytes)
+{
+	uint8_t in_buf[OTA_COMPRESS_CHUNK];
+	uint8_t out_buf[OTA_COMPRESS_CHUNK];
+	z_stream strm = {0};
+	int flush = Z_NO_FLUSH, ret = Z_OK;
+	size_t len = 0;
+
+	/* Window must not exceed 32 KB dictionary of tinfl */
+	if (deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS,
+				9, Z_DEFAULT_STRATEGY) != Z_OK) {
+		printf("Failed to init deflate\n");
+		return FAILURE;
+	}
+
+	do {
+		strm.avail_in = fread(in_buf, 1, sizeof(in_buf), in);
+		if (ferror(in)) {
+			printf("Failed to read image\n");
+			goto fail;
+		}
+		*in_bytes += strm.avail_in;
+		flush = feof(in) ? Z_FINISH : Z_NO_FLUSH;
+		strm.next_in = in_buf;
+
+		do {
+			strm.avail_out = sizeof(out_buf);
+			strm.next_out = out_buf;
+			ret = deflate(&strm, flush);
+			if (ret == Z_STREAM_ERROR) {
+				printf("Failed to compress image\n");
+				goto fail;
+			}
+			len = sizeof(out_buf) - strm.avail_out;
+			if (fwrite(out_buf, 1, len, out) != len) {
+				printf("Failed to write compressed image\n");
+				goto fail;
+			}
+			*out_bytes += len;
+		} while (!strm.avail_out);
+	} while (flush != Z_FINISH);
+
+	deflateEnd(&strm);
+	return (ret == Z_STREAM_END) ? SUCCESS : FAILURE;
+fail:
+	deflateEnd(&strm);
+	return FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *in = NULL, *out = NULL;
+	uint64_t in_bytes = 0, out_bytes = 0;
+	int ret = FAILURE;
+
+	if (argc != 3) {
+		printf("Usage: %s <image> <compressed image>\n", argv[0]);
+		return FAILURE;
+	}
+
+	in = fopen(argv[1], "rb");
+	if (!in) {
+		printf("Failed to open %s\n", argv[1]);
+		return FAILURE;
+	}
+
+	out = fopen(argv[2], "wb");
+	if (!out) {
+		printf("Failed to open %s\n", argv[2]);
+		fclose(in);
+		return FAILURE;
+	}
+
+	ret = compress_image(in, out, &in_bytes, &out_bytes);
+	fclose(in);
+	if (fclose(out))
+		ret = FAILURE;
+
+	if (ret) {
+		remove(argv[2]);
+		return FAILURE;
+	}
+
+	printf("%s: %llu -> %llu bytes (%.1f%%)\n", argv[2],
+			(unsigned long long)in_bytes, (unsigned long long)out_bytes,
+			in_bytes ? 100.0 * out_bytes / in_bytes : 0);
+	return SUCCESS;
+}
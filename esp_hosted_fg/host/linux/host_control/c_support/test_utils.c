@@ -61,7 +61,7 @@
         msg->free_buffer_handle = NULL;                   \
       }                                                   \
     }                                                     \
-    free(msg);                                            \
+    free_ctrl_msg(msg);                                   \
     msg = NULL;                                           \
   }                                                       \
 } while(0);
@@ -124,6 +124,20 @@ static int ctrl_app_event_callback(ctrl_cmd_t * app_event)
 					get_timestamp(ts, MIN_TIMESTAMP_STR_SIZE), p);
 			}
 			break;
+		} case CTRL_EVENT_AP_SCAN_RESULT: {
+			event_ap_scan_result_t *p = &app_event->u.e_ap_scan_result;
+			wifi_scanlist_t *list = p->out_list;
+			int i = 0;
+
+			printf("%s App EVENT: Scan: channel[%d] APs[%d]%s\n",
+				get_timestamp(ts, MIN_TIMESTAMP_STR_SIZE), p->channel,
+				p->count, p->scan_done ? " scan done" : "");
+			for (i=0; list && i<p->count; i++) {
+				printf("%d) ssid \"%s\" bssid \"%s\" rssi \"%d\" channel \"%d\" auth mode \"%d\" \n",\
+						i, list[i].ssid, list[i].bssid, list[i].rssi,
+						list[i].channel, list[i].encryption_mode);
+			}
+			break;
 		} default: {
 			printf("%s Invalid event[%u] to parse\n",
 				get_timestamp(ts, MIN_TIMESTAMP_STR_SIZE), app_event->msg_id);
@@ -415,6 +429,7 @@ int register_event_callbacks(void)
 		{ CTRL_EVENT_HEARTBEAT,                          ctrl_app_event_callback },
 		{ CTRL_EVENT_STATION_DISCONNECT_FROM_AP,         ctrl_app_event_callback },
 		{ CTRL_EVENT_STATION_DISCONNECT_FROM_ESP_SOFTAP, ctrl_app_event_callback },
+		{ CTRL_EVENT_AP_SCAN_RESULT,                     ctrl_app_event_callback },
 	};
 
 	for (evt=0; evt<sizeof(events)/sizeof(event_callback_table_t); evt++) {
@@ -746,6 +761,20 @@ int test_get_available_wifi(void)
 	return ctrl_app_resp_callback(resp);
 }
 
+int test_get_available_wifi_stream(void)
+{
+	/* implemented synchronous
+	 * APs found are printed in CTRL_EVENT_AP_SCAN_RESULT event */
+	ctrl_cmd_t req = CTRL_CMD_DEFAULT_REQ();
+	ctrl_cmd_t *resp = NULL;
+
+	req.u.wifi_ap_scan.stream = true;
+
+	resp = wifi_ap_scan_list(req);
+
+	return ctrl_app_resp_callback(resp);
+}
+
 int test_station_mode_disconnect(void)
 {
 	/* implemented synchronous */
@@ -956,43 +985,111 @@ int test_ota_end(void)
 	return ctrl_app_resp_callback(resp);
 }
 
+static int ota_read_file(void *priv, uint8_t *buf, uint32_t len)
+{
+	FILE *f = (FILE *)priv;
+	size_t read_len = fread(buf, 1, len, f);
+
+	if (!read_len && ferror(f))
+		return FAILURE;
+	return read_len;
+}
+
+static int ota_seek_file(void *priv, uint32_t offset)
+{
+	return fseek((FILE *)priv, offset, SEEK_SET) ? FAILURE : SUCCESS;
+}
+
+/* FNV-1a hash of image, so that ESP resumes OTA only of same image */
+static uint32_t ota_image_id(FILE *f)
+{
+	uint8_t buf[CHUNK_SIZE];
+	uint32_t hash = 2166136261u;
+	size_t len = 0, i = 0;
+
+	while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+		for (i = 0; i < len; i++)
+			hash = (hash ^ buf[i]) * 16777619u;
+
+	rewind(f);
+	return hash ? hash : 1;
+}
+
+/* ESP image starts with 0xE9, whereas zlib stream made by ota_compress
+ * starts with CMF 0x78 (deflate, 32K window) and a valid FLG */
+static bool ota_is_compressed(FILE *f)
+{
+	uint8_t hdr[2] = {0};
+	bool compressed = false;
+
+	if (fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr))
+		compressed = (hdr[0] == 0x78) && !(((hdr[0] << 8) | hdr[1]) % 31);
+
+	rewind(f);
+	return compressed;
+}
+
+static void ota_print_progress(const ota_progress_t *progress, void *priv)
+{
+	printf("\rOTA: %u/%u bytes written, %u KB/s ",
+			progress->bytes_written, progress->total_bytes,
+			progress->bytes_per_sec / 1024);
+	fflush(stdout);
+}
+
 int test_ota(char* image_path)
 {
 	FILE* f = NULL;
-	char ota_chunk[CHUNK_SIZE] = {0};
-	int ret = test_ota_begin();
-	if (ret == SUCCESS) {
-		f = fopen(image_path,"rb");
-		if (f == NULL) {
-			printf("Failed to open file %s \n", image_path);
-			return FAILURE;
-		} else {
-			printf("Success in opening %s file \n", image_path);
-		}
-		while (!feof(f)) {
-			fread(&ota_chunk, CHUNK_SIZE, 1, f);
-			ret = test_ota_write((uint8_t* )&ota_chunk, CHUNK_SIZE);
-			if (ret) {
-				printf("OTA procedure failed!!\n");
-				test_ota_end();
-				goto fail;
-			}
-		}
-		fclose(f);
-		f = NULL;
-		ret = test_ota_end();
-		if (ret) {
-			goto fail;
-		}
-	} else {
+	long image_size = 0;
+	ota_update_config_t config = {0};
+	ota_progress_t progress = {0};
+	int ret = FAILURE;
+
+	f = fopen(image_path,"rb");
+	if (f == NULL) {
+		printf("Failed to open file %s \n", image_path);
 		return FAILURE;
+	} else {
+		printf("Success in opening %s file \n", image_path);
 	}
+
+	if (fseek(f, 0, SEEK_END) || ((image_size = ftell(f)) <= 0) ||
+	    fseek(f, 0, SEEK_SET)) {
+		printf("Failed to get size of %s\n", image_path);
+		goto fail;
+	}
+
+	config.read_cb = ota_read_file;
+	config.priv = f;
+	config.total_bytes = image_size;
+	config.chunk_size = CHUNK_SIZE;
+	config.window = OTA_WINDOW;
+	config.progress_cb = ota_print_progress;
+	config.compressed = ota_is_compressed(f);
+	if (config.compressed)
+		printf("Image is compressed, ESP inflates it\n");
+	config.image_id = ota_image_id(f);
+	config.retries = OTA_RESUME_RETRIES;
+	config.seek_cb = ota_seek_file;
+
+	ret = ota_update(&config, &progress);
+	printf("\n");
+	if (ret) {
+		printf("OTA procedure failed!!\n");
+		if (progress.checkpoint)
+			printf("Same OTA resumes from offset %u\n", progress.checkpoint);
+		goto fail;
+	}
+	if (progress.resume_offset)
+		printf("OTA resumed from offset %u\n", progress.resume_offset);
+	printf("OTA of %u bytes took %u ms, %u KB/s\n", progress.bytes_written,
+			progress.elapsed_ms, progress.bytes_per_sec / 1024);
+
+	fclose(f);
 	printf("ESP32 will restart after 5 sec\n");
 	return SUCCESS;
 fail:
-	if (f) {
-		fclose(f);
-	}
+	fclose(f);
 	return FAILURE;
 }
 
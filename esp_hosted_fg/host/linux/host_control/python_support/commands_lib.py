@@ -58,7 +58,7 @@ def cleanup_ctrl_msg(app_resp):
 			if (app_resp.contents.free_buffer_func):
 				app_resp.contents.free_buffer_func(app_resp.contents.free_buffer_handle)
 				app_resp.contents.free_buffer_handle = None
-		mem_free(app_resp)
+		commands_map_py_to_c.free_ctrl_msg(app_resp)
 		app_resp = None
 
 
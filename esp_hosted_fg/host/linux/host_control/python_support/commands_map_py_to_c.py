@@ -98,6 +98,9 @@ ota_end.restype = POINTER(CONTROL_COMMAND)
 hosted_free = commands_lib.hosted_free
 hosted_free.restype = None
 
+free_ctrl_msg = commands_lib.free_ctrl_msg
+free_ctrl_msg.restype = None
+
 create_socket = commands_lib.create_socket
 create_socket.restype = c_int
 
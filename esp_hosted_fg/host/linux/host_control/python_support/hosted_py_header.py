@@ -253,9 +253,18 @@ class WIFI_SOFTAP_VENDOR_IE(Structure):
 				("vnd_ie", VENDOR_IE_DATA)]
 
 
+class OTA_BEGIN(Structure):
+	_fields_ = [("compressed", c_bool),
+				("image_id", c_uint),
+				("image_size", c_uint),
+				("resume_offset", c_uint)]
+
+
 class OTA_WRITE(Structure):
 	_fields_ = [("ota_data", c_char_p),
-				("ota_data_len", c_uint)]
+				("ota_data_len", c_uint),
+				("offset", c_uint),
+				("checkpoint", c_uint)]
 
 
 class WIFI_TX_POWER(Structure):
@@ -282,6 +291,7 @@ class CONTROL_DATA(Union):
 				("wifi_softap_vendor_ie", WIFI_SOFTAP_VENDOR_IE),
 				("wifi_softap_con_sta", WIFI_CONNECTED_STATIONS_LIST),
 				("wifi_ps", WIFI_POWER_SAVE_MODE),
+				("ota_begin", OTA_BEGIN),
 				("ota_write", OTA_WRITE),
 				("wifi_tx_power", WIFI_TX_POWER),
 				("e_heartbeat", EVENT_HEARTBEAT),
@@ -303,7 +313,8 @@ CONTROL_COMMAND._fields_ = [("msg_type", c_char),
 							("ctrl_resp_cb", CTRL_CB),
 							("cmd_timeout_sec", c_int),
 							("free_buffer_handle", c_void_p),
-							("free_buffer_func", FREE_BUFFFER_FUNC)]
+							("free_buffer_func", FREE_BUFFFER_FUNC),
+							("uid", c_uint)]
 
 
 class EVENT_CALLBACK_TABLE_T(Structure):
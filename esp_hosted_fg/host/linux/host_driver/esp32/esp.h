@@ -31,6 +31,7 @@
 
 #define ESP_IF_TYPE_SDIO        1
 #define ESP_IF_TYPE_SPI         2
+#define ESP_IF_TYPE_LOOPBACK    3
 
 /* Network link status */
 #define ESP_LINK_DOWN           0
@@ -72,6 +73,7 @@ struct esp_adapter {
 	u8                      if_type;
 	enum context_state      state;
 	u32                     capabilities;
+	u8                      checksum_prio_q_mask;
 
 	/* Possible types:
 	 * struct esp_sdio_context */
@@ -85,6 +87,11 @@ struct esp_adapter {
 	struct workqueue_struct *if_rx_workqueue;
 	struct work_struct       if_rx_work;
 
+	/* STA/AP frames are handed to network stack in NAPI context */
+	struct net_device       *napi_dev;
+	struct napi_struct      napi;
+	struct sk_buff_head     rx_napi_q;
+
 	struct sk_buff_head     events_skb_q;
 	struct workqueue_struct *events_wq;
 	struct work_struct      events_work;
@@ -95,10 +102,27 @@ struct esp_adapter {
 };
 
 
+/* Driver counters reported with 'ethtool -S', atomic64_t members only */
+struct esp_drv_stats {
+	/* TX SKBs which could not take payload header in place */
+	atomic64_t              tx_copy_fallback;
+};
+
+/* TX counters of net_device_stats. TX queues run on several CPUs at
+ * once, so these are kept apart and copied into stats as read */
+struct esp_tx_stats {
+	atomic64_t              packets;
+	atomic64_t              bytes;
+	atomic64_t              errors;
+	atomic64_t              dropped;
+};
+
 struct esp_private {
 	struct esp_adapter      *adapter;
 	struct net_device       *ndev;
 	struct net_device_stats stats;
+	struct esp_tx_stats     tx_stats;
+	struct esp_drv_stats    drv_stats;
 	u8                      link_state;
 	u8                      mac_address[6];
 	u8                      if_type;
@@ -107,5 +131,7 @@ struct esp_private {
 
 struct esp_skb_cb {
 	struct esp_private      *priv;
+	/* Set by transport as SKB is queued for TX */
+	ktime_t                 tx_enqueue_time;
 };
 #endif
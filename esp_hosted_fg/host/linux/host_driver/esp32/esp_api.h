@@ -31,10 +31,13 @@ struct sk_buff * esp_alloc_skb(u32 len);
 int esp_send_packet(struct esp_adapter *adapter, struct sk_buff *skb);
 u8 esp_is_bt_supported_over_sdio(u32 cap);
 int esp_is_tx_queue_paused(void);
-void esp_tx_pause(void);
+void esp_tx_pause(struct sk_buff *skb);
 void esp_tx_resume(void);
+void esp_tx_sent(struct sk_buff *skb);
+void esp_tx_completed(struct sk_buff *skb);
 int process_init_event(u8 *evt_buf, u8 len);
-void process_capabilities(u8 cap);
+void process_capabilities(u32 cap);
+u8 esp_is_checksum_enabled(struct esp_adapter *adapter, u8 if_type);
 void process_test_capabilities(u8 cap);
 
 #endif
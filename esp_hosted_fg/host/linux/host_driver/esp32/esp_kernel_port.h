@@ -23,6 +23,7 @@
 
 #include "esp.h"
 #include <linux/version.h>
+#include <linux/slab.h>
 
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0))
     #define ESP_BT_SEND_FRAME_PROTOTYPE() \
@@ -94,6 +95,27 @@ static inline void *skb_put_data(struct sk_buff *skb, const void *data,
         void esp_tx_timeout(struct net_device *ndev, unsigned int txqueue)
 #endif
 
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0))
+    #define NDO_SELECT_QUEUE_PROTOTYPE() \
+        u16 esp_select_queue(struct net_device *ndev, struct sk_buff *skb)
+#elif (LINUX_VERSION_CODE < KERNEL_VERSION(3, 14, 0))
+    #define NDO_SELECT_QUEUE_PROTOTYPE() \
+        u16 esp_select_queue(struct net_device *ndev, struct sk_buff *skb, \
+                void *accel_priv)
+#elif (LINUX_VERSION_CODE < KERNEL_VERSION(4, 19, 0))
+    #define NDO_SELECT_QUEUE_PROTOTYPE() \
+        u16 esp_select_queue(struct net_device *ndev, struct sk_buff *skb, \
+                void *accel_priv, select_queue_fallback_t fallback)
+#elif (LINUX_VERSION_CODE < KERNEL_VERSION(5, 2, 0))
+    #define NDO_SELECT_QUEUE_PROTOTYPE() \
+        u16 esp_select_queue(struct net_device *ndev, struct sk_buff *skb, \
+                struct net_device *sb_dev, select_queue_fallback_t fallback)
+#else
+    #define NDO_SELECT_QUEUE_PROTOTYPE() \
+        u16 esp_select_queue(struct net_device *ndev, struct sk_buff *skb, \
+                struct net_device *sb_dev)
+#endif
+
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(5, 15, 0))
 static inline void eth_hw_addr_set(struct net_device *dev, const u8 *addr)
 {
@@ -109,5 +131,49 @@ static inline void eth_hw_addr_set(struct net_device *dev, const u8 *addr)
 #define do_exit(code)	kthread_complete_and_exit(NULL, code)
 #endif
 
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(6, 1, 0))
+    #define NETIF_NAPI_ADD(dev, napi, poll) \
+        netif_napi_add(dev, napi, poll, NAPI_POLL_WEIGHT)
+#else
+    #define NETIF_NAPI_ADD(dev, napi, poll) \
+        netif_napi_add(dev, napi, poll)
+#endif
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3, 19, 0))
+    #define napi_complete_done(napi, work_done) ({ napi_complete(napi); true; })
+#endif
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3, 14, 0))
+    #define smp_load_acquire(p) \
+        ({ typeof(*(p)) ___v = ACCESS_ONCE(*(p)); smp_mb(); ___v; })
+    #define smp_store_release(p, v) \
+        do { smp_mb(); ACCESS_ONCE(*(p)) = (v); } while (0)
+#endif
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(3, 19, 0))
+    #define READ_ONCE(x) ACCESS_ONCE(x)
+#endif
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 13, 0))
+    #define SPI_CONTROLLER(spi) ((spi)->master)
+#else
+    #define SPI_CONTROLLER(spi) ((spi)->controller)
+#endif
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(6, 10, 0))
+static inline struct net_device *alloc_netdev_dummy(int sizeof_priv)
+{
+	struct net_device *dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+
+	if (dev)
+		init_dummy_netdev(dev);
+
+	return dev;
+}
+    #define free_netdev_dummy(dev) kfree(dev)
+#else
+    #define free_netdev_dummy(dev) free_netdev(dev)
+#endif
+
 
 #endif
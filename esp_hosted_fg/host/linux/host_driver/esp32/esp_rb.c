@@ -11,160 +11,165 @@
 #include <linux/sched.h>
 #include <linux/types.h>
 #include <linux/slab.h>
-#include <linux/semaphore.h>
+#include <linux/log2.h>
 #include <linux/uaccess.h>
 
 #include "esp_rb.h"
+#include "esp_kernel_port.h"
 
 int esp_rb_init(esp_rb_t *rb, size_t sz)
 {
 	esp_dbg("%u\n", __LINE__);
 	init_waitqueue_head(&(rb->wq));
 
+	if (!sz) {
+		esp_err("Invalid rb size\n");
+		return -EINVAL;
+	}
+
+	/* Indices are masked on access */
+	sz = roundup_pow_of_two(sz);
+
 	rb->buf = kmalloc(sz, GFP_KERNEL);
 	if (!rb->buf) {
 		esp_err("Failed to allocate memory for rb\n");
 		return -ENOMEM;
 	}
 
-	rb->end = rb->buf + sz;
-	rb->rp = rb->wp = rb->buf;
 	rb->size = sz;
+	rb->head = rb->tail = 0;
+	rb->overruns = rb->overrun_bytes = 0;
+	rb->max_used = 0;
 
-	sema_init(&(rb->sem), 1);
+	mutex_init(&rb->read_lock);
 	esp_verbose("\n");
 	return 0;
 }
 
+int esp_rb_has_data(esp_rb_t *rb)
+{
+	return smp_load_acquire(&rb->head) != READ_ONCE(rb->tail);
+}
+
 int esp_rb_read_by_user(esp_rb_t *rb, const char __user *buf, size_t sz, int block)
 {
+	size_t head = 0, tail = 0, off = 0;
 	int read_len = 0, temp_len = 0;
 
-	if (down_interruptible(&rb->sem)) {
+	if (mutex_lock_interruptible(&rb->read_lock)) {
 		esp_verbose("%u interrupted by signal\n", __LINE__);
 		return -ERESTARTSYS; /* Signal interruption */
 	}
 
-	while (rb->rp == rb->wp) {
-		up(&rb->sem);
+	tail = rb->tail;
+
+	/* Pairs with smp_store_release() of head by writer:
+	 * data till head is visible once head is */
+	while ((head = smp_load_acquire(&rb->head)) == tail) {
+		mutex_unlock(&rb->read_lock);
 		if (block == 0) {
 			esp_verbose("%u EAGAIN\n", __LINE__);
 			return -EAGAIN;
 		}
-		if (wait_event_interruptible(rb->wq, (rb->rp != rb->wp))) {
+		if (wait_event_interruptible(rb->wq, esp_rb_has_data(rb))) {
 			esp_verbose("%u Interrupted2 by signal\n", __LINE__);
 			return -ERESTARTSYS; /* Signal interruption */
 		}
-		if (down_interruptible(&rb->sem)) {
+		if (mutex_lock_interruptible(&rb->read_lock)) {
 			esp_verbose("%u Interrupted3 by signal\n", __LINE__);
 			return -ERESTARTSYS;
 		}
+		tail = rb->tail;
 	}
 
-	if (rb->wp > rb->rp) {
-		read_len = min(sz, (size_t)(rb->wp - rb->rp));
-	} else {
-		read_len = min(sz, (size_t)(rb->end - rb->rp));
-	}
+	sz = min(sz, head - tail);
+	off = tail & (rb->size - 1);
 
-	if (copy_to_user((void *)buf, rb->rp, read_len)) {
-		up(&rb->sem);
+	read_len = min(sz, rb->size - off);
+	if (copy_to_user((void *)buf, rb->buf + off, read_len)) {
+		mutex_unlock(&rb->read_lock);
 		esp_warn("%d: Incomplete/Failed read\n", __LINE__);
 		return -EFAULT;
 	}
 
-	rb->rp += read_len;
-	if (rb->rp == rb->end) {
-		rb->rp = rb->buf;
-	}
-
-	if (read_len < sz) {
-		temp_len = min(sz-read_len,(size_t)(rb->wp - rb->rp));
-		if (copy_to_user((void *)buf+read_len, rb->rp, temp_len)) {
-			up(&rb->sem);
-			esp_warn("%d: Incomplete/Failed read\n", __LINE__);
-			return -EFAULT;
-		}
+	/* Wrap around */
+	temp_len = sz - read_len;
+	if (temp_len && copy_to_user((void *)buf + read_len, rb->buf, temp_len)) {
+		mutex_unlock(&rb->read_lock);
+		esp_warn("%d: Incomplete/Failed read\n", __LINE__);
+		return -EFAULT;
 	}
-
-	rb->rp += temp_len;
 	read_len += temp_len;
 
-	up(&rb->sem);
+	/* Release the slots only after data is copied out */
+	smp_store_release(&rb->tail, tail + read_len);
+
+	mutex_unlock(&rb->read_lock);
 
 	return read_len;
 }
 
 int get_free_space(esp_rb_t *rb)
 {
-	if (!rb || !rb->rp || !rb->wp) {
+	if (!rb || !rb->buf) {
 		esp_err("%u Err fault\n", __LINE__);
 		return -EFAULT;
 	}
-	if (rb->rp == rb->wp) {
-		return rb->size - 1;
-	} else {
-		return ((rb->rp + rb->size - rb->wp) % rb->size) - 1;
-	}
+
+	return rb->size - (READ_ONCE(rb->head) - READ_ONCE(rb->tail));
 }
 
+/* Writes all of buf or nothing, so that a frame is never cut in half.
+ * Only to be called from single producer context */
 int esp_rb_write_by_kernel(esp_rb_t *rb, const char *buf, size_t sz)
 {
-	int write_len = 0, temp_len = 0;
+	size_t head = 0, tail = 0, used = 0, off = 0;
+	int write_len = 0;
 
-	if (!rb || !rb->wp || !rb->rp) {
+	if (!rb || !rb->buf) {
 		esp_err("%u rb uninitialized\n", __LINE__);
 		return -EFAULT;
 	}
 
-	if (down_interruptible(&rb->sem)) {
-		esp_verbose("%u intr by sig\n", __LINE__);
-		return -ERESTARTSYS;
-	}
-
-	if (get_free_space(rb) <= 0) {
-		up(&rb->sem);
-		esp_err("%d, Ringbuffer full or inaccessible\n", __LINE__);
-		return 0;
-	}
+	head = rb->head;
 
-	sz = min(sz, (size_t)get_free_space(rb));
-	if (rb->wp >= rb->rp) {
-		write_len = min(sz, (size_t)(rb->end - rb->wp));
-	} else {
-		write_len = min(sz, (size_t)(rb->rp - rb->wp - 1));
-	}
+	/* Pairs with smp_store_release() of tail by reader:
+	 * slots before tail are no longer accessed by reader */
+	tail = smp_load_acquire(&rb->tail);
+	used = head - tail;
 
-	memcpy(rb->wp, buf, write_len);
-	rb->wp += write_len;
-	if (rb->wp == rb->end) {
-		rb->wp = rb->buf;
+	if (sz > rb->size - used) {
+		rb->overruns++;
+		rb->overrun_bytes += sz;
+		return 0;
 	}
 
-	if (write_len < sz) {
-		temp_len = (size_t)min(sz-write_len,(size_t)(rb->rp - rb->wp - 1));
-		memcpy(rb->wp, buf+write_len, temp_len);
-	}
+	off = head & (rb->size - 1);
+	write_len = min(sz, rb->size - off);
 
-	rb->wp += temp_len;
-	write_len += temp_len;
+	memcpy(rb->buf + off, buf, write_len);
+	/* Wrap around */
+	memcpy(rb->buf, buf + write_len, sz - write_len);
 
-	if (rb->wp == rb->end) {
-		rb->wp = rb->buf;
-	}
+	/* Publish data before the new head */
+	smp_store_release(&rb->head, head + sz);
 
-	up(&rb->sem);
+	used += sz;
+	if (used > rb->max_used)
+		rb->max_used = used;
 
 	wake_up_interruptible(&rb->wq);
 
-	return write_len;
+	return sz;
 }
 
 void esp_rb_cleanup(esp_rb_t *rb)
 {
 	kfree(rb->buf);
-	rb->buf = rb->end = rb->rp = rb->wp = NULL;
+	rb->buf = NULL;
 	rb->size = 0;
+	rb->head = rb->tail = 0;
+	mutex_destroy(&rb->read_lock);
 	esp_verbose("\n");
 	return;
 }
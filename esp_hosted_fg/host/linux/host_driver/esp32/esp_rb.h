@@ -8,12 +8,27 @@
 #ifndef _ESP_RB_H_
 #define _ESP_RB_H_
 
+#include <linux/wait.h>
+#include <linux/mutex.h>
+
+/* Single producer (kernel rx path), single consumer (user read) ring.
+ *
+ * head is only advanced by producer and tail only by consumer, both
+ * free running and masked on access, so size must be power of two.
+ * Producer and consumer never block each other.
+ */
 typedef struct esp_rb {
 	wait_queue_head_t wq;		/* waitqueue to wait for data */
-	unsigned char *buf, *end;	/* actual queue start and end */
-	size_t size;
-	unsigned char *rp, *wp;		/* current read/write pointers */
-	struct semaphore sem;		/* Mutex to protect rb */
+	unsigned char *buf;		/* actual queue */
+	size_t size;			/* power of two */
+	size_t head;			/* next write position, producer owned */
+	size_t tail;			/* next read position, consumer owned */
+	struct mutex read_lock;		/* serializes readers sharing one fd */
+
+	/* Producer owned counters */
+	u64 overruns;			/* writes dropped as ring was full */
+	u64 overrun_bytes;
+	size_t max_used;		/* high watermark of ring usage */
 } esp_rb_t;
 
 int esp_rb_init(esp_rb_t *rb, size_t sz);
@@ -21,5 +36,6 @@ void esp_rb_cleanup(esp_rb_t *rb);
 int esp_rb_read_by_user(esp_rb_t *rb, const char __user *buf, size_t sz, int block);
 int esp_rb_write_by_kernel(esp_rb_t *rb, const char *buf, size_t sz);
 int get_free_space(esp_rb_t *rb);
+int esp_rb_has_data(esp_rb_t *rb);
 
 #endif
@@ -35,9 +35,13 @@
 
 #define ESP_SERIAL_MAJOR      221
 #define ESP_SERIAL_MINOR_MAX  1
-#define ESP_RX_RB_SIZE        4096
+#define ESP_RX_RB_SIZE        16384
 #define ESP_SERIAL_MAX_TX     4096
 
+static unsigned int serial_rb_size = ESP_RX_RB_SIZE;
+module_param(serial_rb_size, uint, S_IRUGO);
+MODULE_PARM_DESC(serial_rb_size, "Receive ring size in bytes of /dev/esps0, rounded up to power of two");
+
 static struct esp_serial_devs {
 	struct device* dev;
 	struct cdev cdev;
@@ -188,7 +192,7 @@ static unsigned int esp_serial_poll(struct file *file, poll_table *wait)
     mutex_lock(&dev->lock);
     poll_wait(file, &dev->rb.wq,  wait);
 
-    if (dev->rb.rp != dev->rb.wp) {
+    if (esp_rb_has_data(&dev->rb)) {
         mask |= (POLLIN | POLLRDNORM) ;   /* readable */
     }
     if (get_free_space(&dev->rb)) {
@@ -211,7 +215,8 @@ const struct file_operations esp_serial_fops = {
 
 int esp_serial_data_received(int dev_index, const char *data, size_t len)
 {
-	int ret = 0, ret_len = 0;
+	esp_rb_t *rb = NULL;
+	int ret = 0;
 	if (dev_index >= ESP_SERIAL_MINOR_MAX) {
 		esp_err("%u ERR: serial_dev_idx[%d] >= minor_max[%d]\n",
 				__LINE__, dev_index, ESP_SERIAL_MINOR_MAX);
@@ -223,23 +228,37 @@ int esp_serial_data_received(int dev_index, const char *data, size_t len)
 		return len;
 	}
 
-	while (ret_len != len) {
-		ret = esp_rb_write_by_kernel(&devs[dev_index].rb,
-				data+ret_len, (len-ret_len));
-		if (ret <= 0) {
-			break;
-		}
-		ret_len += ret;
-	}
-	if (ret <= 0) {
+	rb = &devs[dev_index].rb;
+
+	/* Frame is queued whole or dropped, never truncated */
+	ret = esp_rb_write_by_kernel(rb, data, len);
+	if (ret < 0)
 		return ret;
+
+	if (!ret && len) {
+		if (printk_ratelimit())
+			esp_err("RB full, dropping %zu bytes (overruns: %llu)\n",
+					len, rb->overruns);
 	}
-	if (ret_len != len) {
-		esp_err("RB full, no space to receive. Dropping packet\n");
-	}
 
-	return ret_len;
+	return ret;
+}
+
+static ssize_t rb_stats_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	esp_rb_t *rb = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "size %zu used %d max_used %zu overruns %llu overrun_bytes %llu\n",
+			rb->size, (int)rb->size - get_free_space(rb), rb->max_used,
+			rb->overruns, rb->overrun_bytes);
 }
+static DEVICE_ATTR_RO(rb_stats);
+
+static struct attribute *esp_serial_attrs[] = {
+	&dev_attr_rb_stats.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(esp_serial);
 
 static dev_t dev_first;
 static struct class *cl;
@@ -273,10 +292,15 @@ int esp_serial_init(void *priv)
 	for (i = 0; i < ESP_SERIAL_MINOR_MAX; i++) {
 		dev_t dev_num = dev_first + i;
 		devs[i].dev_index = i;
-		devs[i].dev = device_create(cl, NULL, dev_num, NULL, "esps%d", i);
+		err = esp_rb_init(&devs[i].rb, serial_rb_size);
+		if (err) {
+			esp_err("Failed to init rb of size %u\n", serial_rb_size);
+			goto err_rb_init;
+		}
+		devs[i].dev = device_create_with_groups(cl, NULL, dev_num, &devs[i].rb,
+				esp_serial_groups, "esps%d", i);
 		cdev_init(&devs[i].cdev, &esp_serial_fops);
 		cdev_add(&devs[i].cdev, dev_num, 1);
-		esp_rb_init(&devs[i].rb, ESP_RX_RB_SIZE);
 		devs[i].priv = priv;
 		mutex_init(&devs[i].lock);
 	}
@@ -288,6 +312,14 @@ int esp_serial_init(void *priv)
 	esp_verbose("\n");
 	return 0;
 
+err_rb_init:
+	while (i--) {
+		device_destroy(cl, dev_first + i);
+		cdev_del(&devs[i].cdev);
+		esp_rb_cleanup(&devs[i].rb);
+		mutex_destroy(&devs[i].lock);
+	}
+	class_destroy(cl);
 err_class_create:
 	unregister_chrdev_region(dev_first, ESP_SERIAL_MINOR_MAX);
 err:
@@ -20,6 +20,7 @@
 
 #include "esp_utils.h"
 #include "esp_stats.h"
+#include <linux/math64.h>
 
 #if TEST_RAW_TP
 
@@ -70,7 +71,7 @@ static int raw_tp_tx_process(void *data)
 
 	while (!kthread_should_stop()) {
 
-		if (esp_is_tx_queue_paused()) {
+		if (!esp_is_tx_queue_paused()) {
 
 			tx_skb = esp_alloc_skb(TEST_RAW_TP__BUF_SIZE);
 			if (!tx_skb) {
@@ -89,7 +90,7 @@ static int raw_tp_tx_process(void *data)
 			payload_header->len = cpu_to_le16(TEST_RAW_TP__BUF_SIZE);
 			payload_header->offset = cpu_to_le16(pad_len);
 
-			if (adapter->capabilities & ESP_CHECKSUM_ENABLED) {
+			if (esp_is_checksum_enabled(adapter, ESP_TEST_IF)) {
 				payload_header->checksum =
 					cpu_to_le16(compute_checksum(tx_skb->data,
 								(TEST_RAW_TP__BUF_SIZE + pad_len)));
@@ -207,3 +208,30 @@ void process_test_capabilities(u8 cap)
 	process_raw_tp_flags();
 #endif
 }
+
+void esp_lat_hist_print(const char *name, const struct esp_lat_hist *hist)
+{
+	u32 idx = 0;
+
+	if (!hist->samples)
+		return;
+
+	esp_info("%s latency: %llu samples, avg %llu us, max %llu us\n", name,
+			hist->samples, div64_u64(hist->total_us, hist->samples),
+			hist->max_us);
+
+	for (idx = 0; idx < ESP_LAT_HIST_BUCKETS; idx++) {
+		if (!hist->bucket[idx])
+			continue;
+
+		if (!idx)
+			esp_info("%s latency: %6u - %6u us: %llu\n", name, 0, 1,
+					hist->bucket[idx]);
+		else if (idx == ESP_LAT_HIST_BUCKETS - 1)
+			esp_info("%s latency: %6u -    max us: %llu\n", name,
+					1U << (idx - 1), hist->bucket[idx]);
+		else
+			esp_info("%s latency: %6u - %6u us: %llu\n", name,
+					1U << (idx - 1), 1U << idx, hist->bucket[idx]);
+	}
+}
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Espressif Systems Wireless LAN device driver
+ *
+ * Copyright (C) 2015-2021 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <net/dsfield.h>
+#include "esp_tx_sched.h"
+
+/* Packets served from a queue per round, while others have packets too */
+static const u8 esp_data_q_weight[ESP_DATA_Q_MAX] = {
+	[ESP_DATA_Q_BE] = 4,
+	[ESP_DATA_Q_BK] = 1,
+	[ESP_DATA_Q_VI] = 8,
+	[ESP_DATA_Q_VO] = 16,
+};
+
+/* 802.1d user priority to access category, as in 802.11 */
+static const u8 esp_up_to_data_q[8] = {
+	ESP_DATA_Q_BE, ESP_DATA_Q_BK, ESP_DATA_Q_BK, ESP_DATA_Q_BE,
+	ESP_DATA_Q_VI, ESP_DATA_Q_VI, ESP_DATA_Q_VO, ESP_DATA_Q_VO,
+};
+
+static u8 get_data_q(struct sk_buff *skb)
+{
+	u16 q = skb_get_queue_mapping(skb);
+
+	return (q < ESP_DATA_Q_MAX) ? q : ESP_DATA_Q_BE;
+}
+
+void esp_tx_sched_init(struct esp_tx_sched *sched)
+{
+	u8 i;
+
+	for (i = 0; i < ESP_DATA_Q_MAX; i++)
+		skb_queue_head_init(&sched->q[i]);
+
+	sched->cur = 0;
+	sched->credit = esp_data_q_weight[0];
+}
+
+void esp_tx_sched_purge(struct esp_tx_sched *sched)
+{
+	u8 i;
+
+	for (i = 0; i < ESP_DATA_Q_MAX; i++)
+		skb_queue_purge(&sched->q[i]);
+}
+
+void esp_tx_sched_enqueue(struct esp_tx_sched *sched, struct sk_buff *skb)
+{
+	skb_queue_tail(&sched->q[get_data_q(skb)], skb);
+}
+
+/* Put back packet just dequeued, which could not be sent */
+void esp_tx_sched_requeue(struct esp_tx_sched *sched, struct sk_buff *skb)
+{
+	skb_queue_head(&sched->q[get_data_q(skb)], skb);
+}
+
+static void next_data_q(struct esp_tx_sched *sched)
+{
+	sched->cur = (sched->cur + 1) % ESP_DATA_Q_MAX;
+	sched->credit = esp_data_q_weight[sched->cur];
+}
+
+/* Dequeue from queue whose turn it is, skipping empty ones.
+ * Packet is taken only if it fits in 'room', else NULL is returned and the
+ * same queue is looked at next time, to retain ordering */
+struct sk_buff *esp_tx_sched_dequeue(struct esp_tx_sched *sched, u32 room)
+{
+	struct sk_buff_head *q;
+	struct sk_buff *skb = NULL;
+	unsigned long flags;
+	u8 i;
+
+	for (i = 0; i < ESP_DATA_Q_MAX; i++) {
+		q = &sched->q[sched->cur];
+
+		spin_lock_irqsave(&q->lock, flags);
+		skb = skb_peek(q);
+		if (!skb) {
+			spin_unlock_irqrestore(&q->lock, flags);
+			next_data_q(sched);
+			continue;
+		}
+
+		if (skb->len <= room)
+			__skb_unlink(skb, q);
+		else
+			skb = NULL;
+		spin_unlock_irqrestore(&q->lock, flags);
+
+		if (skb && !--sched->credit)
+			next_data_q(sched);
+
+		return skb;
+	}
+
+	return NULL;
+}
+
+static u8 get_user_priority(struct sk_buff *skb)
+{
+	struct iphdr _iph, *iph;
+	struct ipv6hdr _ip6h, *ip6h;
+
+	/* Explicitly set with SO_PRIORITY, as for cfg80211 drivers */
+	if (skb->priority >= 256 && skb->priority <= 263)
+		return skb->priority - 256;
+
+	switch (skb->protocol) {
+	case htons(ETH_P_IP):
+		iph = skb_header_pointer(skb, ETH_HLEN, sizeof(_iph), &_iph);
+		if (!iph)
+			return 0;
+		/* Precedence bits of DSCP */
+		return ipv4_get_dsfield(iph) >> 5;
+
+	case htons(ETH_P_IPV6):
+		ip6h = skb_header_pointer(skb, ETH_HLEN, sizeof(_ip6h), &_ip6h);
+		if (!ip6h)
+			return 0;
+		return ipv6_get_dsfield(ip6h) >> 5;
+
+	case htons(ETH_P_ARP):
+	case htons(ETH_P_PAE):
+		/* Keep address resolution and key exchange ahead of bulk data */
+		return 7;
+
+	default:
+		return 0;
+	}
+}
+
+/* ndo_select_queue() helper, netdev TX queue index is esp_data_q */
+u16 esp_tx_sched_select_queue(struct sk_buff *skb)
+{
+	return esp_up_to_data_q[get_user_priority(skb)];
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Espressif Systems Wireless LAN device driver
+ *
+ * Copyright (C) 2015-2021 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+
+#ifndef __ESP_TX_SCHED__H__
+#define __ESP_TX_SCHED__H__
+
+#include <linux/skbuff.h>
+
+/* Network data queues, one per netdev TX queue, by 802.11 access category.
+ * BE comes first, so that frames not mapped by netdev land there */
+enum esp_data_q {
+	ESP_DATA_Q_BE = 0,
+	ESP_DATA_Q_BK,
+	ESP_DATA_Q_VI,
+	ESP_DATA_Q_VO,
+	ESP_DATA_Q_MAX,
+};
+
+/* Weighted round robin over data queues, taking the place of single
+ * PRIO_Q_OTHERS queue at transport.
+ * Any context may enqueue. Dequeue is meant for single TX thread */
+struct esp_tx_sched {
+	struct sk_buff_head q[ESP_DATA_Q_MAX];
+
+	/* Dequeuer owned */
+	u8 cur;
+	u8 credit;
+};
+
+void esp_tx_sched_init(struct esp_tx_sched *sched);
+void esp_tx_sched_purge(struct esp_tx_sched *sched);
+void esp_tx_sched_enqueue(struct esp_tx_sched *sched, struct sk_buff *skb);
+void esp_tx_sched_requeue(struct esp_tx_sched *sched, struct sk_buff *skb);
+struct sk_buff *esp_tx_sched_dequeue(struct esp_tx_sched *sched, u32 room);
+u16 esp_tx_sched_select_queue(struct sk_buff *skb);
+
+#endif
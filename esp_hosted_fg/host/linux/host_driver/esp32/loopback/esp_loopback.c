@@ -0,0 +1,539 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2015-2024 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+
+/*
+ * Virtual transport which emulates ESP side in software.
+ * No ESP hardware is needed, so host datapath (process_tx_packet(),
+ * process_rx_packet(), serial and netdev glue) could be exercised and
+ * benchmarked on any Linux machine.
+ */
+#include "esp_utils.h"
+
+#include <linux/module.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/semaphore.h>
+#include <linux/etherdevice.h>
+#include <linux/ktime.h>
+#include "esp_loopback.h"
+#include "esp_if.h"
+#include "esp_api.h"
+#include "esp_bt_api.h"
+#include "esp_serial.h"
+#include "esp_kernel_port.h"
+#include "esp_stats.h"
+
+#define TX_MAX_PENDING_COUNT    100
+#define TX_RESUME_THRESHOLD     (TX_MAX_PENDING_COUNT/5)
+#define RX_SCRIPT_BATCH         32
+#define RX_SCRIPT_ETHER_TYPE    0x88B5 /* IEEE local experimental */
+
+static int loopback_mode = ESP_LOOPBACK_ECHO;
+module_param(loopback_mode, int, S_IRUGO);
+MODULE_PARM_DESC(loopback_mode, "Emulated ESP: 0 - echo, 1 - sink, 2 - scripted firmware");
+
+static int loopback_checksum = 1;
+module_param(loopback_checksum, int, S_IRUGO);
+MODULE_PARM_DESC(loopback_checksum, "Advertise ESP_CHECKSUM_ENABLED capability");
+
+static int loopback_checksum_prio_q = ESP_CHECKSUM_ALL_PRIO_Q;
+module_param(loopback_checksum_prio_q, int, S_IRUGO);
+MODULE_PARM_DESC(loopback_checksum_prio_q, "Bitmap of priority queues carrying checksum");
+
+static uint loopback_rx_pkts = 100000;
+module_param(loopback_rx_pkts, uint, S_IRUGO);
+MODULE_PARM_DESC(loopback_rx_pkts, "Scripted firmware: number of RX frames to generate");
+
+static uint loopback_rx_len = ETH_DATA_LEN;
+module_param(loopback_rx_len, uint, S_IRUGO);
+MODULE_PARM_DESC(loopback_rx_len, "Scripted firmware: payload length of generated RX frames");
+
+static struct sk_buff * read_packet(struct esp_adapter *adapter);
+static int write_packet(struct esp_adapter *adapter, struct sk_buff *skb);
+static void loopback_exit(void);
+
+static struct esp_loopback_context lb_context;
+static atomic_t tx_pending;
+static struct task_struct *lb_thread;
+static struct semaphore lb_sem;
+
+static struct esp_if_ops if_ops = {
+	.read		= read_packet,
+	.write		= write_packet,
+};
+
+static u8 get_prio_q_idx(struct esp_payload_header *header)
+{
+	if (header->if_type == ESP_SERIAL_IF)
+		return PRIO_Q_SERIAL;
+	if (header->if_type == ESP_HCI_IF)
+		return PRIO_Q_BT;
+	return PRIO_Q_OTHERS;
+}
+
+static struct sk_buff * read_packet(struct esp_adapter *adapter)
+{
+	struct esp_loopback_context *context;
+	struct sk_buff *skb = NULL;
+
+	if (!adapter || !adapter->if_context) {
+		esp_err("Invalid args\n");
+		return NULL;
+	}
+
+	context = adapter->if_context;
+
+	skb = skb_dequeue(&(context->rx_q[PRIO_Q_SERIAL]));
+	if (!skb)
+		skb = skb_dequeue(&(context->rx_q[PRIO_Q_BT]));
+	if (!skb)
+		skb = skb_dequeue(&(context->rx_q[PRIO_Q_OTHERS]));
+
+	return skb;
+}
+
+static int write_packet(struct esp_adapter *adapter, struct sk_buff *skb)
+{
+	struct esp_payload_header *payload_header = (struct esp_payload_header *) skb->data;
+	u8 prio_q_idx;
+
+	if (!adapter || !adapter->if_context || !skb || !skb->data || !skb->len) {
+		esp_err("Invalid args\n");
+		dev_kfree_skb(skb);
+		return -EINVAL;
+	}
+
+	if (skb->len > LOOPBACK_BUF_SIZE) {
+		esp_err("Drop pkt of len[%u] > max loopback len[%u]\n",
+				skb->len, LOOPBACK_BUF_SIZE);
+		dev_kfree_skb(skb);
+		return -EPERM;
+	}
+
+	if (lb_context.state != ESP_CONTEXT_READY) {
+		dev_kfree_skb(skb);
+		return -EPERM;
+	}
+
+	prio_q_idx = get_prio_q_idx(payload_header);
+
+	if (prio_q_idx == PRIO_Q_OTHERS) {
+		if (atomic_read(&tx_pending) >= TX_MAX_PENDING_COUNT) {
+			esp_tx_pause(skb);
+			lb_context.stats.tx_dropped++;
+			dev_kfree_skb(skb);
+			up(&lb_sem);
+			return -EBUSY;
+		}
+		atomic_inc(&tx_pending);
+	}
+
+	esp_tx_sent(skb);
+	skb_queue_tail(&lb_context.tx_q[prio_q_idx], skb);
+	up(&lb_sem);
+
+	return 0;
+}
+
+static void loopback_set_checksum(struct sk_buff *skb)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) skb->data;
+	u16 len = le16_to_cpu(header->len) + le16_to_cpu(header->offset);
+
+	header->checksum = 0;
+	if (esp_is_checksum_enabled(lb_context.adapter, header->if_type))
+		header->checksum = cpu_to_le16(compute_checksum(skb->data, len));
+}
+
+static void loopback_rx_enqueue(struct sk_buff *skb)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) skb->data;
+
+	lb_context.stats.rx_packets++;
+	lb_context.stats.rx_bytes += le16_to_cpu(header->len);
+
+	skb_queue_tail(&lb_context.rx_q[get_prio_q_idx(header)], skb);
+
+	/* indicate reception of new packet */
+	esp_process_new_packet_intr(lb_context.adapter);
+}
+
+/* Same layout as ESP firmware's boot-up event */
+static int loopback_send_init_event(void)
+{
+	struct esp_payload_header *header;
+	struct esp_priv_event *event;
+	struct sk_buff *skb;
+	u8 *pos;
+	u8 cap = ESP_WLAN_SPI_SUPPORT;
+	u8 event_len = 0;
+	u16 len;
+
+	if (loopback_checksum)
+		cap |= ESP_CHECKSUM_ENABLED;
+
+	skb = esp_alloc_skb(LOOPBACK_BUF_SIZE);
+	if (!skb) {
+		esp_err("SKB alloc failed\n");
+		return -ENOMEM;
+	}
+
+	header = (struct esp_payload_header *) skb->data;
+	memset(header, 0, LOOPBACK_BUF_SIZE);
+
+	event = (struct esp_priv_event *) (skb->data + sizeof(struct esp_payload_header));
+	event->event_type = ESP_PRIV_EVENT_INIT;
+
+	pos = event->event_data;
+
+	*pos++ = ESP_PRIV_CAPABILITY;
+	*pos++ = 1;
+	*pos++ = cap;
+	event_len += 3;
+
+	*pos++ = ESP_PRIV_FIRMWARE_CHIP_ID;
+	*pos++ = 1;
+	*pos++ = ESP_FIRMWARE_CHIP_ESP32;
+	event_len += 3;
+
+	if (loopback_checksum) {
+		*pos++ = ESP_PRIV_CHECKSUM_PRIO_Q;
+		*pos++ = 1;
+		*pos++ = loopback_checksum_prio_q & ESP_CHECKSUM_ALL_PRIO_Q;
+		event_len += 3;
+	}
+
+	event->event_len = event_len;
+	len = sizeof(struct esp_priv_event) + event_len;
+
+	header->if_type = ESP_PRIV_IF;
+	header->if_num = 0;
+	header->priv_pkt_type = ESP_PACKET_TYPE_EVENT;
+	header->len = cpu_to_le16(len);
+	header->offset = cpu_to_le16(sizeof(struct esp_payload_header));
+
+	skb_put(skb, len + sizeof(struct esp_payload_header));
+
+	/* Checksum is not yet negotiated for the init event itself */
+	loopback_rx_enqueue(skb);
+
+	return 0;
+}
+
+static struct sk_buff * loopback_build_rx_frame(void)
+{
+	struct esp_payload_header *header;
+	struct ethhdr *eth;
+	struct esp_private *priv = lb_context.adapter->priv[0];
+	struct sk_buff *skb;
+	u16 len = min_t(u32, loopback_rx_len, ETH_DATA_LEN) + ETH_HLEN;
+
+	if (!priv || !priv->ndev)
+		return NULL;
+
+	skb = esp_alloc_skb(len + sizeof(struct esp_payload_header));
+	if (!skb)
+		return NULL;
+
+	header = (struct esp_payload_header *) skb_put(skb,
+			len + sizeof(struct esp_payload_header));
+	memset(header, 0, skb->len);
+
+	header->if_type = priv->if_type;
+	header->if_num = priv->if_num;
+	header->len = cpu_to_le16(len);
+	header->offset = cpu_to_le16(sizeof(struct esp_payload_header));
+
+	eth = (struct ethhdr *) (skb->data + sizeof(struct esp_payload_header));
+	ether_addr_copy(eth->h_dest, priv->ndev->dev_addr);
+	eth_broadcast_addr(eth->h_source);
+	eth->h_source[0] = 0x02;
+	eth->h_proto = htons(RX_SCRIPT_ETHER_TYPE);
+
+	loopback_set_checksum(skb);
+
+	return skb;
+}
+
+/* Scripted firmware: feed RX path without flooding memory */
+static void loopback_run_rx_script(void)
+{
+	struct sk_buff *skb;
+	int i;
+
+	for (i = 0; i < RX_SCRIPT_BATCH && lb_context.rx_script_left; i++) {
+		if (skb_queue_len(&lb_context.rx_q[PRIO_Q_OTHERS]) >= TX_MAX_PENDING_COUNT) {
+			/* Let RX work drain the queue */
+			usleep_range(50, 100);
+			break;
+		}
+
+		skb = loopback_build_rx_frame();
+		if (!skb)
+			break;
+
+		loopback_rx_enqueue(skb);
+		lb_context.rx_script_left--;
+	}
+
+	if (!lb_context.rx_script_left) {
+		esp_info("Scripted RX done: %u frames\n", loopback_rx_pkts);
+		return;
+	}
+
+	/* Keep thread running until script is over */
+	up(&lb_sem);
+}
+
+static void loopback_process_tx(struct sk_buff *tx_skb, u8 prio_q_idx)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) tx_skb->data;
+
+	esp_tx_completed(tx_skb);
+
+	if (prio_q_idx == PRIO_Q_OTHERS) {
+		if (atomic_read(&tx_pending))
+			atomic_dec(&tx_pending);
+
+		if (atomic_read(&tx_pending) < TX_RESUME_THRESHOLD) {
+			esp_tx_resume();
+#if TEST_RAW_TP
+			esp_raw_tp_queue_resume();
+#endif
+		}
+	}
+
+	lb_context.stats.tx_packets++;
+	lb_context.stats.tx_bytes += le16_to_cpu(header->len);
+
+	esp_hex_dump_dbg("loopback_tx: ", tx_skb->data, 32);
+
+	if (lb_context.mode == ESP_LOOPBACK_ECHO) {
+		/* RX path modifies header in place, so need private copy */
+		tx_skb = skb_unshare(tx_skb, GFP_KERNEL);
+		if (!tx_skb)
+			return;
+
+		/* Header and checksum already valid for RX path, hand it back */
+		loopback_rx_enqueue(tx_skb);
+	} else {
+		dev_kfree_skb(tx_skb);
+	}
+}
+
+static void esp_loopback_transaction(void)
+{
+	struct sk_buff *tx_skb = NULL;
+	u8 prio_q_idx;
+
+	for (prio_q_idx = 0; prio_q_idx < MAX_PRIORITY_QUEUES; prio_q_idx++) {
+		tx_skb = skb_dequeue(&lb_context.tx_q[prio_q_idx]);
+		if (tx_skb)
+			break;
+	}
+
+	if (tx_skb)
+		loopback_process_tx(tx_skb, prio_q_idx);
+	else if (lb_context.rx_script_left)
+		loopback_run_rx_script();
+}
+
+static int esp_loopback_thread(void *data)
+{
+	esp_info("esp loopback thread created, mode[%d]\n", lb_context.mode);
+
+	while (!kthread_should_stop()) {
+
+		if (down_interruptible(&lb_sem)) {
+			esp_verbose("Failed to acquire lb_sem\n");
+			msleep(10);
+			continue;
+		}
+
+		if (lb_context.state != ESP_CONTEXT_READY)
+			continue;
+
+		esp_loopback_transaction();
+		cond_resched();
+	}
+	esp_info("esp loopback thread cleared\n");
+	do_exit(0);
+	return 0;
+}
+
+int process_init_event(u8 *evt_buf, u8 len)
+{
+	u8 len_left = len, tag_len;
+	u8 *pos;
+	struct esp_adapter *adapter = esp_get_adapter();
+	int ret = 0;
+
+	if (!evt_buf)
+		return -1;
+
+	pos = evt_buf;
+	/* Older firmware checksums all queues */
+	adapter->checksum_prio_q_mask = ESP_CHECKSUM_ALL_PRIO_Q;
+
+	while (len_left) {
+		tag_len = *(pos + 1);
+		esp_info("EVENT: %d\n", *pos);
+		if (*pos == ESP_PRIV_CAPABILITY) {
+			adapter->capabilities = *(pos + 2);
+		} else if (*pos == ESP_PRIV_FIRMWARE_CHIP_ID) {
+			esp_info("Emulated ESP chipset [%d]\n", *(pos + 2));
+		} else if (*pos == ESP_PRIV_CHECKSUM_PRIO_Q) {
+			adapter->checksum_prio_q_mask = *(pos + 2);
+		} else if (*pos == ESP_PRIV_TEST_RAW_TP) {
+			process_test_capabilities(*(pos + 2));
+		} else {
+			esp_warn("Unsupported tag in event\n");
+		}
+		pos += (tag_len+2);
+		len_left -= (tag_len+2);
+	}
+
+	ret = esp_add_card(lb_context.adapter);
+	if (ret) {
+		esp_err("Failed to add card\n");
+		return ret;
+	}
+
+	process_capabilities(adapter->capabilities);
+	esp_info("esp boot-up event processed\n");
+
+	lb_context.start_time = ktime_get();
+
+	if (lb_context.mode == ESP_LOOPBACK_FIRMWARE) {
+		lb_context.rx_script_left = loopback_rx_pkts;
+		up(&lb_sem);
+	}
+
+	return 0;
+}
+
+static void loopback_print_stats(void)
+{
+	struct esp_loopback_stats *stats = &lb_context.stats;
+	s64 elapsed_us;
+
+	if (!lb_context.start_time)
+		return;
+
+	elapsed_us = ktime_us_delta(ktime_get(), lb_context.start_time);
+	if (elapsed_us <= 0)
+		elapsed_us = 1;
+
+	esp_info("loopback: tx %llu pkts / %llu bytes, rx %llu pkts / %llu bytes, tx dropped %llu\n",
+			stats->tx_packets, stats->tx_bytes,
+			stats->rx_packets, stats->rx_bytes, stats->tx_dropped);
+	esp_info("loopback: %lld us, tx %llu pps, rx %llu pps\n", elapsed_us,
+			div64_u64(stats->tx_packets * USEC_PER_SEC, elapsed_us),
+			div64_u64(stats->rx_packets * USEC_PER_SEC, elapsed_us));
+}
+
+static int loopback_init(void)
+{
+	int status = 0;
+	uint8_t prio_q_idx = 0;
+
+	sema_init(&lb_sem, 0);
+	atomic_set(&tx_pending, 0);
+
+	for (prio_q_idx=0; prio_q_idx<MAX_PRIORITY_QUEUES; prio_q_idx++) {
+		skb_queue_head_init(&lb_context.tx_q[prio_q_idx]);
+		skb_queue_head_init(&lb_context.rx_q[prio_q_idx]);
+	}
+
+	lb_thread = kthread_run(esp_loopback_thread, lb_context.adapter, "esp32_loopback");
+	if (!lb_thread) {
+		esp_err("Failed to create esp32_loopback thread\n");
+		return -EFAULT;
+	}
+
+	status = esp_serial_init((void *) lb_context.adapter);
+	if (status != 0) {
+		loopback_exit();
+		esp_err("Error initialising serial interface\n");
+		return status;
+	}
+
+	lb_context.state = ESP_CONTEXT_READY;
+	lb_context.adapter->state = ESP_CONTEXT_READY;
+
+	status = loopback_send_init_event();
+	if (status) {
+		loopback_exit();
+		return status;
+	}
+
+	return status;
+}
+
+static void loopback_exit(void)
+{
+	uint8_t prio_q_idx = 0;
+
+	lb_context.state = ESP_CONTEXT_DISABLED;
+	lb_context.adapter->state = ESP_CONTEXT_DISABLED;
+
+	up(&lb_sem);
+	if (lb_thread) {
+		kthread_stop(lb_thread);
+		lb_thread = NULL;
+	}
+
+	esp_remove_card(lb_context.adapter);
+
+	for (prio_q_idx=0; prio_q_idx<MAX_PRIORITY_QUEUES; prio_q_idx++) {
+		skb_queue_purge(&lb_context.tx_q[prio_q_idx]);
+		skb_queue_purge(&lb_context.rx_q[prio_q_idx]);
+	}
+
+	loopback_print_stats();
+
+	memset(&lb_context, 0, sizeof(lb_context));
+}
+
+int esp_init_interface_layer(struct esp_adapter *adapter)
+{
+	if (!adapter) {
+		esp_err("null adapter\n");
+		return -EINVAL;
+	}
+
+	if (loopback_mode < 0 || loopback_mode >= ESP_LOOPBACK_MAX_MODE) {
+		esp_err("Invalid loopback_mode[%d]\n", loopback_mode);
+		return -EINVAL;
+	}
+
+	memset(&lb_context, 0, sizeof(lb_context));
+
+	adapter->if_context = &lb_context;
+	adapter->if_ops = &if_ops;
+	adapter->if_type = ESP_IF_TYPE_LOOPBACK;
+	lb_context.adapter = adapter;
+	lb_context.mode = loopback_mode;
+
+	return loopback_init();
+}
+
+void esp_deinit_interface_layer(void)
+{
+	loopback_exit();
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2015-2024 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This software file (the "File") is distributed by Espressif Systems (Shanghai)
+ * PTE LTD under the terms of the GNU General Public License Version 2, June 1991
+ * (the "License").  You may use, redistribute and/or modify this File in
+ * accordance with the terms and conditions of the License, a copy of which
+ * is available by writing to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA or on the
+ * worldwide web at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt.
+ *
+ * THE FILE IS DISTRIBUTED AS-IS, WITHOUT WARRANTY OF ANY KIND, AND THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE
+ * ARE EXPRESSLY DISCLAIMED.  The License provides additional details about
+ * this warranty disclaimer.
+ */
+#ifndef _ESP_LOOPBACK_H_
+#define _ESP_LOOPBACK_H_
+
+#include "esp.h"
+
+#define LOOPBACK_BUF_SIZE       1600
+
+/* Emulated ESP behaviour, selected with 'loopback_mode' module param */
+enum loopback_mode_e {
+	/* Every packet written by host is handed back on RX path */
+	ESP_LOOPBACK_ECHO,
+	/* Packets written by host are consumed and only accounted */
+	ESP_LOOPBACK_SINK,
+	/* Like sink, plus a scripted stream of RX frames towards station
+	 * interface, to measure host RX datapath */
+	ESP_LOOPBACK_FIRMWARE,
+	ESP_LOOPBACK_MAX_MODE,
+};
+
+struct esp_loopback_stats {
+	u64                         tx_packets;
+	u64                         tx_bytes;
+	u64                         rx_packets;
+	u64                         rx_bytes;
+	u64                         tx_dropped;
+};
+
+struct esp_loopback_context {
+	struct esp_adapter          *adapter;
+	struct sk_buff_head         tx_q[MAX_PRIORITY_QUEUES];
+	struct sk_buff_head         rx_q[MAX_PRIORITY_QUEUES];
+	enum context_state          state;
+	u8                          mode;
+	u32                         rx_script_left;
+	struct esp_loopback_stats   stats;
+	ktime_t                     start_time;
+};
+
+#endif
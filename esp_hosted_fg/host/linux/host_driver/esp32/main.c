@@ -35,6 +35,7 @@
 #include "esp_api.h"
 #include "esp_kernel_port.h"
 #include "esp_stats.h"
+#include "esp_tx_sched.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Amey Inamdar <amey.inamdar@espressif.com>");
@@ -45,6 +46,10 @@ MODULE_VERSION("0.0.5");
 
 struct esp_adapter adapter;
 volatile u8 stop_data = 0;
+/* TX paused for traffic not from netdev, i.e. raw throughput test */
+static atomic_t tx_paused = ATOMIC_INIT(0);
+/* Some netdev TX queue stopped by esp_tx_pause() */
+static atomic_t netdev_tx_paused = ATOMIC_INIT(0);
 
 #define ACTION_DROP 1
 /* Unless specified as part of argument, resetpin,
@@ -83,6 +88,7 @@ static inline void ether_addr_copy(u8 *dst, const u8 *src)
 static int esp_open(struct net_device *ndev);
 static int esp_stop(struct net_device *ndev);
 static int esp_hard_start_xmit(struct sk_buff *skb, struct net_device *ndev);
+static NDO_SELECT_QUEUE_PROTOTYPE();
 static int esp_set_mac_address(struct net_device *ndev, void *addr);
 static struct net_device_stats* esp_get_stats(struct net_device *ndev);
 static void esp_set_rx_mode(struct net_device *ndev);
@@ -91,10 +97,32 @@ static NDO_TX_TIMEOUT_PROTOTYPE();
 int esp_send_packet(struct esp_adapter *adapter, struct sk_buff *skb);
 struct sk_buff * esp_alloc_skb(u32 len);
 
+static void esp_get_drvinfo(struct net_device *ndev, struct ethtool_drvinfo *info);
+static int esp_get_sset_count(struct net_device *ndev, int sset);
+static void esp_get_strings(struct net_device *ndev, u32 stringset, u8 *data);
+static void esp_get_ethtool_stats(struct net_device *ndev,
+		struct ethtool_stats *stats, u64 *data);
+
+static const struct ethtool_ops esp_ethtool_ops = {
+	.get_drvinfo = esp_get_drvinfo,
+	.get_link = ethtool_op_get_link,
+	.get_sset_count = esp_get_sset_count,
+	.get_strings = esp_get_strings,
+	.get_ethtool_stats = esp_get_ethtool_stats,
+};
+
+/* Names for struct esp_drv_stats members, in same order */
+static const char esp_drv_stats_strings[][ETH_GSTRING_LEN] = {
+	"tx_copy_fallback",
+};
+
+#define ESP_DRV_STATS_LEN ARRAY_SIZE(esp_drv_stats_strings)
+
 static const struct net_device_ops esp_netdev_ops = {
 	.ndo_open = esp_open,
 	.ndo_stop = esp_stop,
 	.ndo_start_xmit = esp_hard_start_xmit,
+	.ndo_select_queue = esp_select_queue,
 	.ndo_set_mac_address = esp_set_mac_address,
 	.ndo_validate_addr = eth_validate_addr,
 	.ndo_tx_timeout = esp_tx_timeout,
@@ -109,19 +137,25 @@ struct esp_adapter * esp_get_adapter(void)
 
 static int esp_open(struct net_device *ndev)
 {
-	netif_start_queue(ndev);
+	netif_tx_start_all_queues(ndev);
 	return 0;
 }
 
 static int esp_stop(struct net_device *ndev)
 {
-	netif_stop_queue(ndev);
+	netif_tx_stop_all_queues(ndev);
 	return 0;
 }
 
 static struct net_device_stats* esp_get_stats(struct net_device *ndev)
 {
 	struct esp_private *priv = netdev_priv(ndev);
+
+	priv->stats.tx_packets = atomic64_read(&priv->tx_stats.packets);
+	priv->stats.tx_bytes = atomic64_read(&priv->tx_stats.bytes);
+	priv->stats.tx_errors = atomic64_read(&priv->tx_stats.errors);
+	priv->stats.tx_dropped = atomic64_read(&priv->tx_stats.dropped);
+
 	return &priv->stats;
 }
 
@@ -142,6 +176,44 @@ static NDO_TX_TIMEOUT_PROTOTYPE()
 {
 }
 
+/* TX queue is picked by user priority or DSCP, for transport to serve
+ * them by weight */
+static NDO_SELECT_QUEUE_PROTOTYPE()
+{
+	return esp_tx_sched_select_queue(skb);
+}
+
+static void esp_get_drvinfo(struct net_device *ndev, struct ethtool_drvinfo *info)
+{
+	strscpy(info->driver, KBUILD_MODNAME, sizeof(info->driver));
+}
+
+static int esp_get_sset_count(struct net_device *ndev, int sset)
+{
+	if (sset == ETH_SS_STATS)
+		return ESP_DRV_STATS_LEN;
+
+	return -EOPNOTSUPP;
+}
+
+static void esp_get_strings(struct net_device *ndev, u32 stringset, u8 *data)
+{
+	if (stringset == ETH_SS_STATS)
+		memcpy(data, esp_drv_stats_strings, sizeof(esp_drv_stats_strings));
+}
+
+static void esp_get_ethtool_stats(struct net_device *ndev,
+		struct ethtool_stats *stats, u64 *data)
+{
+	struct esp_private *priv = netdev_priv(ndev);
+	atomic64_t *counters = (atomic64_t *) &priv->drv_stats;
+	u32 i = 0;
+
+	BUILD_BUG_ON(sizeof(struct esp_drv_stats) != ESP_DRV_STATS_LEN * sizeof(atomic64_t));
+	for (i = 0; i < ESP_DRV_STATS_LEN; i++)
+		data[i] = atomic64_read(&counters[i]);
+}
+
 static void esp_set_rx_mode(struct net_device *ndev)
 {
 }
@@ -158,7 +230,7 @@ static int esp_hard_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 
 	if (!skb->len || (skb->len > ETH_FRAME_LEN)) {
 		esp_err("tx len[%d], max_len[%d]\n", skb->len, ETH_FRAME_LEN);
-		priv->stats.tx_dropped++;
+		atomic64_inc(&priv->tx_stats.dropped);
 		dev_kfree_skb(skb);
 		return NETDEV_TX_OK;
 	}
@@ -210,7 +282,7 @@ static int process_tx_packet (struct sk_buff *skb)
 	struct esp_payload_header *payload_header = NULL;
 	struct sk_buff *new_skb = NULL;
 	int ret = 0;
-	u8 pad_len = 0, realloc_skb = 0;
+	u8 pad_len = 0;
 	u16 len = 0;
 	u16 total_len = 0;
 	u8 *pos = NULL;
@@ -224,55 +296,44 @@ static int process_tx_packet (struct sk_buff *skb)
 		return NETDEV_TX_OK;
 	}
 
-	if (netif_queue_stopped((const struct net_device *) adapter.priv[0]->ndev) ||
-			netif_queue_stopped((const struct net_device *) adapter.priv[1]->ndev)) {
-		return NETDEV_TX_BUSY;
-	}
-
 	len = skb->len;
 
-	/* Create space for payload header */
-	pad_len = sizeof(struct esp_payload_header);
-
-	total_len = len + pad_len;
+	/* Push payload header in place. ESP picks payload from 'offset', so pad
+	 * is sized to leave payload header 4 byte aligned */
+	pad_len = sizeof(struct esp_payload_header) +
+		(((unsigned long) skb->data) & (SKB_DATA_ADDR_ALIGNMENT - 1));
 
-	/* Align buffer length */
-	pad_len += SKB_DATA_ADDR_ALIGNMENT - (total_len % SKB_DATA_ADDR_ALIGNMENT);
+	if (skb_is_nonlinear(skb) || skb_header_cloned(skb) ||
+	    (skb_headroom(skb) < pad_len)) {
+		/* Fallback: gather into new aligned SKB, with single copy */
+		pad_len = sizeof(struct esp_payload_header);
 
-	if (skb_headroom(skb) < pad_len) {
-		/* Headroom is not sufficient */
-		realloc_skb = 1;
-	}
-
-	if (realloc_skb || !IS_ALIGNED((unsigned long) skb->data, SKB_DATA_ADDR_ALIGNMENT)) {
-		/* Realloc SKB */
-		if (skb_linearize(skb)) {
-			priv->stats.tx_errors++;
-			dev_kfree_skb(skb);
-			return NETDEV_TX_OK;
-		}
-
-		new_skb = esp_alloc_skb(skb->len + pad_len);
+		new_skb = esp_alloc_skb(len + pad_len);
 
 		if (!new_skb) {
 			esp_err("Failed to allocate SKB\n");
-			priv->stats.tx_errors++;
+			atomic64_inc(&priv->tx_stats.errors);
 			dev_kfree_skb(skb);
 			return NETDEV_TX_OK;
 		}
 
-		pos = new_skb->data;
-		pos += pad_len;
+		pos = skb_put(new_skb, len + pad_len);
 
 		/* Populate new SKB */
-		skb_copy_from_linear_data(skb, pos, skb->len);
-		skb_put(new_skb, skb->len + pad_len);
+		if (skb_copy_bits(skb, 0, pos + pad_len, len)) {
+			atomic64_inc(&priv->tx_stats.errors);
+			dev_kfree_skb(new_skb);
+			dev_kfree_skb(skb);
+			return NETDEV_TX_OK;
+		}
 
 		/* Replace old SKB */
+		skb_set_queue_mapping(new_skb, skb_get_queue_mapping(skb));
 		dev_kfree_skb_any(skb);
 		skb = new_skb;
+		atomic64_inc(&priv->drv_stats.tx_copy_fallback);
 	} else {
-		/* Realloc is not needed, Make space for interface header */
+		/* Make space for interface header */
 		skb_push(skb, pad_len);
 	}
 
@@ -285,30 +346,52 @@ static int process_tx_packet (struct sk_buff *skb)
 	payload_header->len = cpu_to_le16(len);
 	payload_header->offset = cpu_to_le16(pad_len);
 
-	if (adapter.capabilities & ESP_CHECKSUM_ENABLED)
+	if (esp_is_checksum_enabled(&adapter, priv->if_type))
 		payload_header->checksum = cpu_to_le16(compute_checksum(skb->data, (len + pad_len)));
 
 	if (!stop_data) {
+		/* SKB of copy fallback comes with cleared cb */
+		cb = (struct esp_skb_cb *) skb->cb;
+		cb->priv = priv;
+
+		/* Transport frees SKB, take length before handing it over */
+		total_len = skb->len;
+
 		ret = esp_send_packet(priv->adapter, skb);
 
 		if (ret) {
-			priv->stats.tx_errors++;
+			atomic64_inc(&priv->tx_stats.errors);
 		} else {
-			priv->stats.tx_packets++;
-			priv->stats.tx_bytes += skb->len;
+			atomic64_inc(&priv->tx_stats.packets);
+			atomic64_add(total_len, &priv->tx_stats.bytes);
 		}
 	} else {
 		dev_kfree_skb_any(skb);
-		priv->stats.tx_dropped++;
+		atomic64_inc(&priv->tx_stats.dropped);
 	}
 
 	return 0;
 }
-void process_capabilities(u8 cap)
+/* Checksum is negotiated globally, but ESP may leave it out on some
+ * priority queues to save cycles on bulk data path
+ */
+u8 esp_is_checksum_enabled(struct esp_adapter *adapter, u8 if_type)
+{
+	if (!(adapter->capabilities & ESP_CHECKSUM_ENABLED))
+		return 0;
+
+	return !!(adapter->checksum_prio_q_mask &
+			ESP_PRIO_Q_BIT(esp_if_type_to_prio_q(if_type)));
+}
+
+void process_capabilities(u32 cap)
 {
 	struct esp_adapter *adapter = esp_get_adapter();
 	esp_info("ESP peripheral capabilities: 0x%x\n", cap);
 	adapter->capabilities = cap;
+	if (cap & ESP_CHECKSUM_ENABLED)
+		esp_info("Checksum enabled on priority queues: 0x%x\n",
+				adapter->checksum_prio_q_mask);
 
 	/* Reset BT */
 	esp_deinit_bt(esp_get_adapter());
@@ -389,7 +472,7 @@ static void process_rx_packet(struct sk_buff *skb)
 	u16 rx_checksum = 0, checksum = 0;
 	struct hci_dev *hdev = adapter.hcidev;
 	u8 *type = NULL;
-	int ret = 0, ret_len = 0;
+	int ret = 0;
 	struct esp_adapter *adapter = esp_get_adapter();
 
 	if (!skb)
@@ -403,7 +486,7 @@ static void process_rx_packet(struct sk_buff *skb)
 
 	esp_hex_dump_dbg("rx: ", skb->data , len+offset);
 
-	if (adapter->capabilities & ESP_CHECKSUM_ENABLED) {
+	if (esp_is_checksum_enabled(adapter, payload_header->if_type)) {
 		rx_checksum = le16_to_cpu(payload_header->checksum);
 		payload_header->checksum = 0;
 
@@ -417,16 +500,12 @@ static void process_rx_packet(struct sk_buff *skb)
 	}
 
 	if (payload_header->if_type == ESP_SERIAL_IF) {
-		do {
-			ret = esp_serial_data_received(payload_header->if_num,
-					(skb->data + offset + ret_len), (len - ret_len));
-			if (ret < 0) {
-				esp_err("Failed to process data for iface type %d\n",
-						payload_header->if_num);
-				break;
-			}
-			ret_len += ret;
-		} while (ret_len < len);
+		/* Queued whole or dropped on ring overrun */
+		ret = esp_serial_data_received(payload_header->if_num,
+				(skb->data + offset), len);
+		if (ret < 0)
+			esp_err("Failed to process data for iface type %d\n",
+					payload_header->if_num);
 		dev_kfree_skb_any(skb);
 	} else if (payload_header->if_type == ESP_STA_IF ||
 	           payload_header->if_type == ESP_AP_IF) {
@@ -446,11 +525,8 @@ static void process_rx_packet(struct sk_buff *skb)
 		skb->protocol = eth_type_trans(skb, priv->ndev);
 		skb->ip_summed = CHECKSUM_NONE;
 
-		/* Forward skb to kernel */
-		netif_rx_ni(skb);
-
-		priv->stats.rx_bytes += skb->len;
-		priv->stats.rx_packets++;
+		/* Forward skb to kernel, in batches from NAPI poll */
+		skb_queue_tail(&adapter->rx_napi_q, skb);
 	} else if (payload_header->if_type == ESP_HCI_IF) {
 		if (hdev) {
 			/* chop off the header from skb */
@@ -488,48 +564,78 @@ static void process_rx_packet(struct sk_buff *skb)
 	}
 }
 
+/* Netdev TX queue SKB was sent from, NULL for non netdev traffic.
+ * Only STA/AP SKBs carry esp_skb_cb, BT SKBs hold bt_cb in skb->cb */
+static struct netdev_queue * esp_get_tx_queue(struct sk_buff *skb)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) skb->data;
+	struct esp_skb_cb *cb = (struct esp_skb_cb *) skb->cb;
+
+	if ((header->if_type != ESP_STA_IF) && (header->if_type != ESP_AP_IF))
+		return NULL;
+
+	if (!cb->priv || !cb->priv->ndev)
+		return NULL;
+
+	return netdev_get_tx_queue(cb->priv->ndev, skb_get_queue_mapping(skb));
+}
+
 int esp_is_tx_queue_paused(void)
 {
-	if ((adapter.priv[0]->ndev &&
-			!netif_queue_stopped((const struct net_device *)
-				adapter.priv[0]->ndev)) ||
-	    (adapter.priv[1]->ndev &&
-			!netif_queue_stopped((const struct net_device *)
-				adapter.priv[1]->ndev)))
-		return 1;
-	return 0;
+	return atomic_read(&tx_paused);
 }
 
-void esp_tx_pause(void)
+/* Transport TX queue is full. Only netdev queue of this SKB is stopped,
+ * so other interface and other access categories keep flowing */
+void esp_tx_pause(struct sk_buff *skb)
 {
-	if (adapter.priv[0]->ndev &&
-			!netif_queue_stopped((const struct net_device *)
-				adapter.priv[0]->ndev)) {
-		netif_stop_queue(adapter.priv[0]->ndev);
-	}
+	struct netdev_queue *txq = esp_get_tx_queue(skb);
 
-	if (adapter.priv[1]->ndev &&
-			!netif_queue_stopped((const struct net_device *)
-				adapter.priv[1]->ndev)) {
-		netif_stop_queue(adapter.priv[1]->ndev);
+	if (txq) {
+		netif_tx_stop_queue(txq);
+		atomic_set(&netdev_tx_paused, 1);
+	} else {
+		atomic_set(&tx_paused, 1);
 	}
 }
 
 void esp_tx_resume(void)
 {
-	if (adapter.priv[0]->ndev &&
-			netif_queue_stopped((const struct net_device *)
-				adapter.priv[0]->ndev)) {
-		netif_wake_queue(adapter.priv[0]->ndev);
-	}
+	u8 i;
+
+	atomic_set(&tx_paused, 0);
 
-	if (adapter.priv[1]->ndev &&
-			netif_queue_stopped((const struct net_device *)
-				adapter.priv[1]->ndev)) {
-		netif_wake_queue(adapter.priv[1]->ndev);
+	if (!atomic_xchg(&netdev_tx_paused, 0))
+		return;
+
+	for (i = 0; i < ESP_MAX_INTERFACE; i++) {
+		if (adapter.priv[i] && adapter.priv[i]->ndev &&
+				netif_running(adapter.priv[i]->ndev))
+			netif_tx_wake_all_queues(adapter.priv[i]->ndev);
 	}
 }
 
+/* Called by transport just before it queues SKB for TX, once it is sure
+ * not to drop it. Bytes stay accounted to BQL till esp_tx_completed() */
+void esp_tx_sent(struct sk_buff *skb)
+{
+	struct netdev_queue *txq = esp_get_tx_queue(skb);
+
+	if (txq)
+		netdev_tx_sent_queue(txq, skb->len);
+}
+
+/* Called by transport as SKB leaves its TX queue, from its single TX
+ * context only, for every SKB passed to esp_tx_sent(). BQL then limits
+ * bytes held in transport queues */
+void esp_tx_completed(struct sk_buff *skb)
+{
+	struct netdev_queue *txq = esp_get_tx_queue(skb);
+
+	if (txq)
+		netdev_tx_completed_queue(txq, 1, skb->len);
+}
+
 struct sk_buff * esp_alloc_skb(u32 len)
 {
 	struct sk_buff *skb = NULL;
@@ -550,19 +656,70 @@ struct sk_buff * esp_alloc_skb(u32 len)
 }
 
 
+static void esp_rx_napi_schedule(struct esp_adapter *adapter)
+{
+	if (skb_queue_empty(&adapter->rx_napi_q))
+		return;
+
+	/* Called from process context, let softirq run on bh enable */
+	local_bh_disable();
+	napi_schedule(&adapter->napi);
+	local_bh_enable();
+}
+
+static int esp_rx_napi_poll(struct napi_struct *napi, int budget)
+{
+	struct esp_adapter *adapter = container_of(napi, struct esp_adapter, napi);
+	struct esp_private *priv = NULL;
+	struct sk_buff *skb = NULL;
+	int work_done = 0;
+
+	while (work_done < budget) {
+		skb = skb_dequeue(&adapter->rx_napi_q);
+		if (!skb)
+			break;
+
+		priv = netdev_priv(skb->dev);
+		priv->stats.rx_bytes += skb->len;
+		priv->stats.rx_packets++;
+
+		napi_gro_receive(napi, skb);
+		work_done++;
+	}
+
+	if (work_done < budget) {
+		napi_complete_done(napi, work_done);
+
+		/* Frames queued after queue was found empty */
+		if (!skb_queue_empty(&adapter->rx_napi_q))
+			napi_schedule(napi);
+	}
+
+	return work_done;
+}
+
 static int esp_get_packets(struct esp_adapter *adapter)
 {
 	struct sk_buff *skb = NULL;
+	int count = 0;
 
 	if (!adapter || !adapter->if_ops || !adapter->if_ops->read)
 		return -EINVAL;
 
-	skb = adapter->if_ops->read(adapter);
+	/* Drain all packets available from transport. STA/AP frames get
+	 * queued for NAPI, which is kicked once per NAPI_POLL_WEIGHT frames */
+	while ((skb = adapter->if_ops->read(adapter))) {
+		process_rx_packet(skb);
 
-	if (!skb)
-		return -EFAULT;
+		if (skb_queue_len(&adapter->rx_napi_q) >= NAPI_POLL_WEIGHT)
+			esp_rx_napi_schedule(adapter);
+		count++;
+	}
+
+	esp_rx_napi_schedule(adapter);
 
-	process_rx_packet(skb);
+	if (!count)
+		return -EFAULT;
 
 	return 0;
 }
@@ -610,6 +767,8 @@ static int esp_init_priv(struct esp_private *priv, struct net_device *dev,
 	priv->link_state = ESP_LINK_DOWN;
 	priv->adapter = &adapter;
 	memset(&priv->stats, 0, sizeof(priv->stats));
+	memset(&priv->tx_stats, 0, sizeof(priv->tx_stats));
+	memset(&priv->drv_stats, 0, sizeof(priv->drv_stats));
 
 	return 0;
 }
@@ -625,8 +784,16 @@ static int esp_init_net_dev(struct net_device *ndev, struct esp_private *priv)
 
 	eth_hw_addr_set(ndev, priv->mac_address);
 	/* set ethtool ops */
+	ndev->ethtool_ops = &esp_ethtool_ops;
 
 	/* update features supported */
+	/* Fragmented SKBs are gathered in single copy by process_tx_packet */
+	ndev->features |= NETIF_F_SG;
+	ndev->hw_features |= NETIF_F_SG;
+
+	/* Let stack reserve room for payload header and its alignment pad */
+	ndev->needed_headroom = sizeof(struct esp_payload_header) +
+		SKB_DATA_ADDR_ALIGNMENT - 1;
 
 	/* min mtu */
 
@@ -649,10 +816,10 @@ static int esp_add_interface(struct esp_adapter *adapter, u8 if_type, u8 if_num,
 
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3, 17, 0))
 	ndev = alloc_netdev_mqs(sizeof(struct esp_private), name,
-			NET_NAME_ENUM, ether_setup, 1, 1);
+			NET_NAME_ENUM, ether_setup, ESP_DATA_Q_MAX, 1);
 #else
 	ndev = alloc_netdev_mqs(sizeof(struct esp_private), name,
-			ether_setup, 1, 1);
+			ether_setup, ESP_DATA_Q_MAX, 1);
 #endif
 
 	if (!ndev) {
@@ -685,14 +852,14 @@ error_exit:
 static void esp_remove_network_interfaces(struct esp_adapter *adapter)
 {
 	if (adapter->priv[0] && adapter->priv[0]->ndev) {
-		netif_stop_queue(adapter->priv[0]->ndev);
+		netif_tx_stop_all_queues(adapter->priv[0]->ndev);
 		unregister_netdev(adapter->priv[0]->ndev);
 		free_netdev(adapter->priv[0]->ndev);
 		adapter->priv[0] = NULL;
 	}
 
 	if (adapter->priv[1] && adapter->priv[1]->ndev) {
-		netif_stop_queue(adapter->priv[1]->ndev);
+		netif_tx_stop_all_queues(adapter->priv[1]->ndev);
 		unregister_netdev(adapter->priv[1]->ndev);
 		free_netdev(adapter->priv[1]->ndev);
 		adapter->priv[1] = NULL;
@@ -739,6 +906,12 @@ int esp_remove_card(struct esp_adapter *adapter)
 	if (adapter->if_rx_workqueue)
 		flush_workqueue(adapter->if_rx_workqueue);
 
+	/* Frames pending for NAPI refer to interfaces being removed */
+	if (adapter->napi_dev) {
+		napi_synchronize(&adapter->napi);
+		skb_queue_purge(&adapter->rx_napi_q);
+	}
+
 	esp_remove_network_interfaces(adapter);
 
 	esp_verbose("\n");
@@ -765,6 +938,15 @@ static void deinit_adapter(void)
 	if (adapter.if_rx_workqueue)
 		destroy_workqueue(adapter.if_rx_workqueue);
 
+	if (adapter.napi_dev) {
+		napi_disable(&adapter.napi);
+		netif_napi_del(&adapter.napi);
+		free_netdev_dummy(adapter.napi_dev);
+		adapter.napi_dev = NULL;
+	}
+
+	skb_queue_purge(&adapter.rx_napi_q);
+
 	esp_verbose("\n");
 }
 
@@ -811,6 +993,20 @@ static struct esp_adapter * init_adapter(void)
 
 	INIT_WORK(&adapter.if_rx_work, esp_if_rx_work);
 
+	/* NAPI is not tied to STA/AP netdev, as both share same transport */
+	skb_queue_head_init(&adapter.rx_napi_q);
+
+	adapter.napi_dev = alloc_netdev_dummy(0);
+
+	if (!adapter.napi_dev) {
+		esp_err("failed to allocate napi device\n");
+		deinit_adapter();
+		return NULL;
+	}
+
+	NETIF_NAPI_ADD(adapter.napi_dev, &adapter.napi, esp_rx_napi_poll);
+	napi_enable(&adapter.napi);
+
 	skb_queue_head_init(&adapter.events_skb_q);
 
 	adapter.events_wq = alloc_workqueue("ESP_EVENTS_WORKQUEUE", WQ_HIGHPRI, 0);
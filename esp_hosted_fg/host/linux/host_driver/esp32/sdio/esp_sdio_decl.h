@@ -22,6 +22,7 @@
 #define _ESP_DECL_H_
 
 #include "esp.h"
+#include "esp_tx_sched.h"
 
 /* Interrupt Status */
 #define ESP_SLAVE_BIT0_INT             BIT(0)
@@ -47,6 +48,9 @@
 #define ESP_TX_BUFFER_MAX              0x1000
 #define ESP_MAX_BUF_CNT                10
 
+/* Packets sent in one CMD53 write, each in its own ESP buffer */
+#define ESP_TX_BATCH_MAX               8
+
 #define ESP_SLAVE_SLCHOST_BASE         0x3FF55000
 
 #define ESP_SLAVE_SCRATCH_REG_7        (ESP_SLAVE_SLCHOST_BASE + 0x8C)
@@ -86,12 +90,24 @@
 #define ESP_DEVICE_ID_ESP32C6_1     0x6666
 #define ESP_DEVICE_ID_ESP32C6_2     0x7777
 
+/* Packets ESP may have queued to host at once, SDIO_SLAVE_QUEUE_SIZE at ESP */
+#define ESP_RX_QUEUED_MAX           20
+
+/* Packets read per interrupt are counted up to this, larger counts go in last bucket */
+#define ESP_RX_BATCH_HIST_MAX       16
+
 struct esp_sdio_context {
 	struct esp_adapter     *adapter;
 	struct sdio_func       *func;
 	struct sk_buff_head    tx_q[MAX_PRIORITY_QUEUES];
+	/* Network data, in place of tx_q[PRIO_Q_OTHERS] */
+	struct esp_tx_sched    data_q;
 	u32                    rx_byte_count;
 	u32                    tx_buffer_count;
+	/* Packets of a TX batch are copied here, ESP_RX_BUFFER_SIZE apart */
+	u8                     *tx_batch_buf;
+	/* Packets split out of last read, handed out before reading again */
+	struct sk_buff_head    rx_q;
 };
 
 #endif
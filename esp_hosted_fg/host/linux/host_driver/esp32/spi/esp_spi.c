@@ -35,6 +35,11 @@
 #define NUMBER_1M               1000000
 #define TX_MAX_PENDING_COUNT    100
 #define TX_RESUME_THRESHOLD     (TX_MAX_PENDING_COUNT/5)
+#define RX_POOL_SIZE            16
+/* Variable length transfer: payload headers are clocked first */
+#define SPI_VAR_LEN_HDR         sizeof(struct esp_payload_header)
+/* Rest of transfer is never empty, it is what ends transaction */
+#define SPI_VAR_LEN_MIN         (SPI_VAR_LEN_HDR + 4)
 
 /* ESP in sdkconfig has CONFIG_IDF_FIRMWARE_CHIP_ID entry.
  * supported values of CONFIG_IDF_FIRMWARE_CHIP_ID are - */
@@ -67,6 +72,12 @@ volatile u8 data_path = 0;
 static struct esp_spi_context spi_context;
 static char hardware_type = ESP_PRIV_FIRMWARE_CHIP_UNRECOGNIZED;
 static atomic_t tx_pending;
+static u64 rx_pool_hit;
+static u64 rx_pool_miss;
+/* Bus utilization: bytes clocked per direction vs packet bytes carried */
+static u64 bus_clocked_bytes;
+static u64 bus_tx_bytes;
+static u64 bus_rx_bytes;
 struct task_struct *spi_thread;
 struct semaphore spi_sem;
 u8 first_esp_bootup_over;
@@ -169,12 +180,13 @@ static int write_packet(struct esp_adapter *adapter, struct sk_buff *skb)
 		skb_queue_tail(&spi_context.tx_q[PRIO_Q_BT], skb);
 	} else {
 		if (atomic_read(&tx_pending) >= TX_MAX_PENDING_COUNT) {
-			esp_tx_pause();
+			esp_tx_pause(skb);
 			dev_kfree_skb(skb);
 			up(&spi_sem);
 			return -EBUSY;
 		}
-		skb_queue_tail(&spi_context.tx_q[PRIO_Q_OTHERS], skb);
+		esp_tx_sent(skb);
+		esp_tx_sched_enqueue(&spi_context.data_q, skb);
 		atomic_inc(&tx_pending);
 	}
 
@@ -196,12 +208,23 @@ int process_init_event(u8 *evt_buf, u8 len)
 		return -1;
 
 	pos = evt_buf;
+	adapter->capabilities = 0;
+	/* Older firmware checksums all queues */
+	adapter->checksum_prio_q_mask = ESP_CHECKSUM_ALL_PRIO_Q;
 
 	while (len_left) {
 		tag_len = *(pos + 1);
 		esp_info("EVENT: %d\n", *pos);
 		if (*pos == ESP_PRIV_CAPABILITY) {
-			adapter->capabilities = *(pos + 2);
+			adapter->capabilities |= *(pos + 2);
+		} else if (*pos == ESP_PRIV_CAPABILITY_EXT) {
+			/* Full capability mask, little endian */
+			adapter->capabilities |= (*(pos + 2)) |
+				(*(pos + 3) << 8) |
+				(*(pos + 4) << 16) |
+				(*(pos + 5) << 24);
+		} else if (*pos == ESP_PRIV_CHECKSUM_PRIO_Q) {
+			adapter->checksum_prio_q_mask = *(pos + 2);
 		} else if (*pos == ESP_PRIV_SPI_CLK_MHZ){
 			adjust_spi_clock(*(pos + 2));
 		} else if (*pos == ESP_PRIV_FIRMWARE_CHIP_ID){
@@ -230,6 +253,7 @@ int process_init_event(u8 *evt_buf, u8 len)
 			skb_queue_purge(&spi_context.tx_q[prio_q_idx]);
 			skb_queue_purge(&spi_context.rx_q[prio_q_idx]);
 		}
+		esp_tx_sched_purge(&spi_context.data_q);
 
 		esp_remove_card(spi_context.adapter);
 
@@ -237,6 +261,7 @@ int process_init_event(u8 *evt_buf, u8 len)
 			skb_queue_head_init(&spi_context.tx_q[prio_q_idx]);
 			skb_queue_head_init(&spi_context.rx_q[prio_q_idx]);
 		}
+		esp_tx_sched_init(&spi_context.data_q);
 	}
 
 	ret = esp_add_card(spi_context.adapter);
@@ -254,26 +279,24 @@ int process_init_event(u8 *evt_buf, u8 len)
 }
 
 
-static int process_rx_buf(struct sk_buff *skb)
+/* Validate packet at 'header' and return its total length (header + payload).
+ * 'room' is the space left in the transfer from 'header' onwards.
+ * Returns 0 if packet is not valid */
+static u16 get_rx_pkt_len(struct esp_payload_header *header, u16 room)
 {
-	struct esp_payload_header *header;
 	u16 len = 0;
 	u16 offset = 0;
 
-	if (!skb)
-		return -EINVAL;
-
-	header = (struct esp_payload_header *) skb->data;
-
-	esp_hex_dump_dbg("spi_rx: ", skb->data , min(skb->len, 32));
+	if (room < sizeof(struct esp_payload_header))
+		return 0;
 
 	if (header->if_type >= ESP_MAX_IF) {
-		return -EINVAL;
+		return 0;
 	}
 
 	len = le16_to_cpu(header->len);
 	if (!len) {
-		return -EINVAL;
+		return 0;
 	}
 
 	offset = le16_to_cpu(header->offset);
@@ -282,26 +305,23 @@ static int process_rx_buf(struct sk_buff *skb)
 	if (offset != sizeof(struct esp_payload_header)) {
 		esp_err("offset_rcv[%d] != exp[%d], drop\n",
 				(int)offset, (int)sizeof(struct esp_payload_header));
-		esp_hex_dump_dbg("wrong offset: ", skb->data , min(skb->len, 32));
-		return -EINVAL;
+		esp_hex_dump_dbg("wrong offset: ", header, 32);
+		return 0;
 	}
 
-
 	len += sizeof(struct esp_payload_header);
-	if (len > SPI_BUF_SIZE) {
-		esp_info("len[%u] > max[%u], drop\n", len, SPI_BUF_SIZE);
-		esp_hex_dump_dbg("wrong len: ", skb->data , 8);
-		return -EINVAL;
+	if (len > room) {
+		esp_info("len[%u] > max[%u], drop\n", len, room);
+		esp_hex_dump_dbg("wrong len: ", header, 8);
+		return 0;
 	}
 
-	/* Trim SKB to actual size */
-	skb_trim(skb, len);
-
+	return len;
+}
 
-	if (!data_path) {
-		esp_verbose("datapath closed\n");
-		return -EPERM;
-	}
+static void enqueue_rx_skb(struct sk_buff *skb)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) skb->data;
 
 	/* enqueue skb for read_packet to pick it */
 	if (header->if_type == ESP_SERIAL_IF)
@@ -310,18 +330,309 @@ static int process_rx_buf(struct sk_buff *skb)
 		skb_queue_tail(&spi_context.rx_q[PRIO_Q_BT], skb);
 	else
 		skb_queue_tail(&spi_context.rx_q[PRIO_Q_OTHERS], skb);
+}
+
+static int process_rx_buf(struct sk_buff *skb)
+{
+	struct esp_payload_header *header;
+	struct sk_buff *pkt_skb;
+	u16 len = 0;
+	u16 pos = 0;
+	u16 room = 0;
+	int queued = 0;
+	int ret = 0;
+
+	if (!skb)
+		return -EINVAL;
+
+	/* Only as much as was clocked */
+	room = skb->len;
+
+	esp_hex_dump_dbg("spi_rx: ", skb->data , min(skb->len, 32));
+
+	if (!get_rx_pkt_len((struct esp_payload_header *) skb->data, room))
+		return -EINVAL;
+
+	if (!data_path) {
+		esp_verbose("datapath closed\n");
+		return -EPERM;
+	}
+
+	/* ESP may pack multiple packets in one transfer, each at 4 byte aligned
+	 * position, with MORE_PKT_IN_AGGR set on all but the last one.
+	 * Leading packets are copied out, last one is handed over in rx skb */
+	while (1) {
+		header = (struct esp_payload_header *) (skb->data + pos);
+		len = get_rx_pkt_len(header, room - pos);
+		if (!len) {
+			ret = -EINVAL;
+			break;
+		}
+		bus_rx_bytes += len;
+
+		if (!(header->flags & MORE_PKT_IN_AGGR) ||
+		    (ESP_AGGR_ALIGN(pos + len) >= room)) {
+			/* Trim SKB to actual size */
+			skb_pull(skb, pos);
+			skb_trim(skb, len);
+			enqueue_rx_skb(skb);
+			queued++;
+			break;
+		}
+
+		pkt_skb = esp_alloc_skb(len);
+		if (!pkt_skb) {
+			esp_err("Failed to allocate SKB for aggregated pkt\n");
+			ret = -ENOMEM;
+			break;
+		}
+
+		memcpy(skb_put(pkt_skb, len), header, len);
+		enqueue_rx_skb(pkt_skb);
+		queued++;
+
+		pos = ESP_AGGR_ALIGN(pos + len);
+	}
 
 	/* indicate reception of new packet */
-	esp_process_new_packet_intr(spi_context.adapter);
+	if (queued)
+		esp_process_new_packet_intr(spi_context.adapter);
 
-	return 0;
+	return ret;
+}
+
+/* RX skb for one transaction, of SPI_BUF_SIZE length.
+ * Transactions carrying nothing for host hand their skb back to pool, so
+ * only those passed up the stack need fresh allocation */
+static struct sk_buff *rx_pool_get(void)
+{
+	struct sk_buff *skb = skb_dequeue(&spi_context.rx_pool);
+
+	if (skb) {
+		rx_pool_hit++;
+		return skb;
+	}
+
+	rx_pool_miss++;
+	skb = esp_alloc_skb(SPI_BUF_SIZE);
+	if (skb)
+		skb_put(skb, SPI_BUF_SIZE);
+
+	return skb;
+}
+
+/* Return RX skb not handed over by process_rx_buf() */
+static void rx_pool_put(struct sk_buff *skb)
+{
+	if (skb_queue_len(&spi_context.rx_pool) >= RX_POOL_SIZE) {
+		dev_kfree_skb(skb);
+		return;
+	}
+
+	/* Transfer may have been shorter than buffer */
+	skb_put(skb, SPI_BUF_SIZE - skb->len);
+
+	/* Most recently used first, while still cache hot */
+	skb_queue_head(&spi_context.rx_pool, skb);
+}
+
+static void tx_skb_dequeued(struct sk_buff *skb)
+{
+	esp_tx_completed(skb);
+
+	if (atomic_read(&tx_pending))
+		atomic_dec(&tx_pending);
+
+	if (atomic_read(&tx_pending) < TX_RESUME_THRESHOLD) {
+		esp_tx_resume();
+#if TEST_RAW_TP
+		esp_raw_tp_queue_resume();
+#endif
+	}
+}
+
+static u16 get_tx_pkt_len(struct sk_buff *skb)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) skb->data;
+
+	return le16_to_cpu(header->offset) + le16_to_cpu(header->len);
+}
+
+/* Dequeue head of highest priority non-empty tx queue, only if it fits in
+ * 'room'. Lower priority queues are not looked at, to retain ordering.
+ * Network data queues are served by weight among themselves */
+static struct sk_buff *dequeue_tx_skb(u16 room, u8 *prio_q_idx)
+{
+	struct sk_buff_head *q;
+	struct sk_buff *skb = NULL;
+	unsigned long flags;
+	u8 i;
+
+	for (i = 0; i < PRIO_Q_OTHERS; i++) {
+		q = &spi_context.tx_q[i];
+
+		spin_lock_irqsave(&q->lock, flags);
+		skb = skb_peek(q);
+		if (skb) {
+			if (get_tx_pkt_len(skb) <= room)
+				__skb_unlink(skb, q);
+			else
+				skb = NULL;
+			spin_unlock_irqrestore(&q->lock, flags);
+			*prio_q_idx = i;
+			return skb;
+		}
+		spin_unlock_irqrestore(&q->lock, flags);
+	}
+
+	*prio_q_idx = PRIO_Q_OTHERS;
+	return esp_tx_sched_dequeue(&spi_context.data_q, room);
+}
+
+/* If ESP supports it, pack more pending tx packets after 'skb' within same
+ * SPI_BUF_SIZE transfer. Returns skb to be transmitted */
+static struct sk_buff *aggregate_tx_skbs(struct sk_buff *skb)
+{
+	struct esp_payload_header *header;
+	struct sk_buff *aggr_skb, *next_skb;
+	u16 pos, len;
+	u8 prio_q_idx = 0;
+	u8 *buf;
+
+	if (!(spi_context.adapter->capabilities & ESP_SPI_AGGREGATION))
+		return skb;
+
+	len = get_tx_pkt_len(skb);
+	pos = ESP_AGGR_ALIGN(len);
+	if (pos + sizeof(struct esp_payload_header) >= SPI_BUF_SIZE)
+		return skb;
+
+	next_skb = dequeue_tx_skb(SPI_BUF_SIZE - pos, &prio_q_idx);
+	if (!next_skb)
+		return skb;
+
+	aggr_skb = esp_alloc_skb(SPI_BUF_SIZE);
+	if (!aggr_skb) {
+		if (prio_q_idx == PRIO_Q_OTHERS)
+			esp_tx_sched_requeue(&spi_context.data_q, next_skb);
+		else
+			skb_queue_head(&spi_context.tx_q[prio_q_idx], next_skb);
+		return skb;
+	}
+
+	buf = skb_put(aggr_skb, SPI_BUF_SIZE);
+	memset(buf, 0, SPI_BUF_SIZE);
+
+	memcpy(buf, skb->data, len);
+	dev_kfree_skb(skb);
+	header = (struct esp_payload_header *) buf;
+
+	do {
+		/* Checksum is plain byte sum, account for newly set flag */
+		header->flags |= MORE_PKT_IN_AGGR;
+		if (esp_is_checksum_enabled(spi_context.adapter, header->if_type))
+			header->checksum = cpu_to_le16(le16_to_cpu(header->checksum) +
+					MORE_PKT_IN_AGGR);
+
+		len = get_tx_pkt_len(next_skb);
+		memcpy(buf + pos, next_skb->data, len);
+		header = (struct esp_payload_header *) (buf + pos);
+		pos = ESP_AGGR_ALIGN(pos + len);
+
+		tx_skb_dequeued(next_skb);
+		dev_kfree_skb(next_skb);
+
+		if (pos + sizeof(struct esp_payload_header) >= SPI_BUF_SIZE)
+			break;
+
+		next_skb = dequeue_tx_skb(SPI_BUF_SIZE - pos, &prio_q_idx);
+	} while (next_skb);
+
+	/* Buffer stays SPI_BUF_SIZE, length is what is used of it */
+	skb_trim(aggr_skb, pos);
+
+	return aggr_skb;
+}
+
+/* Full duplex, so each clocked byte could carry one byte either way */
+static void print_bus_stats(void)
+{
+	u64 used = bus_tx_bytes + bus_rx_bytes;
+
+	if (!bus_clocked_bytes)
+		return;
+
+	esp_info("spi bus: clocked %llu bytes, carried tx %llu rx %llu, utilization %llu%%\n",
+			bus_clocked_bytes, bus_tx_bytes, bus_rx_bytes,
+			div64_u64(used * 100, bus_clocked_bytes * 2));
+}
+
+/* Announce length of data in transfer, in first payload header */
+static void set_tx_xfer_len(struct sk_buff *skb)
+{
+	struct esp_payload_header *header = (struct esp_payload_header *) skb->data;
+
+	header->xfer_len = DIV_ROUND_UP(skb->len, ESP_SPI_XFER_LEN_UNIT);
+
+	/* Checksum is plain byte sum, account for newly set field */
+	if (esp_is_checksum_enabled(spi_context.adapter, header->if_type))
+		header->checksum = cpu_to_le16(le16_to_cpu(header->checksum) +
+				header->xfer_len);
+}
+
+/* Variable length transfer, with chip select held throughout.
+ * Payload headers are clocked first. Rest is clocked only as far as needed
+ * for longer of host data and ESP data, as announced in ESP header.
+ * Returns number of bytes clocked, or negative error */
+static int spi_var_len_transfer(const void *tx_buf, u8 *rx_buf, u16 tx_len)
+{
+	struct spi_device *spi = spi_context.esp_spi_dev;
+	struct esp_payload_header *header = (struct esp_payload_header *) rx_buf;
+	struct spi_transfer trans;
+	struct spi_message msg;
+	u16 len = 0;
+	int ret = 0;
+
+	spi_bus_lock(SPI_CONTROLLER(spi));
+
+	memset(&trans, 0, sizeof(trans));
+	trans.speed_hz = spi_context.spi_clk_mhz * NUMBER_1M;
+	trans.tx_buf = tx_buf;
+	trans.rx_buf = rx_buf;
+	trans.len = SPI_VAR_LEN_HDR;
+	/* Keep chip select asserted after this message */
+	trans.cs_change = 1;
+
+	spi_message_init(&msg);
+	spi_message_add_tail(&trans, &msg);
+	ret = spi_sync_locked(spi, &msg);
+	if (ret)
+		goto unlock;
+
+	len = max_t(u16, tx_len, header->xfer_len * ESP_SPI_XFER_LEN_UNIT);
+	len = clamp_t(u16, ESP_AGGR_ALIGN(len), SPI_VAR_LEN_MIN, SPI_BUF_SIZE);
+
+	trans.tx_buf = (const u8 *) tx_buf + SPI_VAR_LEN_HDR;
+	trans.rx_buf = rx_buf + SPI_VAR_LEN_HDR;
+	trans.len = len - SPI_VAR_LEN_HDR;
+	trans.cs_change = 0;
+
+	spi_message_init(&msg);
+	spi_message_add_tail(&trans, &msg);
+	ret = spi_sync_locked(spi, &msg);
+
+unlock:
+	spi_bus_unlock(SPI_CONTROLLER(spi));
+
+	return ret ? ret : len;
 }
 
 static void esp_spi_transaction(void)
 {
 	struct spi_transfer trans;
 	struct sk_buff *tx_skb = NULL, *rx_skb = NULL;
-	u8 *rx_buf;
+	u8 var_len = !!(spi_context.adapter->capabilities & ESP_SPI_VAR_LEN);
+	u16 tx_len = 0;
 	int ret = 0;
 	volatile int trans_ready, rx_pending;
 
@@ -336,17 +647,11 @@ static void esp_spi_transaction(void)
 			if (!tx_skb)
 				tx_skb = skb_dequeue(&spi_context.tx_q[PRIO_Q_BT]);
 			if (!tx_skb)
-				tx_skb = skb_dequeue(&spi_context.tx_q[PRIO_Q_OTHERS]);
+				tx_skb = esp_tx_sched_dequeue(&spi_context.data_q,
+						SPI_BUF_SIZE);
 			if (tx_skb) {
-				if (atomic_read(&tx_pending))
-					atomic_dec(&tx_pending);
-
-				if (atomic_read(&tx_pending) < TX_RESUME_THRESHOLD) {
-					esp_tx_resume();
-#if TEST_RAW_TP
-					esp_raw_tp_queue_resume();
-#endif
-				}
+				tx_skb_dequeued(tx_skb);
+				tx_skb = aggregate_tx_skbs(tx_skb);
 			}
 		}
 
@@ -358,46 +663,62 @@ static void esp_spi_transaction(void)
 			 * 	Tx_buf: Check if tx_q has valid buffer for transmission,
 			 * 		else keep it blank
 			 *
-			 * 	Rx_buf: Allocate memory for incoming data. This will be freed
+			 * 	Rx_buf: Take buffer from rx pool. This goes back to pool
 			 *		immediately if received buffer is invalid.
 			 *		If it is a valid buffer, upper layer will free it.
 			 * */
 
+			/* Configure RX buffer. Clocked part of it is overwritten */
+			rx_skb = rx_pool_get();
+			if (!rx_skb) {
+				esp_err("Failed to allocate RX buffer\n");
+				if (tx_skb)
+					dev_kfree_skb(tx_skb);
+				mutex_unlock(&spi_lock);
+				return;
+			}
+
 			/* Configure TX buffer if available */
 
 			if (tx_skb) {
+				tx_len = tx_skb->len;
+				if (var_len)
+					set_tx_xfer_len(tx_skb);
 				trans.tx_buf = tx_skb->data;
 				esp_hex_dump_dbg("spi_tx: ", trans.tx_buf, 32);
 			} else {
-				tx_skb = esp_alloc_skb(SPI_BUF_SIZE);
-				trans.tx_buf = skb_put(tx_skb, SPI_BUF_SIZE);
-				memset((void*)trans.tx_buf, 0, SPI_BUF_SIZE);
+				trans.tx_buf = spi_context.tx_dummy_buf;
 			}
 
-			/* Configure RX buffer */
-			rx_skb = esp_alloc_skb(SPI_BUF_SIZE);
-			rx_buf = skb_put(rx_skb, SPI_BUF_SIZE);
-
-			memset(rx_buf, 0, SPI_BUF_SIZE);
-
-			trans.rx_buf = rx_buf;
-			trans.len = SPI_BUF_SIZE;
+			if (var_len) {
+				ret = spi_var_len_transfer(trans.tx_buf, rx_skb->data, tx_len);
+			} else {
+				trans.rx_buf = rx_skb->data;
+				trans.len = SPI_BUF_SIZE;
 
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3, 15, 0))
-			if (hardware_type == ESP_PRIV_FIRMWARE_CHIP_ESP32) {
-				trans.cs_change = 1;
-			}
+				if (hardware_type == ESP_PRIV_FIRMWARE_CHIP_ESP32) {
+					trans.cs_change = 1;
+				}
 #endif
-			ret = spi_sync_transfer(spi_context.esp_spi_dev, &trans, 1);
-			if (ret) {
+				ret = spi_sync_transfer(spi_context.esp_spi_dev, &trans, 1);
+				if (!ret)
+					ret = SPI_BUF_SIZE;
+			}
+
+			if (ret < 0) {
 				esp_err("SPI Transaction failed: %d\n", ret);
-				dev_kfree_skb(rx_skb);
-				dev_kfree_skb(tx_skb);
+				rx_pool_put(rx_skb);
+				if (tx_skb)
+					dev_kfree_skb(tx_skb);
 			} else {
+				bus_clocked_bytes += ret;
+				bus_tx_bytes += tx_len;
+				skb_trim(rx_skb, ret);
 
-				/* Free rx_skb if received data is not valid */
+				/* Recycle rx_skb if received data is not valid */
 				if (process_rx_buf(rx_skb)) {
-					dev_kfree_skb(rx_skb);
+					rx_pool_put(rx_skb);
 				}
 
 				if (tx_skb)
@@ -601,7 +922,15 @@ static int spi_init(void)
 		skb_queue_head_init(&spi_context.tx_q[prio_q_idx]);
 		skb_queue_head_init(&spi_context.rx_q[prio_q_idx]);
 	}
+	esp_tx_sched_init(&spi_context.data_q);
+	skb_queue_head_init(&spi_context.rx_pool);
 
+	spi_context.tx_dummy_buf = kzalloc(SPI_BUF_SIZE, GFP_KERNEL);
+	if (!spi_context.tx_dummy_buf) {
+		spi_exit();
+		esp_err("Failed to allocate dummy TX buffer\n");
+		return -ENOMEM;
+	}
 
 	status = spi_dev_init(spi_context.spi_clk_mhz);
 	if (status) {
@@ -645,6 +974,7 @@ static void spi_exit(void)
 		skb_queue_purge(&spi_context.tx_q[prio_q_idx]);
 		skb_queue_purge(&spi_context.rx_q[prio_q_idx]);
 	}
+	esp_tx_sched_purge(&spi_context.data_q);
 
 	up(&spi_sem);
 	if (spi_thread) {
@@ -652,6 +982,12 @@ static void spi_exit(void)
 		spi_thread = NULL;
 	}
 
+	esp_info("spi rx pool: hit %llu miss %llu\n", rx_pool_hit, rx_pool_miss);
+	print_bus_stats();
+	skb_queue_purge(&spi_context.rx_pool);
+	kfree(spi_context.tx_dummy_buf);
+	spi_context.tx_dummy_buf = NULL;
+
 	esp_remove_card(spi_context.adapter);
 
 	if (test_bit(ESP_SPI_GPIO_HS_IRQ_DONE, &spi_context.spi_flags)) {
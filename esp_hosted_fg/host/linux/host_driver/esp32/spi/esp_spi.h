@@ -19,6 +19,7 @@
 #define _ESP_SPI_H_
 
 #include "esp.h"
+#include "esp_tx_sched.h"
 
 #define HANDSHAKE_PIN           22
 #define SPI_IRQ                 gpio_to_irq(HANDSHAKE_PIN)
@@ -40,7 +41,13 @@ struct esp_spi_context {
 	struct esp_adapter          *adapter;
 	struct spi_device           *esp_spi_dev;
 	struct sk_buff_head         tx_q[MAX_PRIORITY_QUEUES];
+	/* Network data, in place of tx_q[PRIO_Q_OTHERS] */
+	struct esp_tx_sched         data_q;
 	struct sk_buff_head         rx_q[MAX_PRIORITY_QUEUES];
+	/* Free SPI_BUF_SIZE RX skbs, reused across transactions */
+	struct sk_buff_head         rx_pool;
+	/* Zeroes, clocked out when there is nothing to send */
+	u8                          *tx_dummy_buf;
 	struct workqueue_struct     *spi_workqueue;
 	struct work_struct          spi_work;
 	enum context_state          state;
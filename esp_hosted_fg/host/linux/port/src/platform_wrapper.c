@@ -23,21 +23,21 @@
 #define SUCCESS                 0
 #define FAILURE                 -1
 #define DUMMY_READ_BUF_LEN      64
+/* Initial size of serial read buffer, grown on demand for larger frame */
+#define SERIAL_RX_BUF_LEN       4096
 #define EAGAIN                  11
 
-#define HOSTED_CALLOC(buff,nbytes) do {                           \
-    buff = (uint8_t *)hosted_calloc(1, nbytes);                   \
-    if (!buff) {                                                  \
-        printf("%s, Failed to allocate memory \n", __func__);     \
-        goto free_bufs;                                           \
-    }                                                             \
-} while(0);
-
 #define thread_handle_t pthread_t
 #define semaphore_handle_t sem_t
 
 struct serial_drv_handle_t {
 	int file_desc;
+	/* Data read from driver, not yet handed over
+	 * is rx_buf[rx_head] to rx_buf[rx_tail - 1] */
+	uint8_t *rx_buf;
+	uint32_t rx_buf_size;
+	uint32_t rx_head;
+	uint32_t rx_tail;
 };
 
 extern int errno;
@@ -148,6 +148,9 @@ int control_path_platform_init(struct serial_drv_handle_t* serial_drv_handle)
 
 	mem_free(buf);
 
+	/* Anything buffered earlier is stale too */
+	serial_drv_handle->rx_head = serial_drv_handle->rx_tail = 0;
+
 	/* set to blocking: expected behaviour of read() in the rx thread */
 	if (SUCCESS != set_read_access_nonblocking(serial_drv_handle, false)) {
 		printf("%s: failed to set_read_access back to blocking\n", __func__);
@@ -397,6 +400,14 @@ int hosted_timer_stop(void *timer_handle)
 	return FAILURE;
 }
 
+uint64_t hosted_get_time_ms(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
 /* Sample timer_handler looks like this:
  *
  * void expired(union sigval timer_data){
@@ -497,6 +508,14 @@ struct serial_drv_handle_t* serial_drv_open(const char *transport)
 		return NULL;
 	}
 
+	serial_drv_handle->rx_buf_size = SERIAL_RX_BUF_LEN;
+	serial_drv_handle->rx_buf = (uint8_t *)hosted_malloc(SERIAL_RX_BUF_LEN);
+	if (!serial_drv_handle->rx_buf) {
+		printf("%s, Failed to allocate memory \n",__func__);
+		mem_free(serial_drv_handle);
+		return NULL;
+	}
+
 	serial_drv_handle->file_desc = open(transport, O_RDWR);
 	if (serial_drv_handle->file_desc == -1) {
 		int errsv = errno;
@@ -513,6 +532,7 @@ struct serial_drv_handle_t* serial_drv_open(const char *transport)
 				break;
 			}
 		}
+		mem_free(serial_drv_handle->rx_buf);
 		mem_free(serial_drv_handle);
 		return NULL;
 	}
@@ -523,6 +543,8 @@ struct serial_drv_handle_t* serial_drv_open(const char *transport)
 int serial_drv_write (struct serial_drv_handle_t *serial_drv_handle,
 		uint8_t *buf, int in_count, int *out_count)
 {
+	int count = 0, written = 0;
+
 	if (!serial_drv_handle ||
 	    serial_drv_handle->file_desc < 0 ||
 	    !buf || !in_count || !out_count) {
@@ -530,11 +552,25 @@ int serial_drv_write (struct serial_drv_handle_t *serial_drv_handle,
 		goto free_bufs;
 	}
 
-	*out_count = write(serial_drv_handle->file_desc, buf, in_count);
-	if (*out_count <= 0) {
-		perror("write: ");
-		goto free_bufs;
+	/* fd is non blocking in event loop mode, write may be partial */
+	while (written < in_count) {
+		count = write(serial_drv_handle->file_desc,
+				buf + written, in_count - written);
+		if ((count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+			fd_set wfds;
+
+			FD_ZERO(&wfds);
+			FD_SET(serial_drv_handle->file_desc, &wfds);
+			select(serial_drv_handle->file_desc + 1, NULL, &wfds, NULL, NULL);
+			continue;
+		}
+		if (count <= 0) {
+			perror("write: ");
+			goto free_bufs;
+		}
+		written += count;
 	}
+	*out_count = written;
 	mem_free(buf);
 	return SUCCESS;
 
@@ -543,6 +579,21 @@ free_bufs:
 	return FAILURE;
 }
 
+int serial_drv_get_poll_fd(struct serial_drv_handle_t *serial_drv_handle)
+{
+	if (!serial_drv_handle ||
+	    serial_drv_handle->file_desc < 0) {
+		return FAILURE;
+	}
+
+	if (SUCCESS != set_read_access_nonblocking(serial_drv_handle, true)) {
+		printf("%s: failed to set_read_access to nonblocking\n", __func__);
+		return FAILURE;
+	}
+
+	return serial_drv_handle->file_desc;
+}
+
 int serial_drv_close(struct serial_drv_handle_t **serial_drv_handle)
 {
 	if (!serial_drv_handle ||
@@ -550,6 +601,7 @@ int serial_drv_close(struct serial_drv_handle_t **serial_drv_handle)
 	    (*serial_drv_handle)->file_desc < 0) {
 		return FAILURE;
 	}
+	mem_free((*serial_drv_handle)->rx_buf);
 	if(close((*serial_drv_handle)->file_desc) < 0) {
 		perror("close:");
 		mem_free(*serial_drv_handle);
@@ -561,30 +613,34 @@ int serial_drv_close(struct serial_drv_handle_t **serial_drv_handle)
 	return SUCCESS;
 }
 
-/* This whole processing of two step parsing TLV is common for MPU and MCU
+/* This whole processing of TLV parsing is common for MPU and MCU
  * and ideally this processing should have been done in serial_if.c.
  * But the problem is there is difference in reading in MPU and MCU.
  * For MPU, it is straight forward, read on character driver file and
  * partial reads are supported.
  * But For MCU, the problem is it doesn't have that capability and gets complete
  * serial buffer on transport.
- * To keep it simple, two step parsing TLV buffer is kept in platform specific code
+ * To keep it simple, TLV parsing is kept in platform specific code
+ *
+ * For MPU, whatever driver has is read in single read() into rx_buf,
+ * which may hold multiple frames. Frames are handed over one per call
+ * from rx_buf itself, no allocation or copy is done per frame.
  */
 uint8_t * serial_drv_read(struct serial_drv_handle_t *serial_drv_handle,
 		uint32_t *out_nbyte)
 {
-	int ret = 0, count = 0, total_read_len = 0;
+	int count = 0;
 	const char* ep_name = CTRL_EP_NAME_RESP;
-	uint16_t init_read_len = SIZE_OF_TYPE + SIZE_OF_LENGTH + strlen(ep_name) +
+	uint32_t init_read_len = SIZE_OF_TYPE + SIZE_OF_LENGTH + strlen(ep_name) +
 		SIZE_OF_TYPE + SIZE_OF_LENGTH;
-	uint8_t init_read_buf[init_read_len];
-	uint8_t *buf = NULL;
+	uint32_t frame_len = 0, avail = 0;
 	uint32_t buf_len = 0;
+	uint8_t *frame = NULL;
 	/* Any of `CTRL_EP_NAME_EVENT` and `CTRL_EP_NAME_RESP` could be used,
 	 * as both have same strlen in adapter.h */
 
 /*
- * Read fixed length of received data in below format:
+ * Each frame starts with fixed length header in below format:
  * ----------------------------------------------------------------------------
  *  Endpoint Type | Endpoint Length | Endpoint Value  | Data Type | Data Length
  * ----------------------------------------------------------------------------
@@ -593,70 +649,80 @@ uint8_t * serial_drv_read(struct serial_drv_handle_t *serial_drv_handle,
  *  ---------------------------------------------------------------------------
  *      1         |       2         | Endpoint Length |     1     |     2     |
  *  ---------------------------------------------------------------------------
+ * followed by `Data Length` bytes of protobuf encoded data
  */
 
 	if (!serial_drv_handle ||
 	    serial_drv_handle->file_desc < 0 ||
+	    !serial_drv_handle->rx_buf ||
 	    !out_nbyte) {
 		printf("%s:%u Invalid parameter\n",__func__,__LINE__);
 		return NULL;
 	}
 
-	memset(init_read_buf, 0, sizeof(init_read_buf));
+	*out_nbyte = 0;
 
-	total_read_len = 0;
-	do {
-		count = read(serial_drv_handle->file_desc,
-				(init_read_buf+total_read_len), (init_read_len-total_read_len));
-		if (count <= 0) {
-			perror("read fail:");
-			printf("Exp read of %u bytes: ret[%d]\n",
-					(init_read_len-total_read_len), count);
-			goto free_bufs;
+	while (1) {
+		avail = serial_drv_handle->rx_tail - serial_drv_handle->rx_head;
+		frame = serial_drv_handle->rx_buf + serial_drv_handle->rx_head;
+		frame_len = init_read_len;
+
+		if (avail >= init_read_len) {
+			if ((parse_tlv(frame, &buf_len) != SUCCESS) || !buf_len) {
+				/* Out of sync with sender, drop what is buffered */
+				serial_drv_handle->rx_head = serial_drv_handle->rx_tail = 0;
+				return NULL;
+			}
+
+			frame_len = init_read_len + buf_len;
+			if (avail >= frame_len) {
+				/* Complete frame available */
+				serial_drv_handle->rx_head += frame_len;
+				if (serial_drv_handle->rx_head == serial_drv_handle->rx_tail)
+					serial_drv_handle->rx_head = serial_drv_handle->rx_tail = 0;
+
+				*out_nbyte = buf_len;
+				return frame + init_read_len;
+			}
 		}
-		total_read_len += count;
-	} while (total_read_len < init_read_len);
 
-	if (total_read_len != init_read_len) {
-		printf("%s, read_bytes exp[%d] vs recvd[%d]\n"
-				,__func__, init_read_len, total_read_len);
-		goto free_bufs;
-	}
+		/* Partial frame. Move it to start, as frame handed over in
+		 * previous call is done with, and make room for complete frame */
+		if (serial_drv_handle->rx_head) {
+			memmove(serial_drv_handle->rx_buf, frame, avail);
+			serial_drv_handle->rx_head = 0;
+			serial_drv_handle->rx_tail = avail;
+		}
 
-	ret = parse_tlv(init_read_buf, &buf_len);
-	if ((ret != SUCCESS) || !buf_len) {
-		goto free_bufs;
-	}
+		if (frame_len > serial_drv_handle->rx_buf_size) {
+			uint8_t *new_buf = (uint8_t *)realloc(
+					serial_drv_handle->rx_buf, frame_len);
 
-	/*
-	 * Read variable length of received data.
-	 * Variable length is obtained after
-	 * parsing of previously read data.
-	 */
-	HOSTED_CALLOC(buf,buf_len);
+			if (!new_buf) {
+				printf("%s, Failed to allocate memory \n", __func__);
+				serial_drv_handle->rx_head = serial_drv_handle->rx_tail = 0;
+				return NULL;
+			}
+			serial_drv_handle->rx_buf = new_buf;
+			serial_drv_handle->rx_buf_size = frame_len;
+		}
 
-	total_read_len = 0;
-	do {
 		count = read(serial_drv_handle->file_desc,
-				(buf+total_read_len), (buf_len-total_read_len));
+				serial_drv_handle->rx_buf + serial_drv_handle->rx_tail,
+				serial_drv_handle->rx_buf_size - serial_drv_handle->rx_tail);
+		if ((count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+			/* Non blocking reads, rest of frame not arrived yet */
+			return NULL;
+		}
 		if (count <= 0) {
-			perror("Fail to read serial data");
-			break;
+			perror("read fail:");
+			printf("Exp read of upto %u bytes: ret[%d]\n",
+					serial_drv_handle->rx_buf_size - serial_drv_handle->rx_tail,
+					count);
+			return NULL;
 		}
-		total_read_len += count;
-	} while (total_read_len < buf_len);
-
-	if (total_read_len != buf_len) {
-		printf("%s, Exp num_bytes[%d] != recvd[%d]\n",
-				__func__, buf_len, total_read_len);
-		goto free_bufs;
+		serial_drv_handle->rx_tail += count;
 	}
 
-	*out_nbyte = buf_len;
-	return buf;
-
-free_bufs:
-	mem_free(buf);
-	*out_nbyte = 0;
 	return NULL;
 }
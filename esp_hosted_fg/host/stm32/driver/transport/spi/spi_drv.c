@@ -459,7 +459,10 @@ static stm_ret_t spi_transaction_v1(uint8_t * txbuff)
 			} else {
 				rx_checksum = le16toh(payload_header->checksum);
 				payload_header->checksum = 0;
-				checksum = compute_checksum(rxbuff, len+offset);
+				if (is_checksum_enabled(payload_header->if_type))
+					checksum = compute_checksum(rxbuff, len+offset);
+				else
+					checksum = rx_checksum;
 				if (checksum == rx_checksum) {
 					buf_handle.priv_buffer_handle = rxbuff;
 					buf_handle.free_buf_handle = free;
@@ -590,7 +593,10 @@ static stm_ret_t spi_transaction_v2(uint8_t * txbuff)
 				rx_checksum = le16toh(payload_header->checksum);
 				payload_header->checksum = 0;
 
-				checksum = compute_checksum(rxbuff, len+offset);
+				if (is_checksum_enabled(payload_header->if_type))
+					checksum = compute_checksum(rxbuff, len+offset);
+				else
+					checksum = rx_checksum;
 
 				if (checksum == rx_checksum) {
 					buf_handle.priv_buffer_handle = rxbuff;
@@ -819,8 +825,9 @@ static uint8_t * get_tx_buffer(uint8_t *is_valid_tx_buf)
 		payload_header->if_type = buf_handle.if_type;
 		payload_header->if_num  = buf_handle.if_num;
 		memcpy(payload, buf_handle.payload, min(len, MAX_PAYLOAD_SIZE));
-		payload_header->checksum = htole16(compute_checksum(sendbuf,
-				sizeof(struct esp_payload_header)+len));;
+		if (is_checksum_enabled(payload_header->if_type))
+			payload_header->checksum = htole16(compute_checksum(sendbuf,
+					sizeof(struct esp_payload_header)+len));
 	}
 
 done:
@@ -24,6 +24,9 @@
  */
 static char chip_type = ESP_PRIV_FIRMWARE_CHIP_UNRECOGNIZED;
 
+/* Priority queues on which slave computes and verifies checksum */
+static uint8_t checksum_prio_q_mask = ESP_CHECKSUM_ALL_PRIO_Q;
+
 /**
  * @brief  open virtual network device
  * @param  netdev - network device
@@ -148,6 +151,17 @@ void process_event(uint8_t *evt_buf, uint16_t len)
 	}
 }
 
+/**
+ * @brief  Check if slave verifies checksum for given interface type
+ * @param  if_type - interface type of packet
+ * @retval 1 if checksum is in use, 0 otherwise
+ */
+uint8_t is_checksum_enabled(uint8_t if_type)
+{
+	return !!(checksum_prio_q_mask &
+			ESP_PRIO_Q_BIT(esp_if_type_to_prio_q(if_type)));
+}
+
 int process_init_event(uint8_t *evt_buf, uint8_t len)
 {
 	uint8_t len_left = len, tag_len;
@@ -155,6 +169,8 @@ int process_init_event(uint8_t *evt_buf, uint8_t len)
 	if (!evt_buf)
 		return STM_FAIL;
 	pos = evt_buf;
+	/* Older slave firmware checksums all queues */
+	checksum_prio_q_mask = ESP_CHECKSUM_ALL_PRIO_Q;
 	while (len_left) {
 		tag_len = *(pos + 1);
 		printf("EVENT: %d\n\r", *pos);
@@ -162,6 +178,9 @@ int process_init_event(uint8_t *evt_buf, uint8_t len)
 			printf("priv capabilty \n\r");
 			process_capabilities(*(pos + 2));
 			print_capabilities(*(pos + 2));
+		} else if (*pos == ESP_PRIV_CHECKSUM_PRIO_Q) {
+			checksum_prio_q_mask = *(pos + 2);
+			printf("checksum on priority queues: 0x%x\n\r", checksum_prio_q_mask);
 		} else if (*pos == ESP_PRIV_SPI_CLK_MHZ) {
 			// adjust spi clock
 		} else if (*pos == ESP_PRIV_FIRMWARE_CHIP_ID) {
@@ -58,6 +58,7 @@ void process_event(uint8_t *evt_buf, uint16_t len);
 void process_priv_communication(struct pbuf *pbuf);
 void print_capabilities(uint32_t cap);
 int process_init_event(uint8_t *evt_buf, uint8_t len);
+uint8_t is_checksum_enabled(uint8_t if_type);
 
 stm_ret_t send_to_slave(uint8_t iface_type, uint8_t iface_num,
 		uint8_t * wbuffer, uint16_t wlen);
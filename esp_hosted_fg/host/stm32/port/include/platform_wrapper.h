@@ -178,6 +178,12 @@ void *hosted_timer_start(int duration, int type,
  */
 int hosted_timer_stop(void *timer_handle);
 
+/* hosted_get_time_ms gives monotonic time
+ * Returns
+ *      milliseconds elapsed since an arbitrary fixed point
+ */
+uint64_t hosted_get_time_ms(void);
+
 /* msleep is sleep in milliseconds
  * Input parameters
  *      mseconds : milliseconds
@@ -235,11 +241,27 @@ int serial_drv_write (struct serial_drv_handle_t* serial_drv_handle,
  * Returns
  *      buf                         :   Protocol encoded data Buffer
  *                                      caller will decode the protobuf
+ *                                      Buffer is owned by serial driver and
+ *                                      is valid till next serial_drv_read,
+ *                                      caller must not free it
  */
 
 uint8_t * serial_drv_read(struct serial_drv_handle_t *serial_drv_handle,
 		uint32_t *out_nbyte);
 
+/*
+ * serial_drv_get_poll_fd function switches driver reads to non blocking
+ * and gives file descriptor to wait on, for application event loop.
+ * Once switched, serial_drv_read returns NULL when frame is not available yet
+ *
+ * Input parameter
+ *      serial_drv_handle           :   Driver Handle
+ * Returns
+ *      file descriptor, readable when data is available
+ *      FAILURE(-1), if not supported
+ */
+int serial_drv_get_poll_fd(struct serial_drv_handle_t* serial_drv_handle);
+
 /*
  * serial_drv_close function closes driver interface.
  *
@@ -23,17 +23,11 @@
 #define TICKS_PER_SEC (1000 / portTICK_PERIOD_MS);
 #define SEC_TO_MILLISEC(x) (1000*(x))
 
-#define HOSTED_CALLOC(buff,nbytes) do {                           \
-    buff = (uint8_t *)hosted_calloc(1, nbytes);                   \
-    if (!buff) {                                                  \
-        printf("%s, Failed to allocate memory \n", __func__);     \
-        goto free_bufs;                                           \
-    }                                                             \
-} while(0);
-
 
 static osSemaphoreId readSemaphore;
 static serial_ll_handle_t * serial_ll_if_g;
+/* Buffer of last serial_drv_read, payload handed over points in it */
+static uint8_t * last_read_buf;
 
 static void control_path_rx_indication(void);
 
@@ -301,6 +295,11 @@ int hosted_timer_stop(void *timer_handle)
 	return STM_FAIL;
 }
 
+uint64_t hosted_get_time_ms(void)
+{
+	return (uint64_t)osKernelSysTick() * portTICK_PERIOD_MS;
+}
+
 /* Sample timer_handler looks like this:
  *
  * void expired(union sigval timer_data){
@@ -428,7 +427,6 @@ uint8_t * serial_drv_read(struct serial_drv_handle_t *serial_drv_handle,
 	/* Any of `CTRL_EP_NAME_EVENT` and `CTRL_EP_NAME_RESP` could be used,
 	 * as both have same strlen in adapter.h */
 	const char* ep_name = CTRL_EP_NAME_RESP;
-	uint8_t *buf = NULL;
 	uint32_t buf_len = 0;
 
 
@@ -439,6 +437,9 @@ uint8_t * serial_drv_read(struct serial_drv_handle_t *serial_drv_handle,
 
 	*out_nbyte = 0;
 
+	/* Payload returned in previous read is done with by now */
+	mem_free(last_read_buf);
+
 	if(!readSemaphore) {
 		printf("Semaphore not initialized\n\r");
 		return NULL;
@@ -464,13 +465,13 @@ uint8_t * serial_drv_read(struct serial_drv_handle_t *serial_drv_handle,
 	print_hex_dump(read_buf, rx_buf_len, "Serial read data");
 
 /*
- * Read Operation happens in two steps because total read length is unknown
- * at first read.
- *      1) Read fixed length of RX data
- *      2) Read variable length of RX data
+ * Buffer from serial interface holds complete frame, parsed in two steps
+ * because total length is unknown till header is parsed.
+ *      1) Fixed length of RX data
+ *      2) Variable length of RX data
  *
- * (1) Read fixed length of RX data :
- * Read fixed length of received data in below format:
+ * (1) Fixed length of RX data :
+ * Fixed length of received data in below format:
  * ----------------------------------------------------------------------------
  *  Endpoint Type | Endpoint Length | Endpoint Value  | Data Type | Data Length
  * ----------------------------------------------------------------------------
@@ -487,50 +488,45 @@ uint8_t * serial_drv_read(struct serial_drv_handle_t *serial_drv_handle,
 		SIZE_OF_TYPE + SIZE_OF_LENGTH;
 
 	if(rx_buf_len < init_read_len) {
-		mem_free(read_buf);
 		printf("Incomplete serial buff, return\n");
-		return NULL;
+		goto free_bufs;
 	}
 
-	HOSTED_CALLOC(buf,init_read_len);
-
-	memcpy(buf, read_buf, init_read_len);
-
 	/* parse_tlv function returns variable payload length
 	 * of received data in buf_len
 	 **/
-	ret = parse_tlv(buf, &buf_len);
+	ret = parse_tlv(read_buf, &buf_len);
 	if (ret || !buf_len) {
-		mem_free(buf);
 		printf("Failed to parse RX data \n\r");
 		goto free_bufs;
 	}
 
 	if (rx_buf_len < (init_read_len + buf_len)) {
 		printf("Buf read on serial iface is smaller than expected len\n");
-		mem_free(buf);
 		goto free_bufs;
 	}
 
-	mem_free(buf);
 /*
- * (2) Read variable length of RX data:
+ * (2) Variable length of RX data follows the header in same buffer,
+ * hand it over in place. read_buf is kept till next read.
  */
-	HOSTED_CALLOC(buf,buf_len);
-
-	memcpy((buf), read_buf+init_read_len, buf_len);
-
-	mem_free(read_buf);
+	last_read_buf = read_buf;
 
 	*out_nbyte = buf_len;
-	return buf;
+	return read_buf + init_read_len;
 
 free_bufs:
 	mem_free(read_buf);
-	mem_free(buf);
 	return NULL;
 }
 
+int serial_drv_get_poll_fd(struct serial_drv_handle_t* serial_drv_handle)
+{
+	/* Reads are driven by serial_ll rx indication, no fd to poll */
+	printf("Poll fd not supported\n\r");
+	return STM_FAIL;
+}
+
 int serial_drv_close(struct serial_drv_handle_t** serial_drv_handle)
 {
 	if (!serial_drv_handle || !(*serial_drv_handle)) {
@@ -539,6 +535,7 @@ int serial_drv_close(struct serial_drv_handle_t** serial_drv_handle)
 			mem_free(serial_drv_handle);
 		return STM_FAIL;
 	}
+	mem_free(last_read_buf);
 	mem_free(*serial_drv_handle);
 	return STM_OK;
 }
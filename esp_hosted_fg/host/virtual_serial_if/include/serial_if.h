@@ -14,6 +14,12 @@
 #define SIZE_OF_TYPE                1
 #define SIZE_OF_LENGTH              2
 
+/* Length of TLV header ahead of data, i.e. endpoint name TLV and
+ * type, length of data TLV. Both endpoint names have same length */
+#define SERIAL_TLV_HEADER_LEN       (SIZE_OF_TYPE + SIZE_OF_LENGTH + \
+                                     sizeof(CTRL_EP_NAME_RESP) - 1 + \
+                                     SIZE_OF_TYPE + SIZE_OF_LENGTH)
+
 /*
  * The data written on serial driver file, `SERIAL_IF_FILE` from adapter.h
  * In TLV i.e. Type Length Value format, to transfer data between host and ESP32
@@ -25,6 +31,11 @@
  */
 uint16_t compose_tlv(uint8_t* buf, uint8_t* data, uint16_t data_length);
 
+/* Compose only TLV header, of SERIAL_TLV_HEADER_LEN bytes, in buf
+ * for data_length bytes of data which follow it
+ **/
+uint16_t compose_tlv_header(uint8_t* buf, uint16_t data_length);
+
 /* Parse the protobuf encoded data in format of tag, length and value
  * Thi will help application to decode protobuf payload and payload length
  **/
@@ -42,7 +53,20 @@ int transport_pserial_close(void);
  **/
 int transport_pserial_send(uint8_t* data, uint16_t data_length);
 
+/* Send buffer already holding data_length bytes of data after
+ * SERIAL_TLV_HEADER_LEN bytes reserved for TLV header.
+ * Header is filled in place, so data is not copied. Buffer must be allocated
+ * with hosted_malloc/hosted_calloc and is freed by transport, also on failure
+ **/
+int transport_pserial_send_buf(uint8_t* buf, uint16_t data_length);
+
 /* Read and return number of bytes and buffer from serial interface
+ * Returned buffer is owned by serial driver and is valid till next read
  **/
 uint8_t * transport_pserial_read(uint32_t *out_nbyte);
+
+/* Switch serial interface reads to non blocking and return fd to poll
+ * transport_pserial_read then returns NULL if no complete frame is available
+ **/
+int transport_pserial_get_poll_fd(void);
 #endif
@@ -43,6 +43,15 @@ struct serial_drv_handle_t* serial_handle = NULL;
  */
 
 uint16_t compose_tlv(uint8_t* buf, uint8_t* data, uint16_t data_length)
+{
+	uint16_t count = compose_tlv_header(buf, data_length);
+
+	memcpy(&buf[count], data, data_length);
+	count = count + data_length;
+	return count;
+}
+
+uint16_t compose_tlv_header(uint8_t* buf, uint16_t data_length)
 {
 	char* ep_name = CTRL_EP_NAME_RESP;
 	uint16_t ep_length = strlen(ep_name);
@@ -61,8 +70,6 @@ uint16_t compose_tlv(uint8_t* buf, uint8_t* data, uint16_t data_length)
 	count++;
 	buf[count] = ((data_length >> 8) & 0xFF);
 	count++;
-	memcpy(&buf[count], data, data_length);
-	count = count + data_length;
 	return count;
 }
 
@@ -152,11 +159,22 @@ int transport_pserial_open(void)
 
 int transport_pserial_send(uint8_t* data, uint16_t data_length)
 {
-	char* ep_name = CTRL_EP_NAME_RESP;
-	int count = 0, ret = 0;
-	uint16_t buf_len = 0;
 	uint8_t *write_buf = NULL;
 
+	HOSTED_CALLOC(write_buf, SERIAL_TLV_HEADER_LEN + data_length);
+
+	memcpy(write_buf + SERIAL_TLV_HEADER_LEN, data, data_length);
+
+	return transport_pserial_send_buf(write_buf, data_length);
+
+free_bufs:
+	return FAILURE;
+}
+
+int transport_pserial_send_buf(uint8_t* buf, uint16_t data_length)
+{
+	int count = 0, ret = 0;
+
 /*
  * TLV (Type - Length - Value) structure is as follows:
  * --------------------------------------------------------------------------------------------
@@ -168,38 +186,47 @@ int transport_pserial_send(uint8_t* data, uint16_t data_length)
  *       1        |        2        | Endpoint length |     1     |      2      | Data length |
  * --------------------------------------------------------------------------------------------
  */
-	buf_len = SIZE_OF_TYPE + SIZE_OF_LENGTH + strlen(ep_name) +
-		SIZE_OF_TYPE + SIZE_OF_LENGTH + data_length;
-
-	HOSTED_CALLOC(write_buf,buf_len);
+	if (!buf) {
+		command_log("Invalid TX buffer\n");
+		return FAILURE;
+	}
 
 	if (!serial_handle) {
 		command_log("Serial connection closed?\n");
 		goto free_bufs;
 	}
 
-	count = compose_tlv(write_buf, data, data_length);
-	if (!count) {
+	count = compose_tlv_header(buf, data_length);
+	if (count != SERIAL_TLV_HEADER_LEN) {
 		command_log("Failed to compose TX data\n");
 		goto free_bufs;
 	}
+	count += data_length;
 
-	ret = serial_drv_write(serial_handle, write_buf, count, &count);
+	/* serial driver owns buf from here, even on failure */
+	ret = serial_drv_write(serial_handle, buf, count, &count);
 	if (ret != SUCCESS) {
 		command_log("Failed to write TX data\n");
-		goto free_bufs;
+		return FAILURE;
 	}
 	return SUCCESS;
 free_bufs:
-	if (write_buf) {
-		mem_free(write_buf);
-	}
+	mem_free(buf);
 
 	return FAILURE;
 }
 
 uint8_t * transport_pserial_read(uint32_t *out_nbyte)
 {
-	/* Two step parsing TLV is moved in serial_drv_read */
+	/* TLV parsing is moved in serial_drv_read */
 	return serial_drv_read(serial_handle, out_nbyte);
 }
+
+int transport_pserial_get_poll_fd(void)
+{
+	if (!serial_handle) {
+		command_log("Serial connection closed?\n");
+		return FAILURE;
+	}
+	return serial_drv_get_poll_fd(serial_handle);
+}
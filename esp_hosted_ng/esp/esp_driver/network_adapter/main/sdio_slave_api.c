@@ -38,6 +38,49 @@ static interface_context_t context;
 static interface_handle_t if_handle_g;
 static const char TAG[] = "FW_SDIO_SLAVE";
 
+/* Packets are back to back in stream to host, each one 4 byte aligned */
+#define SDIO_TX_ALIGN(len)      (((len) + 3) & ~3)
+
+#if CONFIG_ESP_SDIO_TX_QUEUE
+/* Buffers queued to host and not yet reclaimed. Bootup event goes before
+ * data path is open, so only one task sends at a time */
+static uint32_t tx_queued;
+
+static void sdio_tx_reclaim(TickType_t wait)
+{
+	void *buf = NULL;
+
+	while (sdio_slave_send_get_finished(&buf, wait) == ESP_OK) {
+		free(buf);
+		tx_queued--;
+		wait = 0;
+	}
+}
+#endif
+
+/* DMA capable send buffer of SDIO_TX_ALIGN(len) bytes, owned by this call */
+static esp_err_t sdio_tx_send(uint8_t *sendbuf, uint32_t len)
+{
+	esp_err_t ret = ESP_OK;
+
+#if CONFIG_ESP_SDIO_TX_QUEUE
+	/* Block for host to read only once send queue is full */
+	sdio_tx_reclaim(tx_queued >= SDIO_SLAVE_QUEUE_SIZE ? portMAX_DELAY : 0);
+
+	ret = sdio_slave_send_queue(sendbuf, SDIO_TX_ALIGN(len), sendbuf,
+			portMAX_DELAY);
+	if (ret == ESP_OK) {
+		tx_queued++;
+		return ESP_OK;
+	}
+#else
+	ret = sdio_slave_transmit(sendbuf, len);
+#endif
+
+	free(sendbuf);
+	return ret;
+}
+
 static interface_handle_t * sdio_init(void);
 static int32_t sdio_write(interface_handle_t *handle, interface_buffer_handle_t *buf_handle);
 static int sdio_read(interface_handle_t *if_handle, interface_buffer_handle_t *buf_handle);
@@ -98,6 +141,14 @@ IRAM_ATTR static void event_cb(uint8_t val)
 static void sdio_read_done(void *handle)
 {
 	sdio_slave_recv_load_buf((sdio_slave_buf_handle_t) handle);
+
+	/* Buffers written by host are only returned here, after they are
+	 * processed, so ESP cannot tell whether host has run out of them.
+	 * Host sets wait flag before it waits, notify only then */
+	if (sdio_slave_read_reg(ESP_TX_BUF_WAIT_SCRATCH_POS)) {
+		sdio_slave_write_reg(ESP_TX_BUF_WAIT_SCRATCH_POS, 0);
+		sdio_slave_send_host_int(ESP_TX_BUF_AVAILABLE);
+	}
 }
 
 static interface_handle_t * sdio_init(void)
@@ -252,7 +303,7 @@ static int32_t sdio_write(interface_handle_t *handle, interface_buffer_handle_t
 
 	total_len = buf_handle->payload_len + sizeof (struct esp_payload_header);
 
-	sendbuf = heap_caps_malloc(total_len, MALLOC_CAP_DMA);
+	sendbuf = heap_caps_malloc(SDIO_TX_ALIGN(total_len), MALLOC_CAP_DMA);
 	if (sendbuf == NULL) {
 		ESP_LOGE(TAG , "Malloc send buffer fail!");
 		return ESP_FAIL;
@@ -278,10 +329,9 @@ static int32_t sdio_write(interface_handle_t *handle, interface_buffer_handle_t
 				offset+buf_handle->payload_len));
 #endif
 
-	ret = sdio_slave_transmit(sendbuf, total_len);
+	ret = sdio_tx_send(sendbuf, total_len);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG , "sdio slave transmit error, ret : 0x%x\r\n", ret);
-		free(sendbuf);
 		return ESP_FAIL;
 	}
 #if 0
@@ -289,7 +339,6 @@ static int32_t sdio_write(interface_handle_t *handle, interface_buffer_handle_t
 	ESP_LOG_BUFFER_HEXDUMP("s->h", buf_handle->payload,
 	  buf_handle->payload_len, ESP_LOG_INFO);
 #endif
-	free(sendbuf);
 
 	return buf_handle->payload_len;
 }
@@ -362,14 +411,12 @@ esp_err_t send_bootup_event_to_host(uint8_t cap)
 	header->checksum = htole16(compute_checksum(buf_handle.payload, buf_handle.payload_len));
 #endif
 
-	ret = sdio_slave_transmit(buf_handle.payload, buf_handle.payload_len);
+	ret = sdio_tx_send(buf_handle.payload, buf_handle.payload_len);
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG , "sdio slave tx error, ret : 0x%x\r\n", ret);
-		free(buf_handle.payload);
 		return ESP_FAIL;
 	}
 
-	free(buf_handle.payload);
 	return ESP_OK;
 }
 
@@ -437,6 +484,9 @@ static esp_err_t sdio_reset(interface_handle_t *handle)
 	if (ret != ESP_OK)
 		return ret;
 
+	/* With CONFIG_ESP_SDIO_TX_QUEUE, send buffers returned here are
+	 * reclaimed by sdio_tx_send() instead */
+#if !CONFIG_ESP_SDIO_TX_QUEUE
 	while (1) {
 		sdio_slave_buf_handle_t handle = NULL;
 
@@ -450,6 +500,7 @@ static esp_err_t sdio_reset(interface_handle_t *handle)
 			ESP_ERROR_CHECK(ret);
 		}
 	}
+#endif
 
 	return ESP_OK;
 }
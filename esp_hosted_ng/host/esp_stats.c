@@ -8,6 +8,7 @@
 
 #include "utils.h"
 #include "esp_stats.h"
+#include <linux/math64.h>
 
 #if TEST_RAW_TP
 
@@ -193,3 +194,30 @@ void process_test_capabilities(u32 raw_tp_mode)
 	process_raw_tp_flags();
 #endif
 }
+
+void esp_lat_hist_print(const char *name, const struct esp_lat_hist *hist)
+{
+	u32 idx = 0;
+
+	if (!hist->samples)
+		return;
+
+	esp_info("%s latency: %llu samples, avg %llu us, max %llu us\n", name,
+			hist->samples, div64_u64(hist->total_us, hist->samples),
+			hist->max_us);
+
+	for (idx = 0; idx < ESP_LAT_HIST_BUCKETS; idx++) {
+		if (!hist->bucket[idx])
+			continue;
+
+		if (!idx)
+			esp_info("%s latency: %6u - %6u us: %llu\n", name, 0, 1,
+					hist->bucket[idx]);
+		else if (idx == ESP_LAT_HIST_BUCKETS - 1)
+			esp_info("%s latency: %6u -    max us: %llu\n", name,
+					1U << (idx - 1), hist->bucket[idx]);
+		else
+			esp_info("%s latency: %6u - %6u us: %llu\n", name,
+					1U << (idx - 1), 1U << idx, hist->bucket[idx]);
+	}
+}
@@ -73,6 +73,17 @@ enum ESP_HOST_INTERRUPT {
 	ESP_POWER_SAVE_OFF,
 };
 
+/* SDIO general purpose interrupt bits raised by ESP to host */
+enum ESP_SLAVE_INTERRUPT {
+	/* ESP loaded a receive buffer while host waits for one */
+	ESP_TX_BUF_AVAILABLE,
+};
+
+/* Byte of scratch register 0 which host sets before it waits for
+ * ESP_TX_BUF_AVAILABLE. ESP raises the interrupt only while it is set,
+ * and clears it as it does */
+#define ESP_TX_BUF_WAIT_SCRATCH_POS     0
+
 enum ESP_CAPABILITIES {
 	ESP_WLAN_SDIO_SUPPORT = (1 << 0),
 	ESP_BT_UART_SUPPORT = (1 << 1),
@@ -168,5 +168,7 @@ struct esp_wifi_device {
 
 struct esp_skb_cb {
 	struct esp_wifi_device      *priv;
+	/* Set by transport as SKB is queued for TX */
+	ktime_t                     tx_enqueue_time;
 };
 #endif
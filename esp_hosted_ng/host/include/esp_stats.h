@@ -25,4 +25,36 @@ inline void esp_raw_tp_queue_resume(void);
 void test_raw_tp_cleanup(void);
 void update_test_raw_tp_rx_stats(u16 len);
 
+/* Latency histogram with log2 buckets
+ * bucket[0] counts samples below 1 us, bucket[n] samples in [2^(n-1), 2^n) us
+ * and last bucket everything above. Not locked, meant for single updater */
+#define ESP_LAT_HIST_BUCKETS     16
+
+struct esp_lat_hist {
+	u64 bucket[ESP_LAT_HIST_BUCKETS];
+	u64 samples;
+	u64 total_us;
+	u64 max_us;
+};
+
+static inline void esp_lat_hist_add(struct esp_lat_hist *hist, s64 us)
+{
+	u32 idx = 0;
+
+	if (us < 0)
+		us = 0;
+
+	idx = fls64(us);
+	if (idx >= ESP_LAT_HIST_BUCKETS)
+		idx = ESP_LAT_HIST_BUCKETS - 1;
+
+	hist->bucket[idx]++;
+	hist->samples++;
+	hist->total_us += us;
+	if (us > hist->max_us)
+		hist->max_us = us;
+}
+
+void esp_lat_hist_print(const char *name, const struct esp_lat_hist *hist);
+
 #endif
@@ -824,17 +824,21 @@ struct sk_buff *esp_alloc_skb(u32 len)
 static int esp_get_packets(struct esp_adapter *adapter)
 {
 	struct sk_buff *skb = NULL;
+	int count = 0;
 
 	if (!adapter || !adapter->if_ops || !adapter->if_ops->read)
 		return -EINVAL;
 
-	skb = adapter->if_ops->read(adapter);
+	/* Drain all packets available from transport, single SDIO read may
+	 * bring in multiple of them */
+	while ((skb = adapter->if_ops->read(adapter))) {
+		process_rx_packet(adapter, skb);
+		count++;
+	}
 
-	if (!skb)
+	if (!count)
 		return -EFAULT;
 
-	process_rx_packet(adapter, skb);
-
 	return 0;
 }
 
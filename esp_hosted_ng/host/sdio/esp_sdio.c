@@ -17,15 +17,22 @@
 #include "esp_api.h"
 #include "esp_bt_api.h"
 #include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
 #include "esp_stats.h"
 #include "esp_utils.h"
 #include "include/esp_kernel_port.h"
 
 extern u32 raw_tp_mode;
-#define MAX_WRITE_RETRIES       2
 #define TX_MAX_PENDING_COUNT    200
 #define TX_RESUME_THRESHOLD     (TX_MAX_PENDING_COUNT/5)
 
+/* ESP raises ESP_TX_BUF_AVAILABLE as it loads a buffer, if host has set its
+ * wait flag. Older firmware does not, so buffer count is re-read at least
+ * every jiffy while waiting */
+#define TX_BUF_WAIT_MAX_MS      10
+#define TX_BUF_POLL_JIFFIES     1
+
 #define CHECK_SDIO_RW_ERROR(ret) do {			\
 	if (ret)						\
 	esp_err("CMD53 read/write error at %d\n", __LINE__);	\
@@ -35,6 +42,24 @@ struct esp_sdio_context sdio_context;
 static atomic_t tx_pending;
 static atomic_t queue_items[MAX_PRIORITY_QUEUES];
 
+/* TX thread sleeps here for packets to send or for ESP buffers */
+static DECLARE_WAIT_QUEUE_HEAD(tx_wq);
+static atomic_t tx_buf_event;
+
+/* Enqueue to CMD53 write done, in TX thread only */
+static struct esp_lat_hist tx_lat_hist;
+static u64 tx_buf_waits;
+static u64 tx_buf_drops;
+/* CMD53 writes by number of packets in them */
+static u64 tx_batch_hist[ESP_TX_BATCH_MAX + 1];
+
+/* Interrupts by number of packets read for them, in RX path only */
+static u64 rx_batch_hist[ESP_RX_BATCH_HIST_MAX + 1];
+static u32 rx_intr_pkts;
+
+/* ESP buffers known to be free, in TX thread only */
+static u32 tx_buf_available;
+
 #ifdef CONFIG_ENABLE_MONITOR_PROCESS
 struct task_struct *monitor_thread;
 #endif
@@ -64,6 +89,11 @@ static void esp_process_interrupt(struct esp_sdio_context *context, u32 int_stat
 	if (int_status & ESP_SLAVE_RX_NEW_PACKET_INT) {
 		esp_process_new_packet_intr(context->adapter);
 	}
+
+	if (int_status & BIT(ESP_TX_BUF_AVAILABLE)) {
+		atomic_set(&tx_buf_event, 1);
+		wake_up_interruptible(&tx_wq);
+	}
 }
 
 static void esp_handle_isr(struct sdio_func *func)
@@ -106,6 +136,29 @@ static void esp_handle_isr(struct sdio_func *func)
 	kfree(int_status);
 }
 
+/* Ask ESP to raise ESP_TX_BUF_AVAILABLE on next buffer it loads */
+static int set_tx_buf_wait(struct esp_sdio_context *context)
+{
+	u8 *val;
+	int ret = 0;
+
+	val = kmalloc(sizeof(u8), GFP_KERNEL);
+
+	if (!val) {
+		return -ENOMEM;
+	}
+
+	*val = 1;
+
+	ret = esp_write_reg(context,
+			ESP_SLAVE_SCRATCH_REG_0 + ESP_TX_BUF_WAIT_SCRATCH_POS, val,
+			sizeof(*val), ACQUIRE_LOCK);
+
+	kfree(val);
+
+	return ret;
+}
+
 int generate_slave_intr(struct esp_sdio_context *context, u8 data)
 {
 	u8 *val;
@@ -242,6 +295,42 @@ static void flush_sdio(struct esp_sdio_context *context)
 }
 #endif
 
+static void print_tx_stats(void)
+{
+	u8 count = 0;
+
+	esp_lat_hist_print("sdio tx", &tx_lat_hist);
+	esp_info("sdio tx: waited for ESP buffers %llu times, dropped %llu\n",
+			tx_buf_waits, tx_buf_drops);
+
+	for (count = 1; count <= ESP_TX_BATCH_MAX; count++) {
+		if (tx_batch_hist[count])
+			esp_info("sdio tx: %u packets per write: %llu\n", count,
+					tx_batch_hist[count]);
+	}
+}
+
+static void print_rx_stats(void)
+{
+	u8 count = 0;
+
+	for (count = 1; count <= ESP_RX_BATCH_HIST_MAX; count++) {
+		if (rx_batch_hist[count])
+			esp_info("sdio rx: %u%s packets per interrupt: %llu\n", count,
+					(count == ESP_RX_BATCH_HIST_MAX) ? "+" : "",
+					rx_batch_hist[count]);
+	}
+}
+
+static void rx_intr_done(void)
+{
+	if (!rx_intr_pkts)
+		return;
+
+	rx_batch_hist[min_t(u32, rx_intr_pkts, ESP_RX_BATCH_HIST_MAX)]++;
+	rx_intr_pkts = 0;
+}
+
 static void esp_remove(struct sdio_func *func)
 {
 	struct esp_sdio_context *context;
@@ -262,6 +351,9 @@ static void esp_remove(struct sdio_func *func)
 	if (tx_thread)
 		kthread_stop(tx_thread);
 
+	print_tx_stats();
+	print_rx_stats();
+
 	if (context) {
 		generate_slave_intr(context, BIT(ESP_CLOSE_DATA_PATH));
 		msleep(100);
@@ -281,6 +373,8 @@ static void esp_remove(struct sdio_func *func)
 			deinit_sdio_func(context->func);
 			context->func = NULL;
 		}
+		skb_queue_purge(&context->rx_q);
+		kfree(context->tx_batch_buf);
 		memset(context, 0, sizeof(struct esp_sdio_context));
 	}
 	esp_dbg("ESP SDIO cleanup completed\n");
@@ -358,12 +452,77 @@ static int init_context(struct esp_sdio_context *context)
 		skb_queue_head_init(&(sdio_context.tx_q[prio_q_idx]));
 		atomic_set(&queue_items[prio_q_idx], 0);
 	}
+	skb_queue_head_init(&context->rx_q);
 
 	context->adapter->if_type = ESP_IF_TYPE_SDIO;
 
 	return ret;
 }
 
+static u32 get_rx_pkt_len(struct esp_payload_header *header, u32 room)
+{
+	u16 offset = 0;
+	u32 len = 0;
+
+	if (room < sizeof(struct esp_payload_header))
+		return 0;
+
+	offset = le16_to_cpu(header->offset);
+	if (offset != sizeof(struct esp_payload_header))
+		return 0;
+
+	len = offset + le16_to_cpu(header->len);
+	if (len > room)
+		return 0;
+
+	return len;
+}
+
+/* ESP may have queued multiple packets, which come back to back in one read,
+ * each at 4 byte aligned position. Packets after first one are copied out to
+ * rx_q, first one is handed over in rx skb */
+static struct sk_buff *split_rx_packets(struct esp_sdio_context *context,
+		struct sk_buff *skb)
+{
+	struct esp_payload_header *header = NULL;
+	struct sk_buff *pkt_skb = NULL;
+	u32 first_len, pos, len;
+
+	first_len = get_rx_pkt_len((struct esp_payload_header *) skb->data,
+			skb->len);
+
+	/* Let process_rx_packet() deal with it as a single packet */
+	if (!first_len)
+		return skb;
+
+	pos = round_up(first_len, 4);
+
+	while (pos < skb->len) {
+		header = (struct esp_payload_header *) (skb->data + pos);
+		len = get_rx_pkt_len(header, skb->len - pos);
+		if (!len) {
+			esp_err("Invalid packet at %u of %u byte read, drop rest\n",
+					pos, skb->len);
+			break;
+		}
+
+		pkt_skb = esp_alloc_skb(len);
+		if (!pkt_skb) {
+			esp_err("Failed to allocate SKB for batched pkt\n");
+			break;
+		}
+
+		memcpy(skb_put(pkt_skb, len), header, len);
+		skb_queue_tail(&context->rx_q, pkt_skb);
+
+		pos = round_up(pos + len, 4);
+	}
+
+	skb_trim(skb, first_len);
+
+	return skb;
+}
+
 static struct sk_buff *read_packet(struct esp_adapter *adapter)
 {
 	u32 len_from_slave, data_left, len_to_read, size, num_blocks;
@@ -384,6 +543,13 @@ static struct sk_buff *read_packet(struct esp_adapter *adapter)
 		return NULL;
 	}
 
+	/* Packets left over from last read go first */
+	skb = skb_dequeue(&context->rx_q);
+	if (skb) {
+		rx_intr_pkts++;
+		return skb;
+	}
+
 	sdio_claim_host(context->func);
 
 	data_left = len_to_read = len_from_slave = num_blocks = 0;
@@ -393,10 +559,12 @@ static struct sk_buff *read_packet(struct esp_adapter *adapter)
 
 	if (ret || !len_from_slave) {
 		sdio_release_host(context->func);
+		rx_intr_done();
 		return NULL;
 	}
 
-	size = ESP_BLOCK_SIZE * 4;
+	/* All packets ESP has queued are read in one go */
+	size = ESP_RX_QUEUED_MAX * ESP_RX_BUFFER_SIZE;
 
 	if (len_from_slave > size) {
 		esp_info("Rx large packet: %d\n", len_from_slave);
@@ -454,7 +622,9 @@ static struct sk_buff *read_packet(struct esp_adapter *adapter)
 
 	sdio_release_host(context->func);
 
-	return skb;
+	rx_intr_pkts++;
+
+	return split_rx_packets(context, skb);
 }
 
 static int write_packet(struct esp_adapter *adapter, struct sk_buff *skb)
@@ -494,6 +664,8 @@ static int write_packet(struct esp_adapter *adapter, struct sk_buff *skb)
 	/* Enqueue SKB in tx_q */
 	atomic_inc(&tx_pending);
 
+	cb->tx_enqueue_time = ktime_get();
+
 	/* Notify to process queue */
 	if (payload_header->if_type == ESP_INTERNAL_IF)
 		prio = PRIO_Q_HIGH;
@@ -505,6 +677,8 @@ static int write_packet(struct esp_adapter *adapter, struct sk_buff *skb)
 	atomic_inc(&queue_items[prio]);
 	skb_queue_tail(&(sdio_context.tx_q[prio]), skb);
 
+	wake_up_interruptible(&tx_wq);
+
 	return 0;
 }
 
@@ -513,52 +687,224 @@ static int is_sdio_write_buffer_available(u32 buf_needed)
 #define BUFFER_AVAILABLE        1
 #define BUFFER_UNAVAILABLE      0
 
-	int ret = 0;
-	static u32 buf_available;
 	struct esp_sdio_context *context = &sdio_context;
-	u8 retry = MAX_WRITE_RETRIES;
+	unsigned long timeout = jiffies + msecs_to_jiffies(TX_BUF_WAIT_MAX_MS);
+	u8 waited = 0;
+	u8 wait_flag_set = 0;
 
 	/*If buffer needed are less than buffer available
 	  then only read for available buffer number from slave*/
-	if (buf_available < buf_needed) {
-		while (retry) {
-			ret = esp_slave_get_tx_buffer_num(context, &buf_available, ACQUIRE_LOCK);
+	while (tx_buf_available < buf_needed) {
+		/* Clear before reading, so interrupt raised after read is not lost */
+		atomic_set(&tx_buf_event, 0);
 
-			if (buf_available < buf_needed) {
+		esp_slave_get_tx_buffer_num(context, &tx_buf_available, ACQUIRE_LOCK);
+		if (tx_buf_available >= buf_needed)
+			break;
 
-				/* Release SDIO and retry after delay*/
-				retry--;
-				usleep_range(10, 50);
-				continue;
-			}
+		if (kthread_should_stop() || time_after(jiffies, timeout)) {
+			tx_buf_drops++;
+			/* No buffer available at slave */
+			return BUFFER_UNAVAILABLE;
+		}
 
-			break;
+		if (!waited) {
+			tx_buf_waits++;
+			waited = 1;
+		}
+
+		/* Read buffer count once more after setting wait flag, so
+		 * that buffer loaded before ESP saw the flag is not missed */
+		if (!wait_flag_set) {
+			set_tx_buf_wait(context);
+			wait_flag_set = 1;
+			continue;
 		}
-	}
 
-	if (buf_available >= buf_needed)
-		buf_available -= buf_needed;
+		wait_event_interruptible_timeout(tx_wq,
+				atomic_read(&tx_buf_event) || kthread_should_stop(),
+				TX_BUF_POLL_JIFFIES);
 
-	if (!retry) {
-		/* No buffer available at slave */
-		return BUFFER_UNAVAILABLE;
+		/* ESP clears wait flag as it raises interrupt */
+		if (atomic_read(&tx_buf_event))
+			wait_flag_set = 0;
 	}
 
+	tx_buf_available -= buf_needed;
+
 	return BUFFER_AVAILABLE;
 }
 
-static int tx_process(void *data)
+static int is_tx_queued(void)
+{
+	return atomic_read(&queue_items[PRIO_Q_HIGH]) ||
+		atomic_read(&queue_items[PRIO_Q_MID]) ||
+		atomic_read(&queue_items[PRIO_Q_LOW]);
+}
+
+static int is_tx_work_pending(void)
+{
+	return kthread_should_stop() || is_tx_queued();
+}
+
+/* Dequeue next packet in priority order */
+static struct sk_buff *dequeue_tx_skb(struct esp_sdio_context *context)
+{
+	struct sk_buff *tx_skb = NULL;
+	struct esp_skb_cb *cb = NULL;
+
+	if (atomic_read(&queue_items[PRIO_Q_HIGH]) > 0) {
+		tx_skb = skb_dequeue(&(context->tx_q[PRIO_Q_HIGH]));
+		if (!tx_skb) {
+			return NULL;
+		}
+		atomic_dec(&queue_items[PRIO_Q_HIGH]);
+	} else if (atomic_read(&queue_items[PRIO_Q_MID]) > 0) {
+		tx_skb = skb_dequeue(&(context->tx_q[PRIO_Q_MID]));
+		if (!tx_skb) {
+			return NULL;
+		}
+		atomic_dec(&queue_items[PRIO_Q_MID]);
+	} else if (atomic_read(&queue_items[PRIO_Q_LOW]) > 0) {
+		tx_skb = skb_dequeue(&(context->tx_q[PRIO_Q_LOW]));
+		if (!tx_skb) {
+			return NULL;
+		}
+		atomic_dec(&queue_items[PRIO_Q_LOW]);
+	} else {
+		return NULL;
+	}
+
+	if (atomic_read(&tx_pending))
+		atomic_dec(&tx_pending);
+
+	/* resume network tx queue if bearable load */
+	cb = (struct esp_skb_cb *)tx_skb->cb;
+	if (cb && cb->priv && atomic_read(&tx_pending) < TX_RESUME_THRESHOLD) {
+		esp_tx_resume(cb->priv);
+#if TEST_RAW_TP
+		if (raw_tp_mode != 0) {
+			esp_raw_tp_queue_resume();
+		}
+#endif
+	}
+
+	return tx_skb;
+}
+
+/* Add more queued packets behind first one, as long as ESP has free buffers.
+ * Buffer count is re-read at most once and never waited for.
+ * write_packet() keeps every packet within one ESP buffer */
+static u8 dequeue_tx_batch(struct esp_sdio_context *context,
+		struct sk_buff **batch, u32 buf_reserved)
+{
+	u8 count = 1;
+	u8 refreshed = 0;
+
+	if (!context->tx_batch_buf)
+		return count;
+
+	while (count < ESP_TX_BATCH_MAX && is_tx_queued()) {
+		if (!tx_buf_available) {
+			if (refreshed)
+				break;
+
+			esp_slave_get_tx_buffer_num(context, &tx_buf_available,
+					ACQUIRE_LOCK);
+			refreshed = 1;
+
+			/* Read count still has buffers taken by this batch */
+			buf_reserved += count - 1;
+			if (tx_buf_available > buf_reserved)
+				tx_buf_available -= buf_reserved;
+			else
+				tx_buf_available = 0;
+			continue;
+		}
+
+		batch[count] = dequeue_tx_skb(context);
+		if (!batch[count])
+			break;
+
+		tx_buf_available--;
+		count++;
+	}
+
+	return count;
+}
+
+static int write_tx_skb(struct esp_sdio_context *context, struct sk_buff *tx_skb)
 {
 	int ret = 0;
 	u32 block_cnt = 0;
-	u32 buf_needed = 0;
 	u8 *pos = NULL;
 	u32 data_left, len_to_send, pad;
-	struct sk_buff *tx_skb = NULL;
+
+	pos = tx_skb->data;
+	data_left = len_to_send = 0;
+
+	data_left = tx_skb->len;
+	pad = ESP_BLOCK_SIZE - (data_left % ESP_BLOCK_SIZE);
+	data_left += pad;
+
+
+	do {
+		block_cnt = data_left / ESP_BLOCK_SIZE;
+		len_to_send = data_left;
+		ret = esp_write_block(context, ESP_SLAVE_CMD53_END_ADDR - len_to_send,
+				pos, (len_to_send + 3) & (~3), ACQUIRE_LOCK);
+
+		if (ret) {
+			esp_err("Failed to send data: %d %d %d\n", ret, len_to_send, data_left);
+			break;
+		}
+
+		data_left -= len_to_send;
+		pos += len_to_send;
+	} while (data_left);
+
+	return ret;
+}
+
+/* Send batch in one CMD53 write. ESP ends a receive buffer only when it is
+ * full or the write ends, so every packet but last is padded to the size of
+ * ESP buffer. Each then arrives at ESP in a buffer of its own */
+static int write_tx_batch(struct esp_sdio_context *context,
+		struct sk_buff **batch, u8 count)
+{
+	int ret = 0;
+	u8 *pos = context->tx_batch_buf;
+	u32 len = 0;
+	u8 idx = 0;
+
+	for (idx = 0; idx < count; idx++) {
+		memcpy(pos, batch[idx]->data, batch[idx]->len);
+
+		if (idx < count - 1)
+			pos += ESP_RX_BUFFER_SIZE;
+		else
+			pos += batch[idx]->len;
+	}
+
+	len = round_up(pos - context->tx_batch_buf, ESP_BLOCK_SIZE);
+
+	ret = esp_write_block(context, ESP_SLAVE_CMD53_END_ADDR - len,
+			context->tx_batch_buf, len, ACQUIRE_LOCK);
+	if (ret)
+		esp_err("Failed to send batch: %d %u %u\n", ret, count, len);
+
+	return ret;
+}
+
+static int tx_process(void *data)
+{
+	int ret = 0;
+	u32 buf_needed = 0;
+	struct sk_buff *tx_batch[ESP_TX_BATCH_MAX];
 	struct esp_adapter *adapter = (struct esp_adapter *) data;
 	struct esp_sdio_context *context = NULL;
 	struct esp_skb_cb *cb = NULL;
-	u8 retry;
+	u8 count = 0, idx = 0;
 
 	context = adapter->if_context;
 
@@ -576,93 +922,50 @@ static int tx_process(void *data)
 			continue;
 		}
 
-		if (atomic_read(&queue_items[PRIO_Q_HIGH]) > 0) {
-			tx_skb = skb_dequeue(&(context->tx_q[PRIO_Q_HIGH]));
-			if (!tx_skb) {
-				continue;
-			}
-			atomic_dec(&queue_items[PRIO_Q_HIGH]);
-		} else if (atomic_read(&queue_items[PRIO_Q_MID]) > 0) {
-			tx_skb = skb_dequeue(&(context->tx_q[PRIO_Q_MID]));
-			if (!tx_skb) {
-				continue;
-			}
-			atomic_dec(&queue_items[PRIO_Q_MID]);
-		} else if (atomic_read(&queue_items[PRIO_Q_LOW]) > 0) {
-			tx_skb = skb_dequeue(&(context->tx_q[PRIO_Q_LOW]));
-			if (!tx_skb) {
-				continue;
-			}
-			atomic_dec(&queue_items[PRIO_Q_LOW]);
-		} else {
-			/* esp_verbose("not ready high=%d mid=%d low=%d\n",
-					atomic_read(&queue_items[PRIO_Q_HIGH]),
-					atomic_read(&queue_items[PRIO_Q_MID]),
-					atomic_read(&queue_items[PRIO_Q_LOW])); */
-			msleep(1);
+		/* Woken up by write_packet() or kthread_stop() */
+		if (!is_tx_work_pending()) {
+			wait_event_interruptible(tx_wq, is_tx_work_pending());
 			continue;
 		}
 
-		if (atomic_read(&tx_pending))
-			atomic_dec(&tx_pending);
-
-		retry = MAX_WRITE_RETRIES;
-
-		/* resume network tx queue if bearable load */
-		cb = (struct esp_skb_cb *)tx_skb->cb;
-		if (cb && cb->priv && atomic_read(&tx_pending) < TX_RESUME_THRESHOLD) {
-			esp_tx_resume(cb->priv);
-#if TEST_RAW_TP
-			if (raw_tp_mode != 0) {
-				esp_raw_tp_queue_resume();
-			}
-#endif
-		}
+		tx_batch[0] = dequeue_tx_skb(context);
+		if (!tx_batch[0])
+			continue;
 
-		buf_needed = (tx_skb->len + ESP_RX_BUFFER_SIZE - 1) / ESP_RX_BUFFER_SIZE;
+		buf_needed = (tx_batch[0]->len + ESP_RX_BUFFER_SIZE - 1) / ESP_RX_BUFFER_SIZE;
 
 		/*If SDIO slave buffer is available to write then only write data
 		else wait till buffer is available*/
 		ret = is_sdio_write_buffer_available(buf_needed);
 		if (!ret) {
-			dev_kfree_skb(tx_skb);
+			dev_kfree_skb(tx_batch[0]);
 			continue;
 		}
 
-		pos = tx_skb->data;
-		data_left = len_to_send = 0;
-
-		data_left = tx_skb->len;
-		pad = ESP_BLOCK_SIZE - (data_left % ESP_BLOCK_SIZE);
-		data_left += pad;
+		count = dequeue_tx_batch(context, tx_batch, buf_needed);
 
+		if (count == 1)
+			ret = write_tx_skb(context, tx_batch[0]);
+		else
+			ret = write_tx_batch(context, tx_batch, count);
 
-		do {
-			block_cnt = data_left / ESP_BLOCK_SIZE;
-			len_to_send = data_left;
-			ret = esp_write_block(context, ESP_SLAVE_CMD53_END_ADDR - len_to_send,
-					pos, (len_to_send + 3) & (~3), ACQUIRE_LOCK);
+		if (!ret) {
+			/* Rest of batch takes one buffer per packet */
+			context->tx_buffer_count += buf_needed + count - 1;
+			context->tx_buffer_count = context->tx_buffer_count % ESP_TX_BUFFER_MAX;
+			tx_batch_hist[count]++;
+		}
 
-			if (ret) {
-				esp_err("Failed to send data: %d %d %d\n", ret, len_to_send, data_left);
-				break;
+		for (idx = 0; idx < count; idx++) {
+			if (!ret) {
+				cb = (struct esp_skb_cb *)tx_batch[idx]->cb;
+				esp_lat_hist_add(&tx_lat_hist,
+						ktime_us_delta(ktime_get(), cb->tx_enqueue_time));
 			}
 
-			data_left -= len_to_send;
-			pos += len_to_send;
-		} while (data_left);
-
-		if (ret) {
-			/* drop the packet */
-			dev_kfree_skb(tx_skb);
-			continue;
+			/* on failure, drop the packets */
+			dev_kfree_skb(tx_batch[idx]);
 		}
-
-		context->tx_buffer_count += buf_needed;
-		context->tx_buffer_count = context->tx_buffer_count % ESP_TX_BUFFER_MAX;
-
-		dev_kfree_skb(tx_skb);
-		tx_skb = NULL;
 	}
 
 	do_exit(0);
@@ -807,12 +1110,24 @@ static int esp_probe(struct sdio_func *func,
 
 	context->state = ESP_CONTEXT_READY;
 	atomic_set(&tx_pending, 0);
+	memset(&tx_lat_hist, 0, sizeof(tx_lat_hist));
+	memset(tx_batch_hist, 0, sizeof(tx_batch_hist));
+	memset(rx_batch_hist, 0, sizeof(rx_batch_hist));
+	rx_intr_pkts = 0;
+	tx_buf_waits = tx_buf_drops = 0;
+	tx_buf_available = 0;
 	ret = init_context(context);
 	if (ret) {
 		deinit_sdio_func(func);
 		return ret;
 	}
 
+	/* Without it, packets are sent one per write */
+	context->tx_batch_buf = kzalloc(ESP_TX_BATCH_MAX * ESP_RX_BUFFER_SIZE,
+			GFP_KERNEL);
+	if (!context->tx_batch_buf)
+		esp_warn("Failed to allocate TX batch buffer\n");
+
 	tx_thread = kthread_run(tx_process, context->adapter, "esp_TX");
 
 	if (!tx_thread)
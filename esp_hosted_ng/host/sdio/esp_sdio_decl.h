@@ -34,6 +34,9 @@
 #define ESP_TX_BUFFER_MAX              0x1000
 #define ESP_MAX_BUF_CNT                10
 
+/* Packets sent in one CMD53 write, each in its own ESP buffer */
+#define ESP_TX_BATCH_MAX               8
+
 #define ESP_SLAVE_SLCHOST_BASE         0x3FF55000
 
 #define ESP_SLAVE_SCRATCH_REG_7        (ESP_SLAVE_SLCHOST_BASE + 0x8C)
@@ -73,6 +76,12 @@
 #define ESP_DEVICE_ID_ESP32C6_1     0x6666
 #define ESP_DEVICE_ID_ESP32C6_2     0x7777
 
+/* Packets ESP may have queued to host at once, SDIO_SLAVE_QUEUE_SIZE at ESP */
+#define ESP_RX_QUEUED_MAX           20
+
+/* Packets read per interrupt are counted up to this, larger counts go in last bucket */
+#define ESP_RX_BATCH_HIST_MAX       16
+
 enum context_state {
 	ESP_CONTEXT_DISABLED = 0,
 	ESP_CONTEXT_INIT,
@@ -87,6 +96,10 @@ struct esp_sdio_context {
 	u32                    rx_byte_count;
 	u32                    tx_buffer_count;
 	u32		       sdio_clk_mhz;
+	/* Packets of a TX batch are copied here, ESP_RX_BUFFER_SIZE apart */
+	u8                     *tx_batch_buf;
+	/* Packets split out of last read, handed out before reading again */
+	struct sk_buff_head    rx_q;
 };
 
 #endif